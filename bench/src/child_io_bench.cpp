@@ -0,0 +1,64 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/ChildIoLoop.hpp"
+
+using namespace subprocess;
+
+// Each child writes 64KiB to stdout. Range(0) children run at once, and
+// their output is drained either by one thread each or by a single
+// ChildIoLoop.
+namespace {
+  const std::vector<std::string> producer{ "head", "-c", "65536", "/dev/zero" };
+
+  PopenConfig piped_stdout() {
+    PopenConfig cfg;
+    cfg.stdout = Redirection::Pipe();
+    return cfg;
+  }
+}  // namespace
+
+static void BM_DrainThreadPerChild(benchmark::State& state) {
+  const auto children = static_cast<size_t>(state.range(0));
+  const PopenConfig cfg = piped_stdout();
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    threads.reserve(children);
+    for (size_t i = 0; i < children; i++) {
+      threads.emplace_back([&cfg] {
+        auto child = Popen::create(producer, cfg).or_throw();
+        benchmark::DoNotOptimize(child.std_out->slurp());
+        child.wait().or_throw();
+      });
+    }
+    for (auto& t : threads) t.join();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 65536);
+}
+BENCHMARK(BM_DrainThreadPerChild)->RangeMultiplier(4)->Range(4, 256)->UseRealTime();
+
+static void BM_DrainChildIoLoop(benchmark::State& state) {
+  const auto children = static_cast<size_t>(state.range(0));
+  const PopenConfig cfg = piped_stdout();
+  size_t bytes = 0;
+  ChildIoLoop::Handlers handlers{
+    [&](ChildIoLoop::Id, const char*, size_t len) { bytes += len; },
+    nullptr,
+    nullptr,
+  };
+  for (auto _ : state) {
+    ChildIoLoop loop{ handlers };
+    for (size_t i = 0; i < children; i++) {
+      loop.add(Popen::create(producer, cfg).or_throw()).or_throw();
+    }
+    loop.run();
+  }
+  benchmark::DoNotOptimize(bytes);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 65536);
+}
+BENCHMARK(BM_DrainChildIoLoop)->RangeMultiplier(4)->Range(4, 256)->UseRealTime();
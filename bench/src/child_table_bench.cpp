@@ -0,0 +1,23 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "subprocess/ChildTable.hpp"
+
+using namespace subprocess;
+
+// One `reap_exited` pass over Range(0) idle children: a walk of the state
+// array and a single poll() over their pidfds.
+static void BM_ReapExitedPass(benchmark::State& state) {
+  ChildTable table;
+  PopenConfig cfg;
+  cfg.stdin = Redirection::Pipe();
+  for (int64_t i = 0; i < state.range(0); i++) table.add(Popen::create({"cat"}, cfg).or_throw()).or_throw();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.reap_exited());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  // the table closes each cat's stdin and waits for it
+}
+BENCHMARK(BM_ReapExitedPass)->RangeMultiplier(4)->Range(16, 1024);
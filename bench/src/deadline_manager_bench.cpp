@@ -0,0 +1,30 @@
+#include <benchmark/benchmark.h>
+
+#include <signal.h>
+
+#include <vector>
+
+#include "subprocess/DeadlineManager.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+// Add then cancel one deadline with Range(0) others pending, spread over
+// an hour: the cost should not grow with them.
+static void BM_DeadlineAddCancel(benchmark::State& state) {
+  auto child = Popen::create({"true"}, PopenConfig{}).or_throw();
+  DeadlineManager deadlines;
+  auto now = DeadlineManager::Clock::now();
+  for (int64_t i = 0; i < state.range(0); i++) {
+    deadlines.add(child, now + 1s + std::chrono::milliseconds(i * 3600000 / state.range(0)), DeadlineManager::Signal{SIGKILL});
+  }
+
+  int64_t i = 0;
+  for (auto _ : state) {
+    auto id = deadlines.add(child, now + 10s + std::chrono::milliseconds(i++ % 100000), DeadlineManager::Signal{SIGKILL});
+    benchmark::DoNotOptimize(deadlines.cancel(id));
+  }
+  state.SetItemsProcessed(state.iterations());
+  child.wait();
+}
+BENCHMARK(BM_DeadlineAddCancel)->RangeMultiplier(10)->Range(10, 100000);
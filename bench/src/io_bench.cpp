@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/posix.hpp"
+#include "vendor/fdstream.hpp"
+
+using namespace subprocess;
+
+// Bytes/s through a pipe, written with `fdostream` from one thread and read
+// with `fdistream` from another. Range(0) is the chunk size of each write.
+static void BM_PipeThroughput(benchmark::State& state) {
+  const auto chunk = static_cast<size_t>(state.range(0));
+  const size_t total = 16 << 20;
+  const std::vector<char> payload(chunk, 'x');
+  std::vector<char> sink(chunk);
+
+  for (auto _ : state) {
+    auto [read_end, write_end] = pipe().or_throw();
+    boost::fdistream in(read_end);
+    std::thread writer([&, fd = write_end] {
+      boost::fdostream out(fd);
+      for (size_t sent = 0; sent < total; sent += chunk) {
+        out.write(payload.data(), static_cast<std::streamsize>(chunk));
+      }
+    });
+    size_t received = 0;
+    while (in.read(sink.data(), static_cast<std::streamsize>(chunk)) || in.gcount() > 0) {
+      received += static_cast<size_t>(in.gcount());
+    }
+    writer.join();
+    benchmark::DoNotOptimize(received);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(total));
+}
+BENCHMARK(BM_PipeThroughput)->RangeMultiplier(8)->Range(64, 64 << 10)->UseRealTime();
+
+// Lines/s read with `std::getline` from an `fdistream`. Range(0) is the line
+// length, not counting the newline.
+static void BM_PipeGetline(benchmark::State& state) {
+  const auto line_len = static_cast<size_t>(state.range(0));
+  const size_t lines = 100000;
+  std::string block;
+  for (size_t i = 0; i < 256; i++) block += std::string(line_len, 'y') + "\n";
+
+  for (auto _ : state) {
+    auto [read_end, write_end] = pipe().or_throw();
+    boost::fdistream in(read_end);
+    std::thread writer([&, fd = write_end] {
+      boost::fdostream out(fd);
+      for (size_t sent = 0; sent < lines; sent += 256) {
+        out.write(block.data(), static_cast<std::streamsize>(block.size()));
+      }
+    });
+    std::string line;
+    size_t count = 0;
+    while (std::getline(in, line)) count++;
+    writer.join();
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(lines));
+}
+BENCHMARK(BM_PipeGetline)->Arg(16)->Arg(80)->Arg(512)->UseRealTime();
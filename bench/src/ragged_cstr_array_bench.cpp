@@ -0,0 +1,24 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "subprocess/RaggedCstrArray.hpp"
+
+using namespace subprocess;
+
+// Cost of materializing an environment of Range(0) `KEY=value` entries into
+// the null-terminated array handed to execve().
+static void BM_RaggedCstrArrayBuild(benchmark::State& state) {
+  std::vector<std::string> env;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    env.push_back("SOME_VARIABLE_" + std::to_string(i) + "=/usr/local/share/some/value");
+  }
+  for (auto _ : state) {
+    RaggedCstrArray arr{ env };
+    benchmark::DoNotOptimize(arr.asCharStar());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_RaggedCstrArrayBuild)->RangeMultiplier(4)->Range(8, 4096)->Complexity();
@@ -0,0 +1,27 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+
+using namespace subprocess;
+
+// One sampling pass over Range(0) idle children. The cost per child
+// should stay flat as the count grows.
+static void BM_SamplePass(benchmark::State& state) {
+  const auto children = static_cast<size_t>(state.range(0));
+  ResourceSampler sampler;
+  PopenConfig cfg;
+  cfg.stdin = Redirection::Pipe();
+  cfg.sampler = &sampler;
+  std::vector<Popen> running;
+  running.reserve(children);
+  for (size_t i = 0; i < children; i++) running.push_back(Popen::create({"cat"}, cfg).or_throw());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.sample_once());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  // closing stdin ends each cat, which the destructors wait for
+}
+BENCHMARK(BM_SamplePass)->RangeMultiplier(4)->Range(1, 256);
@@ -0,0 +1,76 @@
+// Child side of shared_ring_bench.cpp. Usage:
+//
+//   ring_peer ring|pipe produce <total> <chunk>   write <total> bytes out
+//   ring_peer ring|pipe echo <size>               echo <size>-byte messages
+//
+// "ring" talks over the SUBPROCESS_RING_* rings, "pipe" over stdin/stdout.
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <optional>
+#include <vector>
+
+#include "subprocess/RingChannel.hpp"
+
+using subprocess::RingChannel;
+
+namespace {
+  bool write_all(std::optional<RingChannel>& ring, const char* data, size_t len) {
+    if (ring.has_value()) return ring->write(data, len).status == boost::io_status::ok;
+    while (len > 0) {
+      auto n = ::write(1, data, len);
+      if (n <= 0) return false;
+      data += n;
+      len -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  bool read_exact(std::optional<RingChannel>& ring, char* dest, size_t len) {
+    while (len > 0) {
+      size_t got;
+      if (ring.has_value()) {
+        auto res = ring->read(dest, len);
+        if (res.status != boost::io_status::ok) return false;
+        got = res.count;
+      } else {
+        auto n = ::read(0, dest, len);
+        if (n <= 0) return false;
+        got = static_cast<size_t>(n);
+      }
+      dest += got;
+      len -= got;
+    }
+    return true;
+  }
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 4) return 2;
+  bool use_ring = strcmp(argv[1], "ring") == 0;
+  std::optional<RingChannel> in, out;
+  if (use_ring) {
+    in = RingChannel::from_env("STDIN");
+    out = RingChannel::from_env("STDOUT");
+    if (!out.has_value()) return 2;
+  }
+
+  if (strcmp(argv[2], "produce") == 0 && argc == 5) {
+    size_t total = strtoull(argv[3], nullptr, 10);
+    std::vector<char> chunk(strtoull(argv[4], nullptr, 10), 'p');
+    for (size_t sent = 0; sent < total; sent += chunk.size()) {
+      if (!write_all(out, chunk.data(), chunk.size())) return 1;
+    }
+    return 0;
+  }
+  if (strcmp(argv[2], "echo") == 0) {
+    if (use_ring && !in.has_value()) return 2;
+    std::vector<char> msg(strtoull(argv[3], nullptr, 10));
+    while (read_exact(in, msg.data(), msg.size())) {
+      if (!write_all(out, msg.data(), msg.size())) return 1;
+    }
+    return 0;
+  }
+  return 2;
+}
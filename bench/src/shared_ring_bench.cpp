@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+
+using namespace subprocess;
+
+namespace {
+  enum Channel : int64_t { Pipe = 0, Ring = 1 };
+
+  PopenConfig channel_config(int64_t channel) {
+    PopenConfig cfg;
+    if (channel == Ring) {
+      cfg.stdin = Redirection::SharedRing{ 1 << 20 };
+      cfg.stdout = Redirection::SharedRing{ 1 << 20 };
+    } else {
+      cfg.stdin = Redirection::Pipe();
+      cfg.stdout = Redirection::Pipe();
+    }
+    return cfg;
+  }
+
+  size_t read_some(Popen& child, char* buf, size_t len) {
+    if (child.ring_out.has_value()) {
+      auto res = child.ring_out->read(buf, len);
+      return res.status == boost::io_status::ok ? res.count : 0;
+    }
+    auto res = child.std_out->read_some(buf, len);
+    return res.status == boost::io_status::ok ? res.count : 0;
+  }
+
+  void write_all(Popen& child, const char* data, size_t len) {
+    if (child.ring_in.has_value()) {
+      child.ring_in->write(data, len);
+    } else {
+      child.std_in->write_some(data, len);
+    }
+  }
+}  // namespace
+
+// Bytes/s from a child to the parent. Range(0) is Pipe (0) or
+// Redirection::SharedRing (1); range(1) is the child's write size. Each
+// iteration spawns a child that produces 64 MiB.
+static void BM_ChildToParentThroughput(benchmark::State& state) {
+  const auto channel = state.range(0);
+  const auto chunk = std::to_string(state.range(1));
+  const size_t total = 64 << 20;
+  const PopenConfig cfg = channel_config(channel);
+  std::vector<char> buf(256 << 10);
+
+  for (auto _ : state) {
+    auto child = Popen::create(
+      { SUBPROCESS_RING_PEER, channel == Ring ? "ring" : "pipe", "produce", std::to_string(total), chunk },
+      cfg).or_throw();
+    size_t received = 0;
+    while (size_t n = read_some(child, buf.data(), buf.size())) received += n;
+    child.wait().or_throw();
+    if (received != total) state.SkipWithError("short read from child");
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(total));
+  state.SetLabel(channel == Ring ? "ring" : "pipe");
+}
+BENCHMARK(BM_ChildToParentThroughput)
+  ->ArgsProduct({ { Pipe, Ring }, { 4 << 10, 64 << 10 } })
+  ->UseRealTime();
+
+// Round trip of one message to an echoing child and back. Range(0) is Pipe
+// (0) or Redirection::SharedRing (1); range(1) is the message size.
+static void BM_ChildRoundTripLatency(benchmark::State& state) {
+  const auto channel = state.range(0);
+  const auto size = static_cast<size_t>(state.range(1));
+  auto child = Popen::create(
+    { SUBPROCESS_RING_PEER, channel == Ring ? "ring" : "pipe", "echo", std::to_string(size) },
+    channel_config(channel)).or_throw();
+  std::vector<char> msg(size, 'm');
+  std::vector<char> reply(size);
+
+  for (auto _ : state) {
+    write_all(child, msg.data(), size);
+    for (size_t got = 0; got < size;) {
+      size_t n = read_some(child, reply.data() + got, size - got);
+      if (n == 0) {
+        state.SkipWithError("child went away");
+        break;
+      }
+      got += n;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(channel == Ring ? "ring" : "pipe");
+}
+BENCHMARK(BM_ChildRoundTripLatency)
+  ->ArgsProduct({ { Pipe, Ring }, { 64, 4096 } })
+  ->UseRealTime();
@@ -0,0 +1,164 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "subprocess/BasicPopen.hpp"
+#include "subprocess/Popen.hpp"
+#include "subprocess/StreamBufferPool.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  PopenConfig true_config() {
+    PopenConfig cfg;
+    cfg.executable = "/bin/true";
+    return cfg;
+  }
+}  // namespace
+
+// Round trip of a single spawn: fork, exec and reap `/bin/true`.
+static void BM_SpawnAndWait(benchmark::State& state) {
+  const PopenConfig cfg = true_config();
+  for (auto _ : state) {
+    auto child = Popen::create({ "true" }, cfg).or_throw();
+    auto status = child.wait().or_throw();
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpawnAndWait)->UseRealTime();
+
+// Same as above but with every thread spawning concurrently; items/s is the
+// aggregate spawn rate across all threads. Each thread reuses its own spawn
+// buffers, so the rate should scale with the cores until fork() itself (the
+// copying of our page tables) is the limit.
+static void BM_SpawnAndWaitThreaded(benchmark::State& state) {
+  const PopenConfig cfg = true_config();
+  for (auto _ : state) {
+    auto child = Popen::create({ "true" }, cfg).or_throw();
+    auto status = child.wait().or_throw();
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpawnAndWaitThreaded)->ThreadRange(1, 64)->UseRealTime();
+
+// Spawn through a PATH lookup with all three standard streams piped, which
+// is the more common shape for callers that capture output.
+static void BM_SpawnPipedAndWait(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.stdin = Redirection::Pipe();
+  cfg.stdout = Redirection::Pipe();
+  cfg.stderr = Redirection::Pipe();
+  for (auto _ : state) {
+    auto child = Popen::create({ "true" }, cfg).or_throw();
+    auto status = child.wait().or_throw();
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpawnPipedAndWait)->UseRealTime();
+
+// How long after a child exits does `wait_timeout` notice? The child writes
+// a line right before exiting; once the parent has read it, the clock starts
+// and stops when `wait_timeout` returns the exit status.
+static void BM_WaitTimeoutDetection(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.stdout = Redirection::Pipe();
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto child = Popen::create({ "echo", "done" }, cfg).or_throw();
+    std::string line;
+    std::getline(*child.std_out, line);
+    state.ResumeTiming();
+
+    auto status = child.wait_timeout(1s).or_throw();
+    benchmark::DoNotOptimize(status);
+
+    state.PauseTiming();
+    if (!status.has_value()) state.SkipWithError("child did not exit within 1s");
+    child.wait().or_throw();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_WaitTimeoutDetection)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// Launch a burst of Range(1) children, then wait for them all; Arg(0) waits
+// for each exec in `create`, Arg(1) sets `async_exec`. items/s is the spawn
+// rate. The PATH search gives each child some setup to do before exec.
+static void BM_BurstSpawn(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.async_exec = state.range(0) != 0;
+  const auto burst = static_cast<size_t>(state.range(1));
+  std::vector<Popen> children;
+  children.reserve(burst);
+  for (auto _ : state) {
+    for (size_t i = 0; i < burst; i++) children.push_back(Popen::create({ "true" }, cfg).or_throw());
+    for (auto& child : children) benchmark::DoNotOptimize(child.wait().or_throw());
+    children.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_BurstSpawn)->ArgsProduct({ { 0, 1 }, { 16, 128 } })->UseRealTime();
+
+// Fan out Range(1) `true` children with different arguments, and reap them.
+// Arg(0) calls `create` in a loop; otherwise `create_many` from Range(0)
+// threads.
+static void BM_FanOut(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.env = std::vector<EnvVar>{ { "PATH", "/usr/bin:/bin" }, { "LANG", "C" } };
+  const auto threads = static_cast<size_t>(state.range(0));
+  std::vector<std::vector<std::string>> argvs;
+  for (int64_t i = 0; i < state.range(1); i++) argvs.push_back({ "true", std::to_string(i) });
+  for (auto _ : state) {
+    if (threads == 0) {
+      std::vector<Popen> children;
+      children.reserve(argvs.size());
+      for (const auto& argv : argvs) children.push_back(Popen::create(argv, cfg).or_throw());
+      for (auto& child : children) benchmark::DoNotOptimize(child.wait().or_throw());
+    } else {
+      auto children = Popen::create_many(argvs, cfg, threads);
+      for (auto& child : children) benchmark::DoNotOptimize(child.or_throw().wait().or_throw());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_FanOut)->ArgsProduct({ { 0, 1, 4 }, { 128 } })->UseRealTime();
+
+// Spawn `echo`, read its output through `std_out` and reap it. Read
+// buffers come from StreamBufferPool: "acquired" counts buffers handed out
+// per spawn, and "slabs" how many slabs had to be mapped for all of them.
+static void BM_SpawnCapture(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.stdout = Redirection::Pipe();
+  auto before = StreamBufferPool::stats();
+  for (auto _ : state) {
+    auto child = Popen::create({ "echo", "captured" }, cfg).or_throw();
+    std::string line;
+    std::getline(*child.std_out, line);
+    benchmark::DoNotOptimize(child.wait().or_throw());
+  }
+  auto after = StreamBufferPool::stats();
+  state.counters["acquired"] = benchmark::Counter(static_cast<double>(after.acquired - before.acquired),
+                                                  benchmark::Counter::kAvgIterations);
+  state.counters["slabs"] = static_cast<double>(after.slabs - before.slabs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpawnCapture)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// BM_SpawnCapture through a BasicPopen with the same layout.
+static void BM_BasicPopenCapture(benchmark::State& state) {
+  using Capture = BasicPopen<policy::Inherit, policy::Pipe, policy::Inherit>;
+  const PopenConfig cfg;
+  for (auto _ : state) {
+    auto child = Capture::create({ "echo", "captured" }, cfg).or_throw();
+    std::string line;
+    std::getline(child.std_out(), line);
+    benchmark::DoNotOptimize(child.wait().or_throw());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BasicPopenCapture)->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,30 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+#include "subprocess/SpawnQueue.hpp"
+
+using namespace subprocess;
+
+// A heavy tenant submits 200 jobs, then a light one 20, into 4 running
+// slots. Reports each tenant's mean queue wait: with fair queueing the
+// light tenant's stays close to a job's run time, however deep the heavy
+// tenant's backlog.
+static void BM_SpawnQueueFairness(benchmark::State& state) {
+  double heavy_wait = 0;
+  double light_wait = 0;
+  for (auto _ : state) {
+    SpawnQueue queue{ SpawnQueue::Handlers{}, SpawnQueue::Options{ 4 } };
+    for (int i = 0; i < 200; i++) queue.submit("heavy", {"true"});
+    for (int i = 0; i < 20; i++) queue.submit("light", {"true"});
+    queue.run();
+    auto heavy = *queue.stats("heavy");
+    auto light = *queue.stats("light");
+    heavy_wait += std::chrono::duration<double, std::milli>(heavy.queue_wait).count() / static_cast<double>(heavy.started);
+    light_wait += std::chrono::duration<double, std::milli>(light.queue_wait).count() / static_cast<double>(light.started);
+  }
+  state.counters["heavy_wait_ms"] = benchmark::Counter(heavy_wait, benchmark::Counter::kAvgIterations);
+  state.counters["light_wait_ms"] = benchmark::Counter(light_wait, benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * 220);
+}
+BENCHMARK(BM_SpawnQueueFairness)->Unit(benchmark::kMillisecond)->Iterations(3);
@@ -0,0 +1,28 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "subprocess/WaitSet.hpp"
+
+using namespace subprocess;
+
+// A `wait_any` that finds nothing, over Range(0) idle children: one
+// epoll_wait() whatever their number.
+static void BM_WaitAnyIdle(benchmark::State& state) {
+  PopenConfig cfg;
+  cfg.stdin = Redirection::Pipe();
+  std::vector<std::unique_ptr<Popen>> children;
+  WaitSet set;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    children.push_back(std::make_unique<Popen>(Popen::create({"cat"}, cfg).or_throw()));
+    set.add(*children.back());
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.wait_any(WaitSet::Clock::now()).or_throw());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  // each Popen closes cat's stdin and waits for it
+}
+BENCHMARK(BM_WaitAnyIdle)->RangeMultiplier(4)->Range(16, 1024);
@@ -1,12 +1,23 @@
 set(sources
+    src/Cgroup.cpp
+    src/ChildIoLoop.cpp
+    src/ChildTable.cpp
     src/ChildState.cpp
+    src/DeadlineManager.cpp
     src/ExitStatus.cpp
+    src/MessageSocket.cpp
     src/Popen.cpp
     src/PopenConfig.cpp
     src/PopenError.cpp
     src/posix.cpp
     src/PrepExec.cpp
+    src/Reactor.cpp
+    src/ResultCache.cpp
+    src/SpawnGovernor.cpp
+    src/SpawnQueue.cpp
+    src/ResourceSampler.cpp
     src/Redirection.cpp
+    src/WaitSet.cpp
 )
 
 set(exe_sources
@@ -14,18 +25,33 @@ set(exe_sources
 )
 
 set(headers
+    include/subprocess/BasicPopen.hpp
     include/subprocess/CaptureData.hpp
+    include/subprocess/Cgroup.hpp
+    include/subprocess/ChildIoLoop.hpp
+    include/subprocess/ChildTable.hpp
     include/subprocess/ChildState.hpp
     include/subprocess/Communicator.hpp
+    include/subprocess/Coroutine.hpp
+    include/subprocess/DeadlineManager.hpp
     include/subprocess/ExitStatus.hpp
+    include/subprocess/MessageSocket.hpp
     include/subprocess/Popen.hpp
     include/subprocess/PopenConfig.hpp
     include/subprocess/PopenError.hpp
     include/subprocess/posix.hpp
     include/subprocess/PrepExec.hpp
     include/subprocess/RaggedCstrArray.hpp
+    include/subprocess/Reactor.hpp
     include/subprocess/Redirection.hpp
+    include/subprocess/ResourceSampler.hpp
+    include/subprocess/ResultCache.hpp
+    include/subprocess/SpawnGovernor.hpp
+    include/subprocess/SpawnQueue.hpp
+    include/subprocess/StreamBufferPool.hpp
+    include/subprocess/RingChannel.hpp
     include/subprocess/Result.hpp
     include/subprocess/type_name.hpp
     include/subprocess/variant_helpers.hpp
+    include/subprocess/WaitSet.hpp
 )
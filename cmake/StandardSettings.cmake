@@ -10,6 +10,8 @@ option(${PROJECT_NAME}_USE_ALT_NAMES "Use alternative names for the project, suc
 # Compiler options
 #
 
+option(${PROJECT_NAME}_ENABLE_COROUTINES "Build the tests for the C++20 coroutine API (`Coroutine.hpp`) when the compiler supports C++20. The library itself always builds as C++17." ON)
+
 option(${PROJECT_NAME}_WARNINGS_AS_ERRORS "Treat compiler warnings as errors." OFF)
 
 #
@@ -32,6 +34,13 @@ option(${PROJECT_NAME}_USE_GOOGLE_MOCK "Use the GoogleMock project for extending
 
 option(${PROJECT_NAME}_USE_CATCH2 "Use the Catch2 project for creating unit tests." ON)
 
+#
+# Benchmarks
+#
+# Currently supporting: Google Benchmark.
+
+option(${PROJECT_NAME}_ENABLE_BENCHMARKS "Build the benchmarks (from the `bench` subfolder) if Google Benchmark is available." ON)
+
 #
 # Static analyzers
 #
@@ -46,6 +55,12 @@ option(${PROJECT_NAME}_ENABLE_CPPCHECK "Enable static analysis with Cppcheck." O
 
 option(${PROJECT_NAME}_ENABLE_CODE_COVERAGE "Enable code coverage through GCC." OFF)
 
+#
+# Sanitizers
+#
+
+option(${PROJECT_NAME}_ENABLE_TSAN "Build with ThreadSanitizer (-fsanitize=thread), e.g. to check the tests that wait from many threads." OFF)
+
 #
 # Doxygen
 #
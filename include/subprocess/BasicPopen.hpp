@@ -0,0 +1,110 @@
+#ifndef SUBPROCESS_BASIC_POPEN_H_
+#define SUBPROCESS_BASIC_POPEN_H_
+
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Popen.hpp"
+#include "PopenConfig.hpp"
+#include "Redirection.hpp"
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /// How `BasicPopen` sets up each standard stream.
+  namespace policy {
+    /// Leave the stream as the child inherits it (`Redirection::None`).
+    struct Inherit { };
+    /// A pipe between the parent and the child (`Redirection::Pipe`).
+    struct Pipe { };
+    /// Merge into the other output stream (`Redirection::Merge`).
+    struct Merge { };
+  }  // namespace policy
+
+  /**
+   * A `Popen` whose standard streams have a layout fixed at compile time,
+   * for call sites that always spawn the same shape of child, e.g.
+   * `BasicPopen<policy::Inherit, policy::Pipe, policy::Merge>` for
+   * "capture stdout and stderr together".
+   *
+   * Invalid layouts (Merge for stdin, or stdout and stderr merged into each
+   * other) do not compile, and a stream's accessor only compiles if the
+   * stream is a pipe, so it never needs checking for presence. Spawning
+   * skips the `PopenConfig` redirections altogether: the stdin, stdout and
+   * stderr of the config passed to `create` are ignored, while everything
+   * else in it applies as for `Popen::create`.
+   *
+   * This is type safety only, not a faster spawn: a `BasicPopen` holds a
+   * whole `Popen` (optional streams and all), and the layout still goes
+   * through the same runtime stream setup. The fork and exec dominate
+   * either way; BM_BasicPopenCapture and BM_SpawnCapture measure the same,
+   * about 0.6 ms a spawn.
+   */
+  template<class In, class Out, class Err>
+  class BasicPopen {
+    template<class P>
+    static constexpr bool is_policy =
+      std::is_same_v<P, policy::Inherit> || std::is_same_v<P, policy::Pipe> || std::is_same_v<P, policy::Merge>;
+
+    static_assert(is_policy<In> && is_policy<Out> && is_policy<Err>,
+                  "BasicPopen takes policy::Inherit, policy::Pipe or policy::Merge for each stream");
+    static_assert(!std::is_same_v<In, policy::Merge>, "policy::Merge is not valid for stdin");
+    static_assert(!(std::is_same_v<Out, policy::Merge> && std::is_same_v<Err, policy::Merge>),
+                  "stdout and stderr cannot both be merged into the other");
+
+   public:
+    static Result<BasicPopen> create(const std::vector<std::string>& argv, const PopenConfig& cfg = PopenConfig{}) {
+      Popen::StdLayout layout{ redirection<In>(), redirection<Out>(), redirection<Err>() };
+      auto res = Popen::create(argv, cfg, nullptr, layout);
+      if (!res.ok()) return res.take_error();
+      return BasicPopen{ res.take_value() };
+    }
+
+    template<class P = In>
+    boost::fdostream& std_in() {
+      static_assert(std::is_same_v<P, policy::Pipe>, "stdin is not a pipe");
+      return *_popen.std_in;
+    }
+    template<class P = Out>
+    boost::fdistream& std_out() {
+      static_assert(std::is_same_v<P, policy::Pipe>, "stdout is not a pipe");
+      return *_popen.std_out;
+    }
+    template<class P = Err>
+    boost::fdistream& std_err() {
+      static_assert(std::is_same_v<P, policy::Pipe>, "stderr is not a pipe");
+      return *_popen.std_err;
+    }
+
+    Result<ExitStatus> wait() { return _popen.wait(); }
+    std::optional<ExitStatus> poll() { return _popen.poll(); }
+    std::optional<pid_t> pid() const { return _popen.pid(); }
+
+    /// The underlying `Popen`, for everything else.
+    Popen& popen() { return _popen; }
+
+   private:
+    explicit BasicPopen(Popen&& popen)
+    : _popen{ std::move(popen) }
+    { }
+
+    template<class P>
+    static const Redirection& redirection() {
+      if constexpr (std::is_same_v<P, policy::Pipe>) {
+        static const Redirection pipe{ Redirection::Pipe{} };
+        return pipe;
+      } else if constexpr (std::is_same_v<P, policy::Merge>) {
+        static const Redirection merge{ Redirection::Merge{} };
+        return merge;
+      } else {
+        static const Redirection none{ Redirection::None{} };
+        return none;
+      }
+    }
+
+    Popen _popen;
+  };
+}  // namespace subprocess
+#endif
@@ -1,5 +1,5 @@
-#ifndef SUBPROCESS_POPEN_H_
-#define SUBPROCESS_POPEN_H_
+#ifndef SUBPROCESS_CAPTURE_DATA_H_
+#define SUBPROCESS_CAPTURE_DATA_H_
 #include <stdint.h>
 
 #include <string>
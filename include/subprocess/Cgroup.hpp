@@ -0,0 +1,120 @@
+#ifndef SUBPROCESS_CGROUP_H_
+#define SUBPROCESS_CGROUP_H_
+
+#include <stdint.h>
+
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "PopenError.hpp"
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /// Limits written to a cgroup's control files. Each needs its controller
+  /// (memory, cpu, pids) to be enabled for the cgroup.
+  struct CgroupLimits {
+    /// `cpu.max`: at most `quota_us` microseconds of CPU time per `period_us`.
+    struct CpuMax {
+      uint64_t quota_us;
+      uint64_t period_us{ 100000 };
+    };
+
+    /// `memory.max`, in bytes.
+    std::optional<uint64_t> memory_max{ std::nullopt };
+    std::optional<CpuMax> cpu_max{ std::nullopt };
+    /// `pids.max`: how many processes and threads may exist in the cgroup.
+    std::optional<uint64_t> pids_max{ std::nullopt };
+  };
+
+  /// Accounting read from a cgroup. A value is missing when its control
+  /// file is, typically because the controller is not enabled.
+  struct CgroupStats {
+    /// `memory.current` and `memory.peak`, in bytes.
+    std::optional<uint64_t> memory_current;
+    std::optional<uint64_t> memory_peak;
+    /// From `cpu.stat`, in microseconds. These are kept even without the
+    /// cpu controller.
+    std::optional<uint64_t> cpu_usage_usec;
+    std::optional<uint64_t> cpu_user_usec;
+    std::optional<uint64_t> cpu_system_usec;
+    /// `pids.current`.
+    std::optional<uint64_t> pids_current;
+  };
+
+  /**
+   * A cgroup v2 directory, held open.
+   *
+   * A `Cgroup` either refers to an existing cgroup (`open`) or owns a leaf
+   * it created (`create`), which it removes when destroyed. Removal fails
+   * while processes remain in the cgroup, in which case it is left behind;
+   * `kill` first to make sure it is empty.
+   */
+  class Cgroup {
+   public:
+    Cgroup(Cgroup&& other);
+    Cgroup& operator=(Cgroup&& other);
+    Cgroup(const Cgroup&) = delete;
+    Cgroup& operator=(const Cgroup&) = delete;
+    ~Cgroup();
+
+    /// Open the existing cgroup at `path`, e.g. "/sys/fs/cgroup/jobs".
+    static Result<Cgroup> open(const std::string& path);
+
+    /**
+     * Create a cgroup named `name` under `parent`, and write `limits` to it.
+     *
+     * The controllers the limits need are enabled in the parent's
+     * `cgroup.subtree_control` first, where they are not already. cgroup v2
+     * only allows that for a parent with no processes of its own, so
+     * `parent` should be a cgroup set aside for children, not the one the
+     * caller runs in.
+     */
+    static Result<Cgroup> create(const std::string& parent, const std::string& name,
+                                 const CgroupLimits& limits = {});
+
+    /// The cgroup v2 directory of the calling process, if cgroup v2 is mounted.
+    static std::optional<std::string> self();
+
+    const std::string& path() const { return _path; }
+    /// The open directory, as needed for `CLONE_INTO_CGROUP`.
+    int fd() const { return _fd; }
+    /// Whether the cgroup is removed when this is destroyed.
+    bool owned() const { return _owned; }
+
+    /// Write `limits` to the cgroup. Limits left unset are not changed.
+    std::optional<PopenError> set_limits(const CgroupLimits& limits);
+
+    Result<CgroupStats> stats() const;
+
+    /**
+     * Kill every process in the cgroup, including any that have left the
+     * child's process group or session.
+     *
+     * Uses `cgroup.kill`, which cannot miss a process that forks meanwhile.
+     * Before Linux 5.14 the processes in `cgroup.procs` are sent SIGKILL
+     * until none remain instead.
+     */
+    std::optional<PopenError> kill();
+
+    /**
+     * Send `signo` to every process in the cgroup, once. Unlike `kill`, a
+     * process forked meanwhile may be missed.
+     */
+    std::optional<PopenError> signal(int signo);
+
+    /// Remove the cgroup, which must be empty, and stop owning it.
+    std::optional<PopenError> remove();
+
+   private:
+    Cgroup(std::string path, int fd, bool owned);
+
+    void close();
+
+    std::string _path;
+    int _fd;
+    bool _owned;
+  };
+}  // namespace subprocess
+#endif
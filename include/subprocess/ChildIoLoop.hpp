@@ -0,0 +1,131 @@
+#ifndef SUBPROCESS_CHILD_IO_LOOP_H_
+#define SUBPROCESS_CHILD_IO_LOOP_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ExitStatus.hpp"
+#include "Popen.hpp"
+#include "Result.hpp"
+
+struct epoll_event;
+
+namespace subprocess {
+
+  /**
+   * Drive the pipes of many children from a single thread.
+   *
+   * A `ChildIoLoop` takes over `Popen` instances: it owns their pipe ends
+   * and reaps them, so nothing is left for the `Popen` to do. Readiness of
+   * every child's stdin, stdout and stderr, and (through a pidfd) of its
+   * exit, is multiplexed on one epoll instance.
+   *
+   * Output is handed to the loop-wide `Handlers` as it arrives, straight
+   * from one shared read buffer, so an idle child costs no buffer space.
+   * Input queued with `write` is bounded per child by
+   * `Options::max_pending_input`.
+   *
+   * A child's `on_exit` is delivered once it has exited *and* its stdout
+   * and stderr have reached end of file, so all of its output is seen
+   * first. (A grandchild holding the pipes open delays `on_exit`.)
+   *
+   * Each child uses up to four descriptors; running 10k children needs
+   * RLIMIT_NOFILE raised accordingly.
+   */
+  class ChildIoLoop {
+   public:
+    using Id = uint64_t;
+
+    struct Handlers {
+      std::function<void(Id, const char* data, size_t len)> on_stdout;
+      std::function<void(Id, const char* data, size_t len)> on_stderr;
+      std::function<void(Id, const ExitStatus&)> on_exit;
+    };
+
+    struct Options {
+      /// Upper bound on input queued by `write` but not yet accepted by a child.
+      size_t max_pending_input{ 64 * 1024 };
+      /// Size of the single buffer all reads go through.
+      size_t read_chunk{ 64 * 1024 };
+      /// Max events handled per `epoll_wait` call.
+      int max_events{ 256 };
+    };
+
+    ChildIoLoop(Handlers handlers);
+    ChildIoLoop(Handlers handlers, Options options);
+    ~ChildIoLoop();
+    ChildIoLoop(const ChildIoLoop&) = delete;
+    ChildIoLoop& operator=(const ChildIoLoop&) = delete;
+
+    /**
+     * Take over a running child. Its `std_in`, `std_out` and `std_err`
+     * (whichever are present) are released to the loop and set nonblocking,
+     * and the `Popen` is detached; the loop will reap the child.
+     */
+    Result<Id> add(Popen&& child);
+
+    /**
+     * Queue `len` bytes for the child's stdin.
+     *
+     * Returns false (queuing nothing) if the child has no stdin pipe, its
+     * stdin was closed, or the data would exceed `max_pending_input`.
+     */
+    bool write(Id id, const char* data, size_t len);
+
+    /// Close the child's stdin once everything queued has been written.
+    void close_stdin(Id id);
+
+    /// Number of children added whose `on_exit` has not been delivered.
+    size_t size() const;
+
+    /**
+     * Wait up to `timeout` (forever if nullopt) for activity and handle it.
+     * Returns the number of events handled.
+     */
+    Result<size_t> run_once(std::optional<std::chrono::milliseconds> timeout);
+
+    /// Handle events until every child has exited and been reported.
+    std::optional<PopenError> run();
+
+   private:
+    enum class Stream : uint8_t { In = 0, Out = 1, Err = 2, Exit = 3 };
+
+    struct Child {
+      pid_t pid{ -1 };
+      int pidfd{ -1 };
+      int fds[3]{ -1, -1, -1 };
+      uint32_t generation{ 0 };
+      bool exited{ false };
+      bool close_stdin_when_drained{ false };
+      std::optional<ExitStatus> status;
+      std::string pending_input;
+    };
+
+    Child* lookup(Id id);
+    Id id_of(uint32_t slot) const;
+    void watch(uint32_t slot, Stream stream, int fd, uint32_t events);
+    void close_stream(uint32_t slot, Stream stream);
+    void handle(uint32_t slot, Stream stream, uint32_t events);
+    void flush_input(uint32_t slot);
+    void reap(uint32_t slot, bool block);
+    void maybe_finish(uint32_t slot);
+
+    Handlers _handlers;
+    Options _options;
+    int _epoll_fd;
+    std::vector<Child> _children;
+    std::vector<uint32_t> _free_slots;
+    // children without a pidfd, reaped by polling once their pipes close
+    std::vector<uint32_t> _unwatched_exits;
+    std::vector<char> _read_buf;
+    std::vector<epoll_event> _events;
+    size_t _live{ 0 };
+  };
+}  // namespace subprocess
+#endif
@@ -3,7 +3,6 @@
 #include <stdint.h>
 
 #include <fstream>
-#include <functional>
 #include <optional>
 #include <variant>
 
@@ -37,15 +36,24 @@ namespace subprocess {
       return std::holds_alternative<T>(_state);
     }
     template <typename T>
-    T get() const {
+    const T& get() const {
       return std::get<T>(_state);
     }
 
+    /// Dispatch on the current state, calling exactly one of the cases.
+    ///
+    /// The cases may be any callables; they are invoked directly rather
+    /// than through `std::function`, so matching never allocates.
+    template <typename PreparingCase, typename RunningCase, typename FinishedCase>
     Result<const std::nullopt_t> match(
-      std::function<Result<const std::nullopt_t>(const Preparing&)> preparing_case,
-      std::function<Result<const std::nullopt_t>(const Running&)> running_case,
-      std::function<Result<const std::nullopt_t>(const Finished&)> finished_case
-    ) const;
+      PreparingCase&& preparing_case,
+      RunningCase&& running_case,
+      FinishedCase&& finished_case
+    ) const {
+      if (auto preparing = std::get_if<Preparing>(&_state)) return preparing_case(*preparing);
+      if (auto running = std::get_if<Running>(&_state)) return running_case(*running);
+      return finished_case(std::get<Finished>(_state));
+    }
 
   };
 }  // namespace subprocess
@@ -0,0 +1,123 @@
+#ifndef SUBPROCESS_CHILD_TABLE_H_
+#define SUBPROCESS_CHILD_TABLE_H_
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "ExitStatus.hpp"
+#include "Popen.hpp"
+#include "Result.hpp"
+#include "vendor/fdstream.hpp"
+
+namespace subprocess {
+
+  /**
+   * Track a great many children at a few dozen bytes each.
+   *
+   * A `Popen` is several KB: its optional streams embed their buffers and a
+   * `std::ios` each. A `ChildTable` takes over `Popen` instances and keeps
+   * only what it needs of them, one array per field (pid, pidfd, state,
+   * wait status, pipe ends), so that bulk queries walk dense memory and an
+   * idle child costs under 100 bytes. Streams over a child's pipes are only
+   * created when asked for.
+   *
+   * Exits are found with one poll() over the children's pidfds, falling
+   * back to waitpid() per child where no pidfd could be opened (kernels
+   * before 5.3, or out of descriptors). Each child uses up to four
+   * descriptors, so RLIMIT_NOFILE must be raised to match.
+   *
+   * Not thread safe.
+   */
+  class ChildTable {
+   public:
+    using Id = uint64_t;
+
+    ChildTable() = default;
+    /// Close every child's pipes and wait for those still running.
+    ~ChildTable();
+    ChildTable(const ChildTable&) = delete;
+    ChildTable& operator=(const ChildTable&) = delete;
+
+    /**
+     * Take over a running child: its `std_in`, `std_out` and `std_err`
+     * (whichever are present) are released to the table, and the `Popen`
+     * is detached. Anything else it holds (rings, sockets, extra_fds, a
+     * cgroup) is closed when the `Popen` is destroyed.
+     */
+    Result<Id> add(Popen&& child);
+
+    /**
+     * Reap the children that have exited since the last call, without
+     * blocking, and return their ids.
+     */
+    std::vector<Id> reap_exited();
+
+    /// Block until the child has exited, and reap it.
+    Result<ExitStatus> wait(Id id);
+
+    /**
+     * Forget the child: close its pipes, then wait for it unless it has
+     * been reaped already. Its id becomes invalid.
+     */
+    void remove(Id id);
+
+    /// Children in the table.
+    size_t size() const { return _size; }
+    /// Children in the table not yet known to have exited.
+    size_t running() const { return _running; }
+
+    /// The child's pid, if the table holds it.
+    std::optional<pid_t> pid(Id id) const;
+    /// The child's exit status, once it has been reaped.
+    std::optional<ExitStatus> exit_status(Id id) const;
+    /// Our end of the child's stdin (0), stdout (1) or stderr (2) pipe, or -1.
+    int fd(Id id, int stream) const;
+
+    /// Streams over the child's pipes, created on first use; nullptr if the
+    /// child has no such pipe.
+    boost::fdostream* std_in(Id id);
+    boost::fdistream* std_out(Id id);
+    boost::fdistream* std_err(Id id);
+
+   private:
+    enum class State : uint8_t { Free, Running, Exited };
+
+    struct Streams {
+      std::optional<boost::fdostream> in;
+      std::optional<boost::fdistream> out;
+      std::optional<boost::fdistream> err;
+    };
+
+    // The slot of `id`, or -1 if it is not in the table.
+    int64_t slot_of(Id id) const;
+    Id id_of(uint32_t slot) const;
+    // waitpid() the child; true once it is reaped.
+    bool reap(uint32_t slot, bool block);
+    void close_pipes(uint32_t slot);
+
+    std::vector<pid_t> _pids;
+    std::vector<int> _pidfds;
+    std::vector<uint32_t> _generations;
+    std::vector<State> _states;
+    // raw waitpid() status, or -1 if it was lost
+    std::vector<int> _statuses;
+    std::vector<std::array<int, 3>> _fds;
+    std::vector<uint32_t> _free_slots;
+    // only for children whose streams were asked for
+    std::unordered_map<uint32_t, Streams> _streams;
+
+    // reused by reap_exited()
+    std::vector<struct pollfd> _pollfds;
+    std::vector<uint32_t> _poll_slots;
+
+    size_t _size{ 0 };
+    size_t _running{ 0 };
+  };
+}  // namespace subprocess
+#endif
@@ -0,0 +1,323 @@
+#ifndef SUBPROCESS_COROUTINE_H_
+#define SUBPROCESS_COROUTINE_H_
+
+// C++20 coroutine support. Everything in this header is only available
+// when the compiler supports coroutines; the rest of the library stays C++17.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define SUBPROCESS_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "CaptureData.hpp"
+#include "Popen.hpp"
+#include "Reactor.hpp"
+#include "posix.hpp"
+#include "vendor/fdstream.hpp"
+
+namespace subprocess {
+
+  /**
+   * A lazily started coroutine producing a `T`.
+   *
+   * A `Task` does nothing until it is `co_await`ed (or `start`ed), and
+   * resumes its awaiter when it finishes. Use `sync_wait` to run a task to
+   * completion from ordinary code.
+   */
+  template<typename T>
+  class Task;
+
+  namespace internal {
+    // On completion, transfer straight to whoever awaited the task.
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      template<typename Promise>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        auto next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept { }
+    };
+
+    struct TaskPromiseBase {
+      std::coroutine_handle<> continuation;
+      std::exception_ptr error;
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      FinalAwaiter final_suspend() noexcept { return {}; }
+      void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template<typename T>
+    struct TaskPromise : TaskPromiseBase {
+      std::optional<T> value;
+
+      Task<T> get_return_object();
+      template<typename U>
+      void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+      T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+      }
+    };
+
+    template<>
+    struct TaskPromise<void> : TaskPromiseBase {
+      Task<void> get_return_object();
+      void return_void() { }
+      void take() {
+        if (error) std::rethrow_exception(error);
+      }
+    };
+  }  // namespace internal
+
+  template<typename T>
+  class [[nodiscard]] Task {
+   public:
+    using promise_type = internal::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> h)
+        : _handle{ h } { }
+    Task(Task&& other) noexcept
+        : _handle{ std::exchange(other._handle, {}) } { }
+    Task& operator=(Task&& other) noexcept {
+      if (this != &other) {
+        if (_handle) _handle.destroy();
+        _handle = std::exchange(other._handle, {});
+      }
+      return *this;
+    }
+    Task(const Task&) = delete;
+    ~Task() {
+      if (_handle) _handle.destroy();
+    }
+
+    bool done() const { return !_handle || _handle.done(); }
+
+    /// Run the task until its first suspension point, without an awaiter.
+    void start() { _handle.resume(); }
+
+    /// The task's result, once `done()`. Rethrows an escaped exception.
+    T result() { return _handle.promise().take(); }
+
+    auto operator co_await() && noexcept {
+      struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+        bool await_ready() noexcept { return handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+          handle.promise().continuation = awaiting;
+          return handle;
+        }
+        T await_resume() { return handle.promise().take(); }
+      };
+      return Awaiter{ _handle };
+    }
+
+   private:
+    std::coroutine_handle<promise_type> _handle;
+  };
+
+  namespace internal {
+    template<typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+      return Task<T>{ std::coroutine_handle<TaskPromise<T>>::from_promise(*this) };
+    }
+    inline Task<void> TaskPromise<void>::get_return_object() {
+      return Task<void>{ std::coroutine_handle<TaskPromise<void>>::from_promise(*this) };
+    }
+
+    // Suspend until the reactor reports readiness, resuming on its thread.
+    // An error from registering is returned from co_await.
+    template<typename Register>
+    struct ReactorAwaiter {
+      Register do_register;
+      std::optional<PopenError> error{};
+
+      bool await_ready() noexcept { return false; }
+      bool await_suspend(std::coroutine_handle<> h) {
+        error = do_register([h] { h.resume(); });
+        return !error.has_value();
+      }
+      std::optional<PopenError> await_resume() { return std::move(error); }
+    };
+    template<typename Register>
+    ReactorAwaiter(Register) -> ReactorAwaiter<Register>;
+  }  // namespace internal
+
+  /**
+   * Run `task` to completion, driving `reactor` until it finishes.
+   */
+  template<typename T>
+  T sync_wait(EpollReactor& reactor, Task<T> task) {
+    task.start();
+    while (!task.done()) {
+      auto res = reactor.run_once(std::nullopt);
+      if (!res.ok()) throw SubprocessException(res.take_error().message());
+    }
+    return task.result();
+  }
+
+  /**
+   * Wait for the child to exit without blocking the thread.
+   *
+   * Equivalent to `Popen::wait()`, but suspends until the reactor reports
+   * the exit instead of blocking in waitpid().
+   */
+  inline Task<Result<ExitStatus>> async_wait(Popen& popen, Reactor& reactor) {
+    if (auto status = popen.poll()) co_return std::move(*status);
+    auto pid = popen.pid();
+    if (pid.has_value()) {
+      auto err = co_await internal::ReactorAwaiter{
+        [&](Reactor::Callback cb) { return reactor.on_exit(*pid, std::move(cb)); }
+      };
+      if (err.has_value()) co_return std::move(*err);
+    }
+    co_return popen.wait();
+  }
+
+  /**
+   * Read up to `len` bytes from a nonblocking stream (see
+   * `PopenConfig::nonblocking`), suspending while no data is available.
+   *
+   * The result's status is never `would_block`.
+   */
+  inline Task<boost::io_result> async_read(
+      boost::fdistream& stream, char* buf, size_t len, Reactor& reactor) {
+    while (true) {
+      auto res = stream.read_some(buf, len);
+      if (res.status != boost::io_status::would_block) co_return res;
+      auto err = co_await internal::ReactorAwaiter{
+        [&](Reactor::Callback cb) { return reactor.on_readable(stream.fd(), std::move(cb)); }
+      };
+      if (err.has_value()) co_return boost::io_result{ boost::io_status::error, 0, err->errnum };
+    }
+  }
+
+  /**
+   * Write all `len` bytes to a nonblocking stream, suspending while the
+   * pipe is full. On failure, the result's count says how much was written.
+   */
+  inline Task<boost::io_result> async_write(
+      boost::fdostream& stream, const char* buf, size_t len, Reactor& reactor) {
+    size_t done = 0;
+    while (true) {
+      boost::io_result res;
+      {
+        // a reader gone makes this EPIPE, not SIGPIPE; not held across a
+        // suspension, which may resume on another thread
+        SigpipeBlock block_sigpipe;
+        res = stream.write_some(buf + done, len - done);
+      }
+      done += res.count;
+      if (res.status != boost::io_status::would_block) {
+        co_return boost::io_result{ res.status, done, res.err };
+      }
+      auto err = co_await internal::ReactorAwaiter{
+        [&](Reactor::Callback cb) { return reactor.on_writable(stream.fd(), std::move(cb)); }
+      };
+      if (err.has_value()) co_return boost::io_result{ boost::io_status::error, done, err->errnum };
+    }
+  }
+
+  /**
+   * Feed `input` to the child's stdin (then close it), collect everything
+   * it writes to stdout and stderr, and wait for it to exit, all without
+   * blocking the thread.
+   *
+   * Streams that were not redirected to pipes are skipped. The pipes are
+   * switched to nonblocking mode if they were not already.
+   */
+  inline Task<Result<CaptureData>> communicate_async(
+      Popen& popen, Reactor& reactor, std::string input = {}) {
+    if (popen.std_in) set_nonblocking(popen.std_in->fd(), true);
+    if (popen.std_out) set_nonblocking(popen.std_out->fd(), true);
+    if (popen.std_err) set_nonblocking(popen.std_err->fd(), true);
+
+    std::string out, err;
+    size_t written = 0;
+    char buf[4096];
+    bool in_open = popen.std_in && popen.std_in->is_open();
+    bool out_open = popen.std_out && popen.std_out->is_open();
+    bool err_open = popen.std_err && popen.std_err->is_open();
+
+    while (in_open || out_open || err_open) {
+      // make whatever progress is possible without blocking
+      bool progressed = false;
+      if (in_open) {
+        boost::io_result res;
+        {
+          // as in `Popen::communicate`: EPIPE rather than SIGPIPE
+          SigpipeBlock block_sigpipe;
+          res = popen.std_in->write_some(input.data() + written, input.size() - written);
+        }
+        written += res.count;
+        progressed |= res.count > 0;
+        if (res.status == boost::io_status::error) {
+          co_return PopenError{PopenError::IoError, "write()", res.err};
+        }
+        // eof: the child stopped reading, which is its business
+        if (res.status != boost::io_status::would_block) {
+          popen.std_in->close();
+          in_open = false;
+        }
+      }
+      for (auto [stream, dest, open] : { std::tuple{ &popen.std_out, &out, &out_open },
+                                         std::tuple{ &popen.std_err, &err, &err_open } }) {
+        while (*open) {
+          auto res = (*stream)->read_some(buf, sizeof(buf));
+          if (res.status == boost::io_status::would_block) break;
+          if (res.status == boost::io_status::error) {
+            co_return PopenError{PopenError::IoError, "read()", res.err};
+          }
+          if (res.status != boost::io_status::ok) {
+            *open = false;
+            break;
+          }
+          dest->append(buf, res.count);
+          progressed = true;
+        }
+      }
+      if (progressed || !(in_open || out_open || err_open)) continue;
+
+      // nothing ready: suspend until any open stream is
+      int fds[3] = { in_open ? popen.std_in->fd() : -1, out_open ? popen.std_out->fd() : -1,
+                     err_open ? popen.std_err->fd() : -1 };
+      auto wait_err = co_await internal::ReactorAwaiter{ [&](Reactor::Callback cb) {
+        // the first stream to become ready resumes us and cancels the rest;
+        // several may be reported ready at once, so only the first counts
+        auto fired = std::make_shared<bool>(false);
+        auto resume = [&reactor, fds, fired, cb = std::move(cb)] {
+          if (*fired) return;
+          *fired = true;
+          for (int fd : fds) {
+            if (fd >= 0) reactor.cancel(fd);
+          }
+          cb();
+        };
+        std::optional<PopenError> e;
+        if (fds[0] >= 0) e = reactor.on_writable(fds[0], resume);
+        if (!e && fds[1] >= 0) e = reactor.on_readable(fds[1], resume);
+        if (!e && fds[2] >= 0) e = reactor.on_readable(fds[2], resume);
+        if (e) {
+          for (int fd : fds) {
+            if (fd >= 0) reactor.cancel(fd);
+          }
+        }
+        return e;
+      } };
+      if (wait_err.has_value()) co_return std::move(*wait_err);
+    }
+
+    auto status = co_await async_wait(popen, reactor);
+    if (!status.ok()) co_return status.take_error();
+    co_return CaptureData{ std::move(out), std::move(err), status.take_value() };
+  }
+}  // namespace subprocess
+
+#endif  // coroutine support
+#endif
@@ -0,0 +1,153 @@
+#ifndef SUBPROCESS_DEADLINE_MANAGER_H_
+#define SUBPROCESS_DEADLINE_MANAGER_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "Popen.hpp"
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /**
+   * Deadlines for many children, on one timer.
+   *
+   * Each deadline names a `Popen` and what to do to it when the deadline
+   * passes: send a signal, terminate it with a grace period, or call a
+   * function. Deadlines live in a hierarchical timer wheel (8 levels of 64
+   * buckets), so adding and cancelling one is O(1) whatever the number
+   * pending, and each costs 40 bytes (plus the function, for a callback).
+   *
+   * One timerfd is armed for the next bucket due; `fd()` becomes readable
+   * then, for the caller's poll()/epoll loop, which calls `expire()`. Or
+   * `run_once` waits on it. Deadlines are rounded up to
+   * `Options::resolution`: an action never runs early, and deadlines
+   * falling in the same tick share a wakeup.
+   *
+   * The `Popen`s are not owned, and must outlive their deadlines (or have
+   * them cancelled); cancel a child's deadline once it has been waited
+   * for. Not thread safe.
+   */
+  class DeadlineManager {
+   public:
+    using Clock = std::chrono::steady_clock;
+    using Id = uint64_t;
+
+    /// `Popen::signal_tree(signo)`.
+    struct Signal {
+      int signo;
+    };
+    /// SIGTERM to the tree, then SIGKILL `grace` later unless the deadline
+    /// has been cancelled meanwhile. Unlike `Popen::terminate`, nothing
+    /// blocks, and the child is not waited for.
+    struct Terminate {
+      std::chrono::milliseconds grace;
+    };
+    /// Call `fn` with the child.
+    struct Callback {
+      std::function<void(Popen&)> fn;
+    };
+    using Action = std::variant<Signal, Terminate, Callback>;
+
+    struct Options {
+      /// The wheel's tick. Deadlines further away than 2^48 ticks, or
+      /// 2^62 ns, are brought in to that.
+      std::chrono::nanoseconds resolution{ std::chrono::milliseconds(1) };
+    };
+
+    DeadlineManager();
+    DeadlineManager(Options options);
+    /// Drop the pending deadlines without acting on them.
+    ~DeadlineManager();
+    DeadlineManager(const DeadlineManager&) = delete;
+    DeadlineManager& operator=(const DeadlineManager&) = delete;
+
+    /// Do `action` to `popen` once `deadline` has passed.
+    Id add(Popen& popen, Clock::time_point deadline, Action action);
+
+    /// Drop the deadline; false if it has already run or been cancelled.
+    /// (A `Terminate` stays pending through its grace period.)
+    bool cancel(Id id);
+
+    /// Deadlines pending.
+    size_t size() const { return _size; }
+
+    /// Readable once a deadline may have passed.
+    int fd() const { return _timer_fd; }
+
+    /// Run the actions of the deadlines that have passed; returns how many.
+    size_t expire();
+
+    /**
+     * Wait up to `timeout` (forever if nullopt) for a deadline to pass, and
+     * `expire()`. Returns the number of actions run.
+     */
+    Result<size_t> run_once(std::optional<std::chrono::milliseconds> timeout);
+
+   private:
+    static constexpr unsigned level_bits = 6;
+    static constexpr unsigned levels = 8;
+    static constexpr uint32_t buckets = 1u << level_bits;
+    static constexpr uint32_t none = UINT32_MAX;
+
+    enum class Kind : uint8_t { Free, Signal, Terminate, Kill, Callback };
+
+    struct Timer {
+      Popen* popen{ nullptr };
+      // in ticks since `_epoch`
+      uint64_t expires{ 0 };
+      // neighbours in the bucket's list
+      uint32_t prev{ none };
+      uint32_t next{ none };
+      uint32_t generation{ 0 };
+      // signo, or the grace period in ticks
+      uint32_t arg{ 0 };
+      // level * buckets + index, or none while due or free
+      uint16_t bucket{ UINT16_MAX };
+      Kind kind{ Kind::Free };
+    };
+
+    Id id_of(uint32_t slot) const;
+    // The slot of `id`, or none if it is not pending.
+    uint32_t slot_of(Id id) const;
+    uint64_t tick_at(Clock::time_point time, bool round_up) const;
+    // Schedule `slot` at its `expires`, which is after `_now`.
+    void schedule(uint32_t slot, uint64_t expires);
+    void link(uint32_t slot);
+    void unlink(uint32_t slot);
+    // Take a bucket's whole list, returning its first slot.
+    uint32_t take_bucket(uint32_t bucket);
+    void release(uint32_t slot);
+    // The tick at which the next non-empty bucket is due.
+    std::optional<uint64_t> next_due() const;
+    // Move `_now` to `target`, cascading buckets down the levels and
+    // collecting the deadlines that pass into `_due`.
+    void advance(uint64_t target);
+    // Point the timerfd at next_due(), if it has changed.
+    void arm();
+
+    Clock::time_point _epoch;
+    int64_t _resolution;
+    int _timer_fd;
+    uint64_t _now{ 0 };
+    std::optional<uint64_t> _armed;
+    std::vector<Timer> _timers;
+    std::vector<uint32_t> _free_slots;
+    std::array<uint32_t, levels * buckets> _heads;
+    // a bit per non-empty bucket, per level
+    std::array<uint64_t, levels> _occupied{};
+    // only for `Callback` deadlines
+    std::unordered_map<uint32_t, std::function<void(Popen&)>> _callbacks;
+    // reused by expire()
+    std::vector<Id> _due;
+    size_t _size{ 0 };
+  };
+}  // namespace subprocess
+#endif
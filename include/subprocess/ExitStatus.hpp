@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include <string>
+#include <type_traits>
 #include <variant>
 namespace subprocess {
 
@@ -51,7 +52,11 @@ namespace subprocess {
     StateType _state;
    public:
 
-    template<typename... Args>
+    // not a candidate for copies, which would otherwise prefer it over the
+    // copy constructor for non-const and const&& sources
+    template<typename... Args,
+             typename = std::enable_if_t<!(sizeof...(Args) == 1 &&
+                                           (std::is_same_v<std::decay_t<Args>, ExitStatus> && ...))>>
     ExitStatus(Args&&... args)
     : _state{std::forward<Args>(args)...}
     { }
@@ -60,6 +65,15 @@ namespace subprocess {
 
     bool success() const;
 
+    template <typename T>
+    bool is_a() const {
+      return std::holds_alternative<T>(_state);
+    }
+    template <typename T>
+    const T& get() const {
+      return std::get<T>(_state);
+    }
+
     std::string toString() const;
 
     ExitStatus& operator=(ExitStatus&& other);
@@ -0,0 +1,92 @@
+#ifndef SUBPROCESS_MESSAGE_SOCKET_H_
+#define SUBPROCESS_MESSAGE_SOCKET_H_
+
+#include <stddef.h>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Result.hpp"
+#include "vendor/fdstream.hpp"
+
+namespace subprocess {
+
+  /**
+   * The parent's end of a `Redirection::Socket`: a Unix domain socket.
+   *
+   * With `SOCK_SEQPACKET` (the default) every `send` is delivered to the
+   * peer as one message, so no framing protocol is needed. Messages may
+   * carry open file descriptors (SCM_RIGHTS), so a file can be handed to
+   * the child instead of streaming its contents.
+   *
+   * Transfers report their outcome as a `boost::io_result`, following the
+   * streams' `read_some`/`write_some`: a nonblocking socket (see
+   * `PopenConfig::nonblocking`) reports `would_block`, or waits until the
+   * optional deadline. For a `recv`, `count` is the message's size in
+   * bytes; for the batched calls it is the number of messages.
+   */
+  class MessageSocket {
+   public:
+    /// Take ownership of a connected socket.
+    explicit MessageSocket(int fd);
+    MessageSocket(MessageSocket&& other);
+    MessageSocket& operator=(MessageSocket&& other);
+    MessageSocket(const MessageSocket&) = delete;
+    MessageSocket& operator=(const MessageSocket&) = delete;
+    ~MessageSocket();
+
+    /// A connected pair of sockets of the given type (SOCK_SEQPACKET or SOCK_STREAM).
+    static Result<std::pair<MessageSocket, MessageSocket>> pair(int type);
+
+    int fd() const { return _fd; }
+    bool is_open() const { return _fd >= 0; }
+    void close();
+    /// Give up ownership of the descriptor without closing it.
+    int release() { return std::exchange(_fd, -1); }
+
+    /// Stop sending, so the peer sees end of file, while still receiving.
+    void shutdown_write();
+
+    /**
+     * Send `len` bytes as one message, along with the descriptors in `fds`
+     * (which stay open on our side). On a stream socket, `count` may be
+     * short; the descriptors go with the first byte.
+     */
+    boost::io_result send(const char* data, size_t len, const std::vector<int>& fds = {},
+                          std::optional<boost::deadline> until = std::nullopt);
+
+    /**
+     * Receive one message of up to `len` bytes. Descriptors sent with it
+     * are appended to `fds` (close-on-exec, and owned by the caller); if
+     * `fds` is null they are closed. A message longer than `len` is an
+     * error (EMSGSIZE), with its first `len` bytes received.
+     *
+     * A peer that has closed its end gives `eof`. (A zero-length message
+     * cannot be told apart from that, so don't send any.)
+     */
+    boost::io_result recv(char* buf, size_t len, std::vector<int>* fds = nullptr,
+                          std::optional<boost::deadline> until = std::nullopt);
+
+    /**
+     * Send several messages with a single sendmmsg(); `count` is how many
+     * were sent, which is short if the socket filled up.
+     */
+    boost::io_result send_batch(const std::vector<std::string_view>& messages,
+                                std::optional<boost::deadline> until = std::nullopt);
+
+    /**
+     * Receive up to `max_messages` messages of up to `max_size` bytes each
+     * with a single recvmmsg(), appending them to `out`. Waits only for the
+     * first; `count` is how many were received.
+     */
+    boost::io_result recv_batch(std::vector<std::string>& out, size_t max_messages, size_t max_size,
+                                std::optional<boost::deadline> until = std::nullopt);
+
+   private:
+    int _fd;
+  };
+}  // namespace subprocess
+#endif
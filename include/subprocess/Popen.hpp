@@ -1,29 +1,68 @@
 #ifndef SUBPROCESS_POPEN_H_
 #define SUBPROCESS_POPEN_H_
+#include <sched.h>
 #include <stdio.h>
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <map>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "CaptureData.hpp"
+#include "Cgroup.hpp"
 #include "ChildState.hpp"
 #include "ExitStatus.hpp"
+#include "MessageSocket.hpp"
 #include "PopenConfig.hpp"
 #include "PopenError.hpp"
 #include "PrepExec.hpp"
+#include "ResourceSampler.hpp"
 #include "Result.hpp"
+#include "RingChannel.hpp"
 #include "vendor/fdstream.hpp"
 
 namespace subprocess {
 
+  template<class In, class Out, class Err>
+  class BasicPopen;
+
   class Popen {
    public:
     Popen() = delete;
-    // TODO: make a destructor that closes any open std_in, std_err, std_out
+    Popen(Popen&& other);
+    Popen& operator=(Popen&& other);
+
+    /**
+     * Close any open std_in, std_out and std_err, then wait for the child
+     * to finish, unless the `Popen` has been detached.
+     *
+     * The parent's pipe ends are closed before waiting so that a child
+     * blocked reading its stdin or writing a full stdout pipe can still
+     * make progress and exit.
+     */
+    ~Popen();
+
     static Result<Popen> create(const std::vector<std::string>& argv, const PopenConfig& cfg);
 
+    /**
+     * `create` a child for each of `argvs`, all with `cfg`.
+     *
+     * Work that would be the same for every child is done once: the PATH
+     * search for the executable (`cfg.executable`, or else the first
+     * child's `argv[0]`, for the children that share it) and building
+     * `cfg.env`. With `threads` above 1 the children are spawned from that
+     * many threads at once.
+     *
+     * The results are in the order of `argvs`; one child failing does not
+     * stop the others.
+     */
+    static std::vector<Result<Popen>> create_many(const std::vector<std::vector<std::string>>& argvs,
+                                                  const PopenConfig& cfg, size_t threads = 1);
+
     /**
      * Wait for the process to finish and return its exit status.
      *
@@ -31,6 +70,12 @@ namespace subprocess {
      * with the exit status. Calling `wait` after that will return the
      * cached exit status without executing any system calls.
      *
+     * `wait`, `wait_timeout`, `poll`, `exit_status` and `pid` may be called
+     * from several threads at once: one of them reaps the child, and the
+     * others see the same exit status. A thread that finds another one
+     * reaping sleeps until it is done (`wait`) or returns as if the child
+     * were still running (`poll`).
+     *
      * # Errors
      *
      * Returns a `PopenError` if a system call fails in an unpredicted way.
@@ -38,6 +83,25 @@ namespace subprocess {
      */
     Result<ExitStatus> wait();
 
+    /**
+     * Whether the child managed to exec, waiting until it is known: nullopt
+     * if it did, or what went wrong if not (the same error `create` returns
+     * without `PopenConfig::async_exec`).
+     *
+     * `wait`, `wait_timeout` and `poll` collect the result too, so a child
+     * that failed to exec makes `wait` and `wait_timeout` return its error
+     * (once it has been reaped) and `poll` its exit status, 127.
+     */
+    std::optional<PopenError> exec_result();
+
+    /**
+     * A descriptor that becomes readable once the exec result is in, for
+     * registering with `poll`/`epoll`; -1 once it has been collected, which
+     * without `PopenConfig::async_exec` is already the case after `create`.
+     * It belongs to the `Popen`, and is closed when the result is collected.
+     */
+    int exec_fd() const { return exec_fail_fd; }
+
     /**
      * Check whether the process is still running, without blocking or errors.
      *
@@ -78,6 +142,83 @@ namespace subprocess {
      */
     Result<std::optional<ExitStatus>> wait_timeout(std::chrono::milliseconds us);
 
+    /**
+     * Feed `input` to the child's stdin (then close it), collect everything
+     * it writes to stdout and stderr, and wait for it to exit.
+     *
+     * Streams that were not redirected to pipes are skipped. All pipes are
+     * serviced together with poll(), so a child filling its stdout while we
+     * are still writing its stdin cannot deadlock. The pipes are switched
+     * to nonblocking mode if they were not already.
+     */
+    Result<CaptureData> communicate(const std::string& input = {});
+
+    /**
+     * Mark the process as detached.
+     *
+     * A detached `Popen` no longer waits for the child when it is destroyed,
+     * leaving it to run (and to be reaped) on its own.
+     */
+    void detach();
+
+    /**
+     * Send `signo` to the child alone.
+     *
+     * Once the child is known to have finished this does nothing, as its
+     * pid may belong to another process by then.
+     */
+    std::optional<PopenError> send_signal(int signo);
+
+    /**
+     * Send `signo` to the child and its descendants.
+     *
+     * That is every process in the child's cgroup if it has one (see
+     * `PopenConfig::cgroup`), or else its process group if it leads one
+     * (`PopenConfig::setpgid`), even after the child itself has exited,
+     * until it is waited for. Otherwise only the child is signaled, as
+     * with `send_signal`.
+     */
+    std::optional<PopenError> signal_tree(int signo);
+
+    /**
+     * Kill the child and its descendants with SIGKILL, and close our ends
+     * of its streams.
+     *
+     * Closing matters when descendants escape: one that still holds the
+     * child's stdout keeps a reader from ever seeing end of file. The child
+     * is not waited for; `wait()` returns promptly afterwards.
+     */
+    std::optional<PopenError> kill_tree();
+
+    /**
+     * Stop the child and its descendants, politely first.
+     *
+     * Sends SIGTERM to the tree (see `signal_tree`) and gives the child up
+     * to `grace` to exit, watching a pidfd rather than polling. If it is
+     * still running then, what is left of the tree is killed as by
+     * `kill_tree`. The child is waited for; one that exited in time keeps
+     * its streams open, so its unread output can still be read.
+     */
+    Result<ExitStatus> terminate(std::chrono::milliseconds grace);
+
+    /**
+     * `terminate` many children at once, with one grace period for all of
+     * them rather than one each. The results are in the order of `popens`.
+     */
+    static std::vector<Result<ExitStatus>> terminate_all(const std::vector<Popen*>& popens,
+                                                         std::chrono::milliseconds grace);
+
+    /**
+     * The child's resource usage over time, oldest first, as recorded by
+     * `PopenConfig::sampler`.
+     *
+     * Empty without a sampler, or if the child could not be tracked. The
+     * samples are forgotten once the `Popen` is destroyed.
+     */
+    std::vector<ResourceSample> resource_samples() const;
+
+    /// Not for reading while another thread may be waiting: `exit_status`
+    /// and `pid` are safe then.
     ChildState child_state;
     bool detached;
 
@@ -85,8 +226,132 @@ namespace subprocess {
     std::optional<boost::fdistream> std_out {std::nullopt};
     std::optional<boost::fdistream> std_err {std::nullopt};
 
+    /// The parent's ends of any `Redirection::SharedRing` streams: we write
+    /// `ring_in` and read `ring_out` and `ring_err`.
+    std::optional<RingChannel> ring_in {std::nullopt};
+    std::optional<RingChannel> ring_out {std::nullopt};
+    std::optional<RingChannel> ring_err {std::nullopt};
+
+    /// The parent's ends of any `Redirection::Socket` streams.
+    std::optional<MessageSocket> sock_in {std::nullopt};
+    std::optional<MessageSocket> sock_out {std::nullopt};
+    std::optional<MessageSocket> sock_err {std::nullopt};
+
+    /// The parent's ends of `PopenConfig::extra_fds`, keyed by the child's
+    /// descriptor number: pipes to the child, pipes from it, and sockets.
+    std::map<int, boost::fdostream> extra_in;
+    std::map<int, boost::fdistream> extra_out;
+    std::map<int, MessageSocket> extra_sockets;
+
+    /// The cgroup the child was started in (see `PopenConfig::cgroup`),
+    /// for its `stats()`, or to `kill()` the child and all its descendants.
+    std::optional<Cgroup> cgroup {std::nullopt};
+
    private:
-    std::optional<PopenError> os_start(const std::vector<std::string>& argv, const PopenConfig& cfg);
+    template<class In, class Out, class Err>
+    friend class BasicPopen;
+
+    // One descriptor to set up in the child: `source` is dup2()ed to
+    // `target`, or just made inheritable if they are the same.
+    struct ChildFd {
+      int target;
+      int source;
+      // whether we created `source` for the child, to close once it is spawned
+      bool owned;
+    };
+
+    // The process attributes from PopenConfig, converted before fork() so
+    // that applying them in the child needs no allocation.
+    struct ChildAttrs {
+      static constexpr size_t max_numa_nodes = 1024;
+      std::optional<cpu_set_t> affinity;
+      std::optional<Scheduling> scheduling;
+      std::optional<int> nice;
+      std::optional<int> io_priority;
+      std::optional<int> numa_mode;
+      std::array<unsigned long, max_numa_nodes / (8 * sizeof(unsigned long))> numa_nodes;
+      std::vector<ResourceLimit> rlimits;
+    };
+
+    // What a spawn needs besides the Popen itself, kept per thread (see
+    // scratch()) so that spawning again reuses it instead of allocating,
+    // and threads spawning at once share nothing.
+    struct SpawnScratch {
+      PrepExec exec;
+      std::vector<ChildFd> child_fds;
+    };
+
+    // What create_many prepares once for all its children.
+    struct SharedSpawn {
+      // `name`, as found on PATH, or empty to search in each child
+      std::string name;
+      std::string path;
+      std::optional<RaggedCstrArray> env;
+    };
+
+    Popen(ChildState&& state, bool detached);
+
+    // The standard streams' redirections: the PopenConfig's, or fixed by
+    // a BasicPopen.
+    struct StdLayout {
+      const Redirection& in;
+      const Redirection& out;
+      const Redirection& err;
+    };
+
+    static Result<Popen> create(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                                SharedSpawn* shared);
+    static Result<Popen> create(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                                SharedSpawn* shared, const StdLayout& layout);
+
+    static SpawnScratch& scratch();
+
+    // How far `child_state` has got, for threads waiting at once. One
+    // thread at a time, the reaper, moves it from Running to Reaping. The
+    // reaper calls waitpid(), collects the exec report, and publishes
+    // `child_state` and `exec_error`. It then stores Finished, or Running
+    // if the child has not exited (exec_result() only collects the report).
+    // Waiters sleep on it as a futex while it is ReapingWaited.
+    enum Phase : uint32_t { Running, Reaping, ReapingWaited, Finished };
+    std::atomic<uint32_t> phase{Running};
+    // The child's pid, once spawned; readable without the race on `child_state`.
+    pid_t spawned_pid{-1};
+
+    // The read end of the exec-fail pipe, until the child's report has
+    // been collected into `exec_error`; see collect_exec.
+    int exec_fail_fd{-1};
+    std::optional<PopenError> exec_error{std::nullopt};
+
+    // The process group the child leads, or 0.
+    pid_t group{0};
+
+    // Where the child is tracked, if PopenConfig::sampler was given.
+    ResourceSampler* sampler{nullptr};
+    ResourceSampler::Id sample_id{0};
+
+    static Result<ChildAttrs> prepare_attrs(const PopenConfig& cfg);
+    // Apply `attrs` to the calling process; returns 0 or an errno value.
+    static int32_t apply_attrs(const ChildAttrs& attrs);
+
+    // Close the `owned` sources once the child has them.
+    static void close_child_ends(const std::vector<ChildFd>& child_fds);
+    // Add the standard streams' entries, from setup_streams, to `child_fds`.
+    static void add_std_child_fds(std::tuple<int, int, int> child_ends, std::vector<ChildFd>& child_fds);
+
+    // Read the child's exec report from exec_fail_fd: nothing, once the
+    // pipe closes on exec, or the errno it failed with. Returns whether
+    // the report is in, waiting for it only if `block`.
+    bool collect_exec(bool block);
+
+    // Close our ends of the child's streams, rings and sockets.
+    void close_streams();
+
+    // Close our ends of the standard streams and reap the child unless
+    // detached. Shared by the destructor and move assignment.
+    void release();
+
+    std::optional<PopenError> os_start(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                                       SharedSpawn* shared, const StdLayout& layout);
     // Create the pipes requested by stdin, stdout, and stderr from
     // the PopenConfig used to construct us, and return the file-
     // descriptors to be given to the child process.
@@ -96,12 +361,36 @@ namespace subprocess {
     // of the pipe.
     Result<std::tuple<int, int, int>> setup_streams(const Redirection&& stin, const Redirection&& stout, const Redirection&& sterr);
 
+    // Create the descriptors requested by PopenConfig::extra_fds, adding
+    // them to `child_fds`.
+    std::optional<PopenError> setup_extra_fds(const std::map<int, Redirection>& extra_fds,
+                                              std::vector<ChildFd>& child_fds);
+
+    // Open or create the cgroup requested by PopenConfig::cgroup.
+    std::optional<PopenError> setup_cgroup(const PopenConfig& cfg);
+
+    // Create the rings requested with Redirection::SharedRing, numbered
+    // at least `min_fd`.
+    std::optional<PopenError> setup_rings(const StdLayout& layout, int min_fd);
+
+    // Reap the child if it has exited (waiting for it to, if `block`),
+    // unless another thread is reaping it already, in which case a
+    // blocking call waits for that one instead. See `phase`.
     Result<const std::nullopt_t> waitpid(bool block);
 
+    // Move `phase` from Running to Reaping, making this thread the reaper.
+    // False once Finished, or if another thread is reaping and not `block`;
+    // a blocking call otherwise sleeps until that thread is done.
+    bool begin_reaping(bool block);
+    // Move `phase` on from Reaping, to Running or Finished, waking waiters.
+    void end_reaping(Phase next);
+
+    // Runs in the child between fork and exec, so must not allocate.
     int32_t do_exec(
       PrepExec& just_exec,
-      std::tuple<int, int, int> child_ends,
-      std::optional<std::string> cwd,
+      std::vector<ChildFd>& child_fds,
+      const ChildAttrs& attrs,
+      const std::optional<std::string>& cwd,
       std::optional<uint32_t> setuid,
       std::optional<uint32_t> setgid,
       bool setpgid
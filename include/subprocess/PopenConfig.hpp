@@ -1,16 +1,68 @@
 #ifndef SUBPROCESS_POPEN_CONFIG_H_
 #define SUBPROCESS_POPEN_CONFIG_H_
+#include <sched.h>
+#include <sys/resource.h>
+
+#include <map>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "Cgroup.hpp"
 #include "Redirection.hpp"
+#include "ResourceSampler.hpp"
 
 namespace subprocess {
 
   using EnvVar = std::pair<std::string, std::string>;
 
+  /// A scheduling policy for `PopenConfig::scheduling`, as for
+  /// `sched_setscheduler(2)`: `SCHED_OTHER`, `SCHED_BATCH` or `SCHED_IDLE`
+  /// with priority 0, or `SCHED_FIFO` or `SCHED_RR` with a real-time priority.
+  struct Scheduling {
+    int policy{ SCHED_OTHER };
+    int priority{ 0 };
+  };
+
+  /// An I/O priority for `PopenConfig::io_priority`, as for `ioprio_set(2)`.
+  struct IoPriority {
+    enum class Class { RealTime = 1, BestEffort = 2, Idle = 3 };
+    Class io_class{ Class::BestEffort };
+    /// 0 (highest) to 7 (lowest); ignored for `Idle`.
+    int level{ 4 };
+  };
+
+  /// A NUMA memory policy for `PopenConfig::numa_policy`, as for
+  /// `set_mempolicy(2)`.
+  struct NumaPolicy {
+    enum class Mode { Default = 0, Preferred = 1, Bind = 2, Interleave = 3, Local = 4 };
+    Mode mode{ Mode::Default };
+    /// The nodes the mode applies to; empty for `Default` and `Local`.
+    std::vector<int> nodes{};
+  };
+
+  /// Where `PopenConfig::cgroup` puts the child.
+  struct CgroupConfig {
+    /// A cgroup v2 directory, e.g. "/sys/fs/cgroup/jobs": the cgroup to
+    /// start the child in, or with `create_leaf`, the parent of its own.
+    std::string path;
+    /// Create a leaf cgroup under `path` for this child alone, available
+    /// as `Popen::cgroup` and removed once the child has been waited for.
+    bool create_leaf{ false };
+    /// Limits to write before the child starts. Without `create_leaf`,
+    /// they apply to everything already in the cgroup as well.
+    CgroupLimits limits{};
+  };
+
+  /// A limit for `PopenConfig::rlimits`, as for `setrlimit(2)`.
+  struct ResourceLimit {
+    /// `RLIMIT_AS`, `RLIMIT_CPU`, `RLIMIT_NOFILE`, `RLIMIT_NPROC`...
+    int resource;
+    rlim_t soft;
+    rlim_t hard;
+  };
+
   struct PopenConfig {
     /// How to configure the executed program's standard input.
     Redirection stdin{ Redirection::None() };
@@ -18,9 +70,41 @@ namespace subprocess {
     Redirection stdout{ Redirection::None() };
     /// How to configure the executed program's standard error.
     Redirection stderr{ Redirection::None() };
+
+    /// Descriptors to set up in the child besides its standard streams,
+    /// keyed by the descriptor number the child sees (which must be above 2).
+    ///
+    /// A `Redirection::Pipe` is read by the parent from `Popen::extra_out`,
+    /// or written to through `Popen::extra_in` if its direction is
+    /// `ToChild`. `FileDescriptor` and `Socket` (whose parent end is in
+    /// `Popen::extra_sockets`) work as for the standard streams, and `None`
+    /// leaves the descriptor alone. `Merge` and `SharedRing` are invalid
+    /// here and make `Popen::create` return `PopenError::LogicError`.
+    std::map<int, Redirection> extra_fds{};
+
     /// Whether the `Popen` instance is initially detached.
     bool detached{ false };
 
+    /// Put the parent's ends of any pipes in nonblocking mode.
+    ///
+    /// With this set, `std_in`, `std_out` and `std_err` never block. Use
+    /// their `read_some`/`write_some` methods, which take an optional
+    /// deadline and report "would block" and "timed out" separately from
+    /// end of file. Each stream's `fd()` may also be registered with an
+    /// external `poll`/`epoll` loop. The child's ends are unaffected.
+    bool nonblocking{ false };
+
+    /// Return from `Popen::create` as soon as the child is forked, without
+    /// waiting for it to exec.
+    ///
+    /// By default `create` waits until the child has run its setup (the
+    /// redirections, `cwd`, `setuid`, the PATH search) and exec'd, so that a
+    /// failure is reported by `create`. With this set, launching many
+    /// children does not serialize on that; a failed exec is reported later
+    /// by `Popen::exec_result`, or by `wait`, which still reaps the child.
+    /// `Popen::exec_fd` may be watched by an event loop meanwhile.
+    bool async_exec{ false };
+
     /// Executable to run.
     ///
     /// If provided, this executable will be used to run the program
@@ -65,6 +149,51 @@ namespace subprocess {
     // Not to be confused with the similarly named `setgid`.
     bool setpgid{false};
 
+    // The process attributes below are applied in the child between fork()
+    // and exec(), so unlike wrapping the command in taskset(1), nice(1) or
+    // ionice(1) they cost no extra exec().
+
+    /// Restrict the subprocess to these CPUs (see `sched_setaffinity(2)`).
+    ///
+    /// Empty means inherit the parent's affinity.
+    std::vector<int> cpu_affinity{};
+
+    /// Scheduling policy and priority for the subprocess.
+    ///
+    /// Raising priority, or choosing a real-time policy, needs privileges;
+    /// if it is not permitted `Popen::create` fails.
+    std::optional<Scheduling> scheduling{ std::nullopt };
+
+    /// Nice value for the subprocess, from -20 to 19.
+    ///
+    /// This is the value itself, not an increment as for nice(1).
+    std::optional<int> nice{ std::nullopt };
+
+    /// I/O scheduling class and priority for the subprocess.
+    std::optional<IoPriority> io_priority{ std::nullopt };
+
+    /// NUMA memory policy for the subprocess, e.g. `{ NumaPolicy::Mode::Bind,
+    /// { 0 } }` to allocate only from node 0.
+    std::optional<NumaPolicy> numa_policy{ std::nullopt };
+
+    /// Start the subprocess in a cgroup v2 cgroup, optionally one created
+    /// for it with resource limits.
+    ///
+    /// The child is created inside the cgroup (`CLONE_INTO_CGROUP`, Linux
+    /// 5.7), so it never runs outside it, not even briefly. On older
+    /// kernels it moves itself there before running anything else.
+    std::optional<CgroupConfig> cgroup{ std::nullopt };
+
+    /// Resource limits for the subprocess, set with `setrlimit(2)`.
+    ///
+    /// Unlike a cgroup's limits these apply to each process on its own
+    /// (children inherit copies), but they need no cgroup delegation.
+    std::vector<ResourceLimit> rlimits{};
+
+    /// Record the subprocess's resource usage over time with this sampler,
+    /// which must outlive the `Popen`; see `Popen::resource_samples`.
+    ResourceSampler* sampler{ nullptr };
+
     /// Returns the environment of the current process.
     ///
     /// The returned value is in the format accepted by the `env`
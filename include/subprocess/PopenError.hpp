@@ -6,16 +6,37 @@
 
 namespace subprocess {
 
+  /**
+   * An error from spawning or managing a child process.
+   *
+   * Errors are cheap to create and copy: they hold the failing operation as
+   * a string literal and the `errno` value it reported. The human readable
+   * text is only built when `message()` is called, so constructing an error
+   * never allocates.
+   */
   struct PopenError {
-    enum class ErrKind { IoError, LogicError };
+    enum class ErrKind { IoError, LogicError, Overloaded };
     constexpr static ErrKind IoError = ErrKind::IoError;
     constexpr static ErrKind LogicError = ErrKind::LogicError;
-    const ErrKind kind;
-    const std::string message;
+    /// The system (or a `SpawnGovernor`) is out of capacity for another
+    /// child right now. Retrying immediately makes things worse; back off
+    /// or shed the work.
+    constexpr static ErrKind Overloaded = ErrKind::Overloaded;
+    ErrKind kind;
+    /// What failed, e.g. "fork()". Must point to a string with static
+    /// storage duration (in practice, a string literal).
+    const char* context;
+    /// The `errno` value reported by the failing call, or 0 if none.
+    int errnum;
 
-    PopenError(ErrKind _kind, const std::string& _message);
-    PopenError(PopenError&& other);
-    PopenError(const PopenError& other);
+    PopenError(ErrKind _kind, const char* _context, int _errnum = 0);
+    PopenError(PopenError&& other) = default;
+    PopenError(const PopenError& other) = default;
+    PopenError& operator=(PopenError&& other) = default;
+    PopenError& operator=(const PopenError& other) = default;
+
+    /// Format the error as "<context>: <description of errnum>".
+    std::string message() const;
   };
 }  // namespace subprocess
 #endif
@@ -17,23 +17,57 @@ namespace subprocess {
  * will need in order to perform the exec.
  * (in the rust version, it's implemented as a function returning
  *  a FnOnce)
+ *
+ * A PrepExec may be prepared again for another command, reusing its
+ * storage, so one that is kept around stops allocating once it has
+ * seen its largest command.
  */
 class PrepExec {
   std::string cmd;
   RaggedCstrArray argvec;
-  std::optional<RaggedCstrArray> envvec;
-  std::optional<std::string> searchpath;
+  RaggedCstrArray envvec;
+  bool use_env = false;
+  char** shared_envp = nullptr;
+  std::string searchpath;
+  bool search = false;
   std::vector<char> prealloc_exe;
 
   int32_t libc_exec();
 
  public:
+  PrepExec() = default;
   PrepExec(
-    const std::string& cmd,
+    std::string cmd,
     const std::vector<std::string>& args,
-    const std::optional<std::vector<std::string>>& env
+    std::optional<RaggedCstrArray> env
   );
 
+  /**
+   * Get ready to exec `cmd` with `args`, inheriting our environment
+   * unless `env()` is filled in afterwards.
+   */
+  void prepare(const std::string& cmd, const std::vector<std::string>& args);
+
+  /**
+   * The environment to exec with instead of ours, emptied for the
+   * caller to fill in.
+   */
+  RaggedCstrArray& env();
+
+  /**
+   * Exec with `envp` instead of `env()` or ours, until the next
+   * `prepare`. It is not copied, so must outlive the exec.
+   */
+  void share_env(char** envp);
+
+  /**
+   * Search PATH for `cmd`, as `exec()` would, returning the absolute
+   * path it would run. nullopt if that cannot be known in advance: `cmd`
+   * is not found, contains a '/', or a relative PATH entry comes first
+   * (it would be resolved in the child's working directory).
+   */
+  static std::optional<std::string> resolve(const std::string& cmd);
+
   int32_t exec();
 };
 
@@ -1,68 +1,136 @@
 #ifndef SUBPROCESS_RAII_CHAR_STAR_H_
 #define SUBPROCESS_RAII_CHAR_STAR_H_
 
-#include <iterator>
+#include <initializer_list>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace subprocess {
-  struct RaiiCharStar {
-    mutable std::vector<char> buf;
-    RaiiCharStar(std::string s)
-        : buf(s.c_str(), s.c_str() + s.size() + 1) { }
-    operator char*() const { return &buf[0]; };
-  };
-
   /**
    * A RaggedCstrArray owns a vector of c-strings, releasing their
    * memory when it is destroyed.
    *
-   *   _ptrs: a vector of char*, one for each RaiiCharChar, terminated by a nullptr
+   * All strings are stored back to back in a single buffer, so building
+   * the array costs two allocations regardless of how many strings it
+   * holds. The pointer array is kept up to date (and null-terminated) on
+   * every change, which means `asCharStar()` never allocates and is safe
+   * to call after fork().
+   *
+   *   _ptrs: a vector of char*, one for each string, terminated by a nullptr
    *   │
-   *   │      _cStrs: a vector of RaiiCharStar, null-terminated C-strings
+   *   │      _buf: every string, each followed by its '\0'
    *   │      │
    *   │      ▼
-   *   │      0: Apple\0
-   *   ▼         ▲
-   *   0:────────┘
-   *          1: Banana\0
-   *             ▲
-   *   1:────────┘
-   *          2: Clementine\0
-   *             ▲
-   *   2:────────┘
-   *
+   *   │      Apple\0Banana\0Clementine\0
+   *   ▼      ▲      ▲       ▲
+   *   0:─────┘      │       │
+   *   1:────────────┘       │
+   *   2:────────────────────┘
    *   3: nullptr
    */
   class RaggedCstrArray {
    public:
-    RaggedCstrArray() { }
-    RaggedCstrArray(std::vector<std::string> strs)
-        : _cStrs{ strs.begin(), strs.end() }
-        , _ptrs{ _cStrs.begin(), _cStrs.end() } { }
+    RaggedCstrArray()
+        : _ptrs{ nullptr } { }
+    RaggedCstrArray(const std::vector<std::string>& strs) {
+      assign(strs);
+    }
 
-    void push(const std::string& str) {
-      if (_ptrs.size() > _cStrs.size()) {
-        // clear out the extra nullptr we have if asCharStar
-        // was called prior to this
-        _ptrs.erase(_ptrs.end() - 1);
+    RaggedCstrArray(const RaggedCstrArray& other)
+        : _buf{ other._buf } {
+      rebuild_ptrs();
+    }
+    RaggedCstrArray& operator=(const RaggedCstrArray& other) {
+      if (this != &other) {
+        _buf = other._buf;
+        rebuild_ptrs();
       }
+      return *this;
+    }
+    // Moving a vector keeps its storage, so the pointers stay valid. The
+    // source is left empty, with its terminator: giving it one may allocate.
+    RaggedCstrArray(RaggedCstrArray&& other)
+        : _buf{ std::move(other._buf) }
+        , _ptrs{ std::move(other._ptrs) } {
+      other.clear();
+    }
+    RaggedCstrArray& operator=(RaggedCstrArray&& other) {
+      if (this != &other) {
+        // the source takes our storage, which always has room for the
+        // terminator
+        _buf.swap(other._buf);
+        _ptrs.swap(other._ptrs);
+        other.clear();
+      }
+      return *this;
+    }
+
+    /// Replace the contents with `strs`, reusing the storage: no allocation
+    /// once it has held as many strings and characters.
+    void assign(const std::vector<std::string>& strs) {
+      size_t total = 0;
+      for (const auto& str : strs) total += str.size() + 1;
+      _buf.clear();
+      _buf.reserve(total);
+      for (const auto& str : strs) _buf.insert(_buf.end(), str.c_str(), str.c_str() + str.size() + 1);
+      _ptrs.reserve(strs.size() + 1);
+      rebuild_ptrs();
+    }
 
-      _cStrs.push_back(str);
-      _ptrs.push_back(&(*_cStrs.back()));
+    /// Remove every string, keeping the storage.
+    void clear() {
+      _buf.clear();
+      _ptrs.clear();
+      _ptrs.push_back(nullptr);
+    }
+
+    /// Make room for `strings` more strings totalling `chars` characters
+    /// (not counting their null terminators).
+    void reserve(size_t strings, size_t chars) {
+      _buf.reserve(_buf.size() + chars + strings);
+      _ptrs.reserve(_ptrs.size() + strings);
+    }
+
+    void push(const std::string& str) { push({ std::string_view{ str } }); }
+
+    /// Append the concatenation of `parts` as a single string, e.g.
+    /// `push({ key, "=", value })`, without building a temporary.
+    void push(std::initializer_list<std::string_view> parts) {
+      const char* old_data = _buf.data();
+      size_t start = _buf.size();
+      for (auto part : parts) _buf.insert(_buf.end(), part.begin(), part.end());
+      _buf.push_back('\0');
+      if (_buf.data() != old_data) {
+        rebuild_ptrs();
+      } else {
+        _ptrs.back() = &_buf[start];
+        _ptrs.push_back(nullptr);
+      }
     }
 
+    size_t size() const { return _ptrs.size() - 1; }
+
     /**
      * returns the null-terminated ragged array of char*s
      * corresponding to the strings in this container
      */
-    char** asCharStar() {
+    char** asCharStar() { return _ptrs.data(); }
+
+   private:
+    void rebuild_ptrs() {
+      _ptrs.clear();
+      size_t start = 0;
+      for (size_t i = 0; i < _buf.size(); i++) {
+        if (_buf[i] == '\0') {
+          _ptrs.push_back(&_buf[start]);
+          start = i + 1;
+        }
+      }
       _ptrs.push_back(nullptr);
-      return &_ptrs[0];
     }
 
-   private:
-    std::vector<RaiiCharStar> _cStrs;
+    std::vector<char> _buf;
     std::vector<char*> _ptrs;
   };
 }  // namespace subprocess
@@ -0,0 +1,96 @@
+#ifndef SUBPROCESS_REACTOR_H_
+#define SUBPROCESS_REACTOR_H_
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "PopenError.hpp"
+#include "Result.hpp"
+
+struct epoll_event;
+
+namespace subprocess {
+
+  /**
+   * Readiness notifications for file descriptors and child exits.
+   *
+   * This is the extension point the coroutine awaitables in
+   * `Coroutine.hpp` are built on: an awaitable registers a one-shot
+   * callback and suspends, and the callback resumes it. Implement this
+   * interface to run those awaitables on your own executor; `EpollReactor`
+   * is the default.
+   *
+   * Every registration is one-shot: the callback runs at most once, from
+   * whichever thread drives the reactor, and must be registered again to
+   * be notified again.
+   */
+  class Reactor {
+   public:
+    using Callback = std::function<void()>;
+
+    virtual ~Reactor() = default;
+
+    /// Call `cb` once `fd` is readable (or at end of file / in error).
+    virtual std::optional<PopenError> on_readable(int fd, Callback cb) = 0;
+    /// Call `cb` once `fd` is writable (or the reader has gone away).
+    virtual std::optional<PopenError> on_writable(int fd, Callback cb) = 0;
+    /// Call `cb` once the child `pid` has exited. The child is not reaped.
+    virtual std::optional<PopenError> on_exit(pid_t pid, Callback cb) = 0;
+    /// Drop the pending registrations for `fd` without calling them.
+    virtual void cancel(int fd) = 0;
+  };
+
+  /**
+   * The default `Reactor`: one epoll instance, with child exits watched
+   * through pidfds. On kernels without pidfd_open() child exits are polled
+   * for every few milliseconds instead.
+   *
+   * Not thread-safe: register callbacks and call `run_once` from one thread.
+   */
+  class EpollReactor : public Reactor {
+   public:
+    EpollReactor();
+    ~EpollReactor() override;
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+    std::optional<PopenError> on_readable(int fd, Callback cb) override;
+    std::optional<PopenError> on_writable(int fd, Callback cb) override;
+    std::optional<PopenError> on_exit(pid_t pid, Callback cb) override;
+    void cancel(int fd) override;
+
+    /// Whether any registration is still waiting to fire.
+    bool has_pending() const;
+
+    /**
+     * Wait up to `timeout` (forever if nullopt) for registrations to become
+     * ready and run their callbacks. Returns the number of callbacks run.
+     */
+    Result<size_t> run_once(std::optional<std::chrono::milliseconds> timeout);
+
+   private:
+    struct Watch {
+      Callback readable;
+      Callback writable;
+      // for pidfds we opened ourselves, the exit callback
+      Callback exited;
+    };
+    struct PolledExit {
+      pid_t pid;
+      Callback cb;
+    };
+
+    std::optional<PopenError> update(int fd, Watch& watch, bool is_new);
+
+    int _epoll_fd;
+    std::unordered_map<int, Watch> _watches;
+    std::vector<PolledExit> _polled_exits;
+    std::vector<epoll_event> _events;
+  };
+}  // namespace subprocess
+#endif
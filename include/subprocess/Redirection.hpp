@@ -3,11 +3,11 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <filesystem>
 #include <fstream>
-#include <functional>
 #include <optional>
 #include <variant>
 
@@ -33,7 +33,14 @@ namespace subprocess {
     ///
     /// The field with `Popen` corresponding to the stream will be
     /// an fdstream corresponding to the parent's end of the pipe.
-    struct Pipe { };
+    ///
+    /// `direction` only matters for `PopenConfig::extra_fds`: the
+    /// standard streams' directions are fixed, and an extra descriptor
+    /// defaults to `FromChild`.
+    struct Pipe {
+      enum class Direction { Default, ToChild, FromChild };
+      Direction direction{ Direction::Default };
+    };
 
     /// Merge the stream to the other output stream.
     ///
@@ -83,6 +90,40 @@ namespace subprocess {
       FileDescriptor& operator=(FileDescriptor&& other);
     };
 
+    /// Exchange the stream's data through a shared-memory ring instead.
+    ///
+    /// For high-rate data between cooperating processes: a `RingChannel`
+    /// of at least `capacity` bytes is created and mapped in both the
+    /// parent and the child. The child inherits the ring's descriptor and
+    /// finds it through the `SUBPROCESS_RING_STDIN`, `SUBPROCESS_RING_STDOUT`
+    /// or `SUBPROCESS_RING_STDERR` environment variable; it attaches with
+    /// `RingChannel::from_env`. The child's standard stream itself is left
+    /// inherited, as with `Redirection::None`.
+    ///
+    /// The field in `Popen` corresponding to the stream will be
+    /// std::nullopt; the parent's end of the ring is in `ring_in`,
+    /// `ring_out` or `ring_err` instead.
+    struct SharedRing {
+      size_t capacity{ 1 << 20 };
+    };
+
+    /// Connect the stream to a Unix domain socket.
+    ///
+    /// A `socketpair` of the given `type` is created: one end becomes the
+    /// child's stream and the other is available to the parent as a
+    /// `MessageSocket`. With `SOCK_SEQPACKET` (the default) message
+    /// boundaries are preserved, and either side may pass open file
+    /// descriptors with SCM_RIGHTS. Use `SOCK_STREAM` for a plain
+    /// bidirectional byte stream. Ordinary programs can read and write the
+    /// socket as they would a pipe.
+    ///
+    /// The field in `Popen` corresponding to the stream will be
+    /// std::nullopt; the parent's end is in `sock_in`, `sock_out` or
+    /// `sock_err` instead.
+    struct Socket {
+      int type{ SOCK_SEQPACKET };
+    };
+
     /// Redirect the stream to/from the specified path, with other arguments as interpreted by open(2)
     ///
     /// You probably want one of Read, Write, or Append, which use this method
@@ -114,7 +155,7 @@ namespace subprocess {
     static Result<Redirection> Append(const std::filesystem::path& path);
 
   private:
-    using StateType = std::variant<None, Pipe, Merge, FileDescriptor>;
+    using StateType = std::variant<None, Pipe, Merge, FileDescriptor, SharedRing, Socket>;
     StateType _state;
   public:
     template<typename... Args>
@@ -139,18 +180,31 @@ namespace subprocess {
       return std::holds_alternative<T>(_state);
     }
     template <typename T>
-    T get() const {
+    const T& get() const {
       return std::get<T>(_state);
     }
 
     std::string toString() const;
 
+    /// Dispatch on the kind of redirection, calling exactly one of the cases.
+    /// `SharedRing` leaves the standard stream alone, so it goes to
+    /// `none_case`; `Socket` is set up separately and must not be matched.
+    ///
+    /// The cases may be any callables (typically lambdas); they are invoked
+    /// directly rather than through `std::function`, so matching never
+    /// allocates.
+    template <typename PipeCase, typename FileCase, typename MergeCase, typename NoneCase>
     Result<const std::nullopt_t> match(
-      std::function<Result<const std::nullopt_t>(const Pipe&)> pipe_case,
-      std::function<Result<const std::nullopt_t>(const FileDescriptor&)> file_case,
-      std::function<Result<const std::nullopt_t>(const Merge&)> merge_case,
-      std::function<Result<const std::nullopt_t>()> none_case
-    ) const;
+      PipeCase&& pipe_case,
+      FileCase&& file_case,
+      MergeCase&& merge_case,
+      NoneCase&& none_case
+    ) const {
+      if (auto pipe = std::get_if<Pipe>(&_state)) return pipe_case(*pipe);
+      if (auto file = std::get_if<FileDescriptor>(&_state)) return file_case(*file);
+      if (auto merge = std::get_if<Merge>(&_state)) return merge_case(*merge);
+      return none_case();
+    }
   };
 }  // namespace subprocess
 #endif
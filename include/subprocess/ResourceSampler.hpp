@@ -0,0 +1,117 @@
+#ifndef SUBPROCESS_RESOURCE_SAMPLER_H_
+#define SUBPROCESS_RESOURCE_SAMPLER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /// One reading of a child's resource usage.
+  struct ResourceSample {
+    std::chrono::steady_clock::time_point time;
+    /// CPU time so far, in user and kernel mode (`/proc/<pid>/stat`).
+    std::chrono::microseconds user_time;
+    std::chrono::microseconds system_time;
+    /// Resident and virtual memory, in bytes (`/proc/<pid>/statm`).
+    uint64_t rss_bytes;
+    uint64_t vm_bytes;
+    /// Bytes read from and written to storage so far (`/proc/<pid>/io`);
+    /// 0 where the kernel does not account I/O per task.
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint32_t threads;
+  };
+
+  /**
+   * Record how the resource usage of children evolves while they run.
+   *
+   * Each tracked child keeps its `/proc/<pid>/stat`, `statm` and `io` open,
+   * so a sample is three pread()s, and all children are sampled in one
+   * pass, by `sample_once` or by a background thread (`start`). A pass
+   * costs the same for every child; none allocates.
+   *
+   * Samples go to a fixed-size ring per child, so a long-running child
+   * keeps only its latest `Options::samples_per_child`.
+   *
+   * A child is sampled until it exits; its samples stay available until it
+   * is `untrack`ed. Since the open files belong to the process rather than
+   * to its pid, a reused pid is never sampled by mistake.
+   *
+   * All members are thread safe.
+   */
+  class ResourceSampler {
+   public:
+    using Id = uint64_t;
+
+    struct Options {
+      /// Time between two passes of the background thread.
+      std::chrono::milliseconds interval{ 100 };
+      /// Samples kept per child; the oldest are overwritten.
+      size_t samples_per_child{ 256 };
+    };
+
+    ResourceSampler();
+    ResourceSampler(Options options);
+    /// Stops the background thread, if started.
+    ~ResourceSampler();
+    ResourceSampler(const ResourceSampler&) = delete;
+    ResourceSampler& operator=(const ResourceSampler&) = delete;
+
+    /// Start sampling the child `pid`.
+    Result<Id> track(pid_t pid);
+
+    /// Stop sampling a child and forget its samples.
+    void untrack(Id id);
+
+    /// The child's samples, oldest first.
+    std::vector<ResourceSample> samples(Id id) const;
+
+    /// Sample every tracked child once. Returns how many were still running.
+    size_t sample_once();
+
+    /// Sample every `Options::interval` on a background thread, until `stop`.
+    void start();
+    void stop();
+
+    /// Number of tracked children.
+    size_t size() const;
+
+   private:
+    struct Child {
+      Id id;
+      int stat_fd{ -1 };
+      int statm_fd{ -1 };
+      int io_fd{ -1 };
+      bool exited{ false };
+      // ring of samples_per_child entries, `next` being the oldest once full
+      std::vector<ResourceSample> ring;
+      size_t next{ 0 };
+      size_t count{ 0 };
+    };
+
+    static void close_files(Child& child);
+    // Read one sample; false once the child has exited.
+    bool read_sample(const Child& child, ResourceSample& sample) const;
+
+    Options _options;
+    int64_t _tick_usec;
+    uint64_t _page_size;
+
+    mutable std::mutex _mutex;
+    std::vector<Child> _children;
+    Id _next_id{ 1 };
+
+    std::condition_variable _wake;
+    bool _stopping{ false };
+    std::thread _thread;
+  };
+}  // namespace subprocess
+#endif
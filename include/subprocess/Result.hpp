@@ -18,7 +18,9 @@ namespace subprocess {
     Result(Args&&... args)
     : _state{std::forward<Args>(args)...}
     { }
-    Result(Result&& other)
+    // noexcept, so that a std::vector of results of a move-only type
+    // (like Result<Popen>) can grow
+    Result(Result&& other) noexcept
     : _state{std::move(other._state)}
     { }
     Result(const Result& other)
@@ -41,7 +43,7 @@ namespace subprocess {
     }
 
     T&& or_throw() {
-      if (!ok()) throw new SubprocessException(take_error().message.c_str());
+      if (!ok()) throw SubprocessException(take_error().message());
       return take_value();
     }
   };
@@ -0,0 +1,97 @@
+#ifndef SUBPROCESS_RESULT_CACHE_H_
+#define SUBPROCESS_RESULT_CACHE_H_
+
+#include <stdint.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CaptureData.hpp"
+#include "PopenConfig.hpp"
+#include "PopenError.hpp"
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /**
+   * Remember the results of deterministic commands, so that running one
+   * again with the same inputs returns its output without spawning it.
+   *
+   * A result is keyed by a SHA-256 digest of everything that can change
+   * it: the executable's identity (device, inode, size and modification
+   * time, so a rebuilt tool misses), `argv`, the environment (or just
+   * `Options::env_keys` of it), the working directory, the bytes fed to
+   * stdin, and the contents of any input files named by the caller. Other
+   * `PopenConfig` settings are not part of the key.
+   *
+   * Results are files in a directory, named by their key and written
+   * atomically, so several caches (in other processes, too) may share it.
+   * Reads map the file instead of copying it through a buffer. Each hit
+   * refreshes the file's modification time, and once the entries exceed
+   * `Options::max_bytes` the least recently used are removed.
+   *
+   * Only results of commands that exited normally are stored; one killed
+   * by a signal says nothing about its inputs. A `ResultCache` object is
+   * not thread safe.
+   */
+  class ResultCache {
+   public:
+    struct Options {
+      /// Total size of the entries beyond which the least recently used are removed.
+      uint64_t max_bytes{ 256 * 1024 * 1024 };
+      /// The environment variables that are part of the key, or nullopt
+      /// for the whole environment.
+      std::optional<std::vector<std::string>> env_keys{ std::nullopt };
+    };
+
+    struct Stats {
+      uint64_t hits{ 0 };
+      uint64_t misses{ 0 };
+      uint64_t evictions{ 0 };
+    };
+
+    /// Use `directory`, which is created if missing, as the store.
+    static Result<ResultCache> open(const std::string& directory);
+    static Result<ResultCache> open(const std::string& directory, Options options);
+
+    /**
+     * Return the cached result of running `argv` with `config` and
+     * `input`, or else run it (with stdin, stdout and stderr redirected to
+     * pipes), store the result and return it.
+     *
+     * `input_files` are files the command reads whose contents should
+     * decide whether a cached result is still valid.
+     */
+    Result<CaptureData> run(const std::vector<std::string>& argv, PopenConfig config,
+                            const std::string& input = {},
+                            const std::vector<std::string>& input_files = {});
+
+    /// The key `run` uses, as 64 hex digits.
+    Result<std::string> key(const std::vector<std::string>& argv, const PopenConfig& config,
+                            const std::string& input = {},
+                            const std::vector<std::string>& input_files = {}) const;
+
+    /// The result stored under `key`, counting a hit or a miss. Anything
+    /// not shaped like a key from `key` is a miss, and touches no file.
+    std::optional<CaptureData> lookup(const std::string& key);
+
+    /// Store `data` under `key`, then evict if over `Options::max_bytes`.
+    std::optional<PopenError> store(const std::string& key, const CaptureData& data);
+
+    Stats stats() const { return _stats; }
+
+   private:
+    ResultCache(std::string directory, Options options, uint64_t total_bytes);
+
+    // Remove least recently used entries until under max_bytes.
+    void evict();
+
+    std::string _directory;
+    Options _options;
+    // our estimate of the entries' size, corrected by each evict()
+    uint64_t _total_bytes;
+    Stats _stats{};
+  };
+}  // namespace subprocess
+#endif
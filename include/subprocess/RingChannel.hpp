@@ -0,0 +1,401 @@
+#ifndef SUBPROCESS_RING_CHANNEL_H_
+#define SUBPROCESS_RING_CHANNEL_H_
+
+// Header-only and free of library dependencies, so that a cooperating child
+// can include it (together with vendor/fdstream.hpp) without linking
+// against the library.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "vendor/fdstream.hpp"
+
+namespace subprocess {
+
+  /**
+   * A single-producer, single-consumer byte ring in shared memory.
+   *
+   * The ring lives in a memfd, so any process holding the descriptor can
+   * `attach` to it: one process writes and the other reads. Data is copied
+   * once on each side and no system call is made while the ring is neither
+   * empty nor full; a side that has to wait sleeps on a futex in the shared
+   * mapping, and its peer only wakes it when it is actually asleep.
+   *
+   * This is what `Redirection::SharedRing` sets up between a `Popen` and its
+   * child. The child finds its end with `from_env("STDOUT")` (or `"STDIN"`,
+   * `"STDERR"`), which reads the `SUBPROCESS_RING_<stream>` environment
+   * variable holding the inherited descriptor.
+   *
+   * End of file is explicit: the writer's `close()` (or destructor) lets
+   * the reader drain the ring and then see `io_status::eof`. A writer that
+   * dies without closing leaves the reader waiting, so readers facing
+   * untrusted children should pass a deadline.
+   */
+  class RingChannel {
+   public:
+    /// Environment variable prefix; the suffix is the stream name.
+    static constexpr const char* env_prefix = "SUBPROCESS_RING_";
+
+    /// Which end of the ring a `RingChannel` is; decides what `close` means.
+    enum class Side : uint8_t { Reader, Writer };
+
+    /**
+     * Create a new ring holding at least `capacity` bytes (rounded up to a
+     * power of two, and to at least a page). The memfd is close-on-exec,
+     * and numbered at least `min_fd` so that it stays clear of descriptors
+     * a child is going to have dup2()ed over.
+     * Returns nullopt with errno set on failure.
+     */
+    static std::optional<RingChannel> create(size_t capacity, Side side, int min_fd = 3) {
+      size_t cap = page_size;
+      while (cap < capacity) cap <<= 1;
+
+      int fd = ::memfd_create("subprocess-ring", MFD_CLOEXEC);
+      if (fd < 0) return std::nullopt;
+      if (fd < min_fd) {
+        int moved = ::fcntl(fd, F_DUPFD_CLOEXEC, min_fd);
+        int saved = errno;
+        ::close(fd);
+        errno = saved;
+        if (moved < 0) return std::nullopt;
+        fd = moved;
+      }
+      if (::ftruncate(fd, static_cast<off_t>(page_size + cap)) != 0) {
+        int saved = errno;
+        ::close(fd);
+        errno = saved;
+        return std::nullopt;
+      }
+      auto ring = map(fd, side);
+      if (!ring.has_value()) {
+        int saved = errno;
+        ::close(fd);
+        errno = saved;
+        return std::nullopt;
+      }
+      ring->_header->capacity = cap;
+      ring->_header->magic = header_magic;
+      ring->_capacity = cap;
+      return ring;
+    }
+
+    /**
+     * Map an existing ring. Takes ownership of `fd`. Returns nullopt with
+     * errno set on failure (EINVAL if `fd` is not a ring: its data must be
+     * a power of two bytes, as its header says).
+     */
+    static std::optional<RingChannel> attach(int fd, Side side) {
+      auto ring = map(fd, side);
+      if (ring.has_value() && ring->_header->capacity != ring->_capacity) {
+        // unmap without flagging the ring closed, and leave `fd` open, as
+        // on the other failures
+        ring->_closed = true;
+        ring->release_fd();
+        errno = EINVAL;
+        return std::nullopt;
+      }
+      return ring;
+    }
+
+    /**
+     * Attach to the ring a parent passed for `stream` ("STDIN", "STDOUT"
+     * or "STDERR"), as named by the `SUBPROCESS_RING_<stream>` environment
+     * variable. We read the STDIN ring and write the others. Returns
+     * nullopt (errno ENOENT) if there is none.
+     */
+    static std::optional<RingChannel> from_env(const char* stream) {
+      std::string name = std::string{ env_prefix } + stream;
+      const char* value = ::getenv(name.c_str());
+      if (value == nullptr) {
+        errno = ENOENT;
+        return std::nullopt;
+      }
+      char* end = nullptr;
+      long fd = ::strtol(value, &end, 10);
+      if (end == value || *end != '\0' || fd < 0) {
+        errno = EINVAL;
+        return std::nullopt;
+      }
+      ::fcntl(static_cast<int>(fd), F_SETFD, FD_CLOEXEC);
+      auto side = ::strcmp(stream, "STDIN") == 0 ? Side::Reader : Side::Writer;
+      auto ring = attach(static_cast<int>(fd), side);
+      if (ring.has_value() && ring->_header->magic != header_magic) {
+        errno = EINVAL;
+        return std::nullopt;
+      }
+      return ring;
+    }
+
+    RingChannel(RingChannel&& other) noexcept
+        : _fd{ std::exchange(other._fd, -1) }
+        , _map{ std::exchange(other._map, nullptr) }
+        , _map_size{ std::exchange(other._map_size, 0) }
+        , _header{ std::exchange(other._header, nullptr) }
+        , _capacity{ std::exchange(other._capacity, 0) }
+        , _side{ other._side }
+        , _closed{ std::exchange(other._closed, true) } { }
+    RingChannel& operator=(RingChannel&& other) noexcept {
+      if (this != &other) {
+        reset();
+        _fd = std::exchange(other._fd, -1);
+        _map = std::exchange(other._map, nullptr);
+        _map_size = std::exchange(other._map_size, 0);
+        _header = std::exchange(other._header, nullptr);
+        _capacity = std::exchange(other._capacity, 0);
+        _side = other._side;
+        _closed = std::exchange(other._closed, true);
+      }
+      return *this;
+    }
+    RingChannel(const RingChannel&) = delete;
+    RingChannel& operator=(const RingChannel&) = delete;
+
+    /// Closes our side (see `close`) and unmaps the ring.
+    ~RingChannel() { reset(); }
+
+    /// The memfd backing the ring, or -1 once released.
+    int fd() const { return _fd; }
+
+    /// Usable bytes in the ring.
+    size_t capacity() const { return _capacity; }
+
+    Side side() const { return _side; }
+
+    /**
+     * Write all of `len` bytes, waiting for space while the ring is full.
+     *
+     * With a deadline, gives up with `timed_out` when it passes. Returns
+     * `eof` if the reader has closed its side. In every case the result's
+     * count says how many bytes were written.
+     */
+    boost::io_result write(const char* data, size_t len,
+                           std::optional<boost::deadline> until = std::nullopt) {
+      Header& h = *_header;
+      size_t done = 0;
+      while (done < len) {
+        if (h.closed.load(std::memory_order_acquire) & reader_closed) {
+          return { boost::io_status::eof, done, 0 };
+        }
+        size_t head = h.head.load(std::memory_order_relaxed);
+        size_t tail = h.tail.load(std::memory_order_acquire);
+        if (corrupted(head, tail)) return { boost::io_status::error, done, EPROTO };
+        size_t space = _capacity - (head - tail);
+        if (space == 0) {
+          auto res = wait(h.space_seq, h.writer_waiting, until, [&] {
+            return h.tail.load(std::memory_order_seq_cst) != tail ||
+                   (h.closed.load(std::memory_order_acquire) & reader_closed);
+          });
+          if (res != boost::io_status::ok) return { res, done, res == boost::io_status::error ? errno : 0 };
+          continue;
+        }
+        size_t n = std::min(space, len - done);
+        copy_in(head, data + done, n);
+        h.head.store(head + n, std::memory_order_seq_cst);
+        done += n;
+        if (h.reader_waiting.load(std::memory_order_seq_cst)) wake(h.data_seq);
+      }
+      return { boost::io_status::ok, done, 0 };
+    }
+
+    /**
+     * Read up to `len` bytes, waiting while the ring is empty.
+     *
+     * Returns `eof` once the writer has closed and the ring is drained,
+     * and `timed_out` if a deadline passes with no data.
+     */
+    boost::io_result read(char* dest, size_t len,
+                          std::optional<boost::deadline> until = std::nullopt) {
+      if (len == 0) return { boost::io_status::ok, 0, 0 };
+      Header& h = *_header;
+      while (true) {
+        size_t tail = h.tail.load(std::memory_order_relaxed);
+        size_t head = h.head.load(std::memory_order_acquire);
+        if (corrupted(head, tail)) return { boost::io_status::error, 0, EPROTO };
+        if (head != tail) {
+          size_t n = std::min(head - tail, len);
+          copy_out(tail, dest, n);
+          h.tail.store(tail + n, std::memory_order_seq_cst);
+          if (h.writer_waiting.load(std::memory_order_seq_cst)) wake(h.space_seq);
+          return { boost::io_status::ok, n, 0 };
+        }
+        if (h.closed.load(std::memory_order_acquire) & writer_closed) {
+          // the writer may have published more just before closing
+          if (h.head.load(std::memory_order_acquire) != tail) continue;
+          return { boost::io_status::eof, 0, 0 };
+        }
+        auto res = wait(h.data_seq, h.reader_waiting, until, [&] {
+          return h.head.load(std::memory_order_seq_cst) != tail ||
+                 (h.closed.load(std::memory_order_acquire) & writer_closed);
+        });
+        if (res != boost::io_status::ok) return { res, 0, res == boost::io_status::error ? errno : 0 };
+      }
+    }
+
+    /**
+     * Close our side: after the writer closes, the reader sees end of file
+     * once drained; after the reader closes, writes fail with `eof`.
+     */
+    void close() {
+      if (_header == nullptr || _closed) return;
+      _closed = true;
+      Header& h = *_header;
+      if (_side == Side::Writer) {
+        h.closed.fetch_or(writer_closed, std::memory_order_seq_cst);
+        wake(h.data_seq);
+      } else {
+        h.closed.fetch_or(reader_closed, std::memory_order_seq_cst);
+        wake(h.space_seq);
+      }
+    }
+
+    /// Give up the descriptor without closing it; the mapping stays.
+    int release_fd() { return std::exchange(_fd, -1); }
+
+   private:
+    static constexpr size_t page_size = 4096;
+    static constexpr uint32_t header_magic = 0x52494e47;  // "RING"
+    static constexpr uint32_t writer_closed = 1;
+    static constexpr uint32_t reader_closed = 2;
+
+    // The first page of the memfd; data follows in the rest. The producer's
+    // and consumer's counters are on separate cache lines.
+    struct Header {
+      uint32_t magic;
+      uint64_t capacity;
+      alignas(64) std::atomic<size_t> head;    // total bytes written
+      std::atomic<uint32_t> data_seq;          // futex: bumped to wake the reader
+      std::atomic<uint32_t> writer_waiting;
+      alignas(64) std::atomic<size_t> tail;    // total bytes read
+      std::atomic<uint32_t> space_seq;         // futex: bumped to wake the writer
+      std::atomic<uint32_t> reader_waiting;
+      alignas(64) std::atomic<uint32_t> closed;
+    };
+    static_assert(sizeof(Header) <= page_size);
+    static_assert(std::atomic<size_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+                  "the ring is shared between processes, so its atomics must be lock-free");
+
+    RingChannel() = default;
+
+    // attach() without checking the header, which create() has yet to write.
+    static std::optional<RingChannel> map(int fd, Side side) {
+      struct stat st;
+      if (::fstat(fd, &st) != 0) return std::nullopt;
+      auto size = static_cast<size_t>(st.st_size);
+      // copy_in and copy_out mask positions with capacity - 1
+      size_t capacity = size - page_size;
+      if (size < 2 * page_size || (capacity & (capacity - 1)) != 0) {
+        errno = EINVAL;
+        return std::nullopt;
+      }
+      void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mem == MAP_FAILED) return std::nullopt;
+      RingChannel ring;
+      ring._fd = fd;
+      ring._map = static_cast<char*>(mem);
+      ring._map_size = size;
+      ring._header = static_cast<Header*>(mem);
+      ring._capacity = capacity;
+      ring._side = side;
+      return ring;
+    }
+
+    // The peer shares the counters and may be buggy or hostile: a ring
+    // holding more than its capacity would have the copies run past the
+    // mapping.
+    bool corrupted(size_t head, size_t tail) const { return head - tail > _capacity; }
+
+    void reset() {
+      close();
+      if (_map != nullptr) ::munmap(_map, _map_size);
+      if (_fd >= 0) ::close(_fd);
+      _map = nullptr;
+      _header = nullptr;
+      _fd = -1;
+    }
+
+    char* data() const { return _map + page_size; }
+
+    void copy_in(size_t pos, const char* src, size_t n) {
+      size_t off = pos & (_capacity - 1);
+      size_t first = std::min(n, _capacity - off);
+      ::memcpy(data() + off, src, first);
+      ::memcpy(data(), src + first, n - first);
+    }
+
+    void copy_out(size_t pos, char* dest, size_t n) const {
+      size_t off = pos & (_capacity - 1);
+      size_t first = std::min(n, _capacity - off);
+      ::memcpy(dest, data() + off, first);
+      ::memcpy(dest + first, data(), n - first);
+    }
+
+    static void wake(std::atomic<uint32_t>& seq) {
+      seq.fetch_add(1, std::memory_order_seq_cst);
+      ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    // Sleep on `seq` until `ready()` or the deadline. `waiting` tells the
+    // peer to wake us; `ready` is re-checked after setting it so that a
+    // wakeup between the caller's check and the futex wait is not lost.
+    template<typename Ready>
+    static boost::io_status wait(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting,
+                                 std::optional<boost::deadline> until, Ready ready) {
+      uint32_t seen = seq.load(std::memory_order_seq_cst);
+      waiting.store(1, std::memory_order_seq_cst);
+      if (ready()) {
+        waiting.store(0, std::memory_order_relaxed);
+        return boost::io_status::ok;
+      }
+      struct timespec timeout;
+      struct timespec* timeout_ptr = nullptr;
+      if (until.has_value()) {
+        auto left = *until - std::chrono::steady_clock::now();
+        if (left <= std::chrono::steady_clock::duration::zero()) {
+          waiting.store(0, std::memory_order_relaxed);
+          return boost::io_status::timed_out;
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+        timeout.tv_sec = ns / 1000000000;
+        timeout.tv_nsec = ns % 1000000000;
+        timeout_ptr = &timeout;
+      }
+      long rc = ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAIT, seen,
+                          timeout_ptr, nullptr, 0);
+      int err = errno;
+      waiting.store(0, std::memory_order_relaxed);
+      if (rc != 0 && err == ETIMEDOUT) return boost::io_status::timed_out;
+      if (rc != 0 && err != EAGAIN && err != EINTR) {
+        errno = err;
+        return boost::io_status::error;
+      }
+      // woken, or raced with the peer: the caller re-checks
+      return boost::io_status::ok;
+    }
+
+    int _fd{ -1 };
+    char* _map{ nullptr };
+    size_t _map_size{ 0 };
+    Header* _header{ nullptr };
+    size_t _capacity{ 0 };
+    Side _side{ Side::Reader };
+    bool _closed{ false };
+  };
+}  // namespace subprocess
+#endif
@@ -0,0 +1,109 @@
+#ifndef SUBPROCESS_SPAWN_GOVERNOR_H_
+#define SUBPROCESS_SPAWN_GOVERNOR_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Popen.hpp"
+#include "PopenConfig.hpp"
+#include "PopenError.hpp"
+#include "Result.hpp"
+
+namespace subprocess {
+
+  /**
+   * Admission control for spawning children under load.
+   *
+   * `spawn` creates a `Popen` once it fits the configured limits: how many
+   * children spawned through the governor may be alive at once, how many
+   * may start per second, and, if a cgroup is watched, how close it is to
+   * its `pids.max` and how much memory pressure (PSI) it is under. A spawn
+   * that does not fit waits, up to a deadline, and then fails with
+   * `PopenError::Overloaded` so the caller can shed load.
+   *
+   * A `fork()` failing with EAGAIN or ENOMEM is retried with jittered
+   * exponential backoff, within the same deadline.
+   *
+   * Children count as alive until they exit, whoever reaps them. All
+   * members are thread safe; waiting spawns are not served in any
+   * particular order.
+   */
+  class SpawnGovernor {
+   public:
+    struct Options {
+      /// Children alive at once; 0 for no limit.
+      size_t max_live{ 0 };
+      /// Spawns per second on average, allowing bursts of `burst`; 0 for no limit.
+      double max_spawns_per_second{ 0 };
+      size_t burst{ 16 };
+      /// A cgroup v2 directory whose `pids.max` and `memory.pressure` to
+      /// respect, or nullopt for none. Missing files are ignored.
+      std::optional<std::string> cgroup{ std::nullopt };
+      /// Spawn only while `pids.current` is at least this far below `pids.max`.
+      uint64_t pids_headroom{ 16 };
+      /// Spawn only while the cgroup's memory "some avg10" pressure is at
+      /// most this percentage; 0 to ignore pressure.
+      double max_memory_pressure{ 0 };
+      /// How long a spawn may wait for admission (and retries), unless
+      /// `spawn` is given its own deadline. Zero fails at once.
+      std::chrono::milliseconds queue_timeout{ 1000 };
+      /// Backoff between attempts, doubling from the first to the second.
+      std::chrono::milliseconds min_backoff{ 1 };
+      std::chrono::milliseconds max_backoff{ 100 };
+    };
+
+    struct Stats {
+      uint64_t spawned{ 0 };
+      /// Spawns that failed with `Overloaded` at their deadline.
+      uint64_t rejected{ 0 };
+      /// fork() failures with EAGAIN or ENOMEM that were retried.
+      uint64_t retries{ 0 };
+    };
+
+    SpawnGovernor();
+    SpawnGovernor(Options options);
+    SpawnGovernor(const SpawnGovernor&) = delete;
+    SpawnGovernor& operator=(const SpawnGovernor&) = delete;
+
+    /// `Popen::create`, once admitted and before `deadline`.
+    Result<Popen> spawn(const std::vector<std::string>& argv, const PopenConfig& cfg);
+    Result<Popen> spawn(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                        std::chrono::steady_clock::time_point deadline);
+
+    /// Children spawned through us that have not exited, as of the last check.
+    size_t live();
+
+    Stats stats() const;
+
+   private:
+    // nullptr if a spawn may proceed now, or why not; `wait_hint` is set to
+    // when the rate limit allows the next spawn, if that is the reason.
+    // Admitting a spawn counts it in `_pending` until it is created.
+    const char* admit(std::chrono::steady_clock::time_point now, std::chrono::nanoseconds& wait_hint);
+    // Forget children that have exited.
+    void prune();
+    // A random duration up to `limit`, so waiting spawns do not retry in step.
+    std::chrono::nanoseconds jitter(std::chrono::nanoseconds limit);
+
+    Options _options;
+
+    mutable std::mutex _mutex;
+    std::vector<pid_t> _live;
+    // spawns admitted whose Popen::create has not returned
+    size_t _pending{ 0 };
+    double _tokens;
+    std::chrono::steady_clock::time_point _refilled;
+    std::chrono::steady_clock::time_point _pressure_checked{};
+    const char* _pressure_reason{ nullptr };
+    std::minstd_rand _random;
+    Stats _stats{};
+  };
+}  // namespace subprocess
+#endif
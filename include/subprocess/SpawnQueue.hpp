@@ -0,0 +1,167 @@
+#ifndef SUBPROCESS_SPAWN_QUEUE_H_
+#define SUBPROCESS_SPAWN_QUEUE_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Popen.hpp"
+#include "PopenConfig.hpp"
+#include "PopenError.hpp"
+#include "Result.hpp"
+#include "WaitSet.hpp"
+
+namespace subprocess {
+
+  /**
+   * Jobs from several tenants, spawned fairly.
+   *
+   * Jobs are queued per tenant and started with `Popen::create` as running
+   * slots free up, so that one tenant submitting thousands of jobs does not
+   * hold the others back. Among tenants with jobs waiting, the next job
+   * comes from the highest priority class waiting, then from the tenant
+   * furthest behind its weighted share of the jobs started (weighted fair
+   * queueing). A tenant that has been idle does not bank the share it did
+   * not use. Each tenant may have its own cap on jobs running.
+   *
+   * The queue owns the children it starts, reaps them through a `WaitSet`,
+   * and hands each to `Handlers::on_exit` once it has exited. It keeps
+   * per-tenant counts and the time jobs spent queued and running.
+   *
+   * Picking a job takes time linear in the tenants with jobs waiting.
+   * Not thread safe.
+   */
+  class SpawnQueue {
+   public:
+    using Clock = std::chrono::steady_clock;
+    using JobId = uint64_t;
+
+    /// Lower classes only start while no higher one has a job waiting
+    /// that may start.
+    enum class Priority : uint8_t { High = 0, Normal = 1, Low = 2 };
+
+    struct Handlers {
+      /// A job's child has exited; its `exit_status()` is set. The `Popen`
+      /// is destroyed afterwards.
+      std::function<void(JobId, Popen&)> on_exit;
+      /// A job's `Popen::create` failed.
+      std::function<void(JobId, const PopenError&)> on_error;
+    };
+
+    struct Options {
+      /// Jobs running at once, over all tenants; 0 for no limit.
+      size_t max_running{ 16 };
+    };
+
+    struct TenantOptions {
+      /// The tenant's share of the jobs started, relative to the others'.
+      uint32_t weight{ 1 };
+      /// Jobs of the tenant running at once; 0 for no limit.
+      size_t max_running{ 0 };
+    };
+
+    struct TenantStats {
+      uint64_t submitted{ 0 };
+      uint64_t started{ 0 };
+      uint64_t finished{ 0 };
+      /// Jobs whose `Popen::create` failed.
+      uint64_t failed{ 0 };
+      size_t queued{ 0 };
+      size_t running{ 0 };
+      /// Time from `submit` to start, summed over the jobs started, and
+      /// the longest.
+      std::chrono::nanoseconds queue_wait{ 0 };
+      std::chrono::nanoseconds max_queue_wait{ 0 };
+      /// Time from start to being reaped, summed over the jobs finished.
+      std::chrono::nanoseconds run_time{ 0 };
+    };
+
+    SpawnQueue(Handlers handlers);
+    SpawnQueue(Handlers handlers, Options options);
+    /// Drop the jobs still queued; the running children are waited for.
+    ~SpawnQueue();
+    SpawnQueue(const SpawnQueue&) = delete;
+    SpawnQueue& operator=(const SpawnQueue&) = delete;
+
+    /// Set a tenant's weight and cap. Tenants not set up get the defaults.
+    void set_tenant(const std::string& tenant, TenantOptions options);
+
+    /// Queue a job for `tenant`. It starts from `dispatch` or `run_once`.
+    JobId submit(const std::string& tenant, std::vector<std::string> argv, PopenConfig cfg = PopenConfig{},
+                 Priority priority = Priority::Normal);
+
+    /// Start as many queued jobs as the caps allow; returns how many.
+    size_t dispatch();
+
+    /**
+     * `dispatch`, wait until a running job exits or until `deadline`
+     * (forever if nullopt), reap those that have and `dispatch` again.
+     * Returns the number of jobs reaped.
+     */
+    Result<size_t> run_once(std::optional<Clock::time_point> deadline = std::nullopt);
+
+    /// Run until every job submitted has finished.
+    std::optional<PopenError> run();
+
+    /// Jobs waiting to start, and running, over all tenants.
+    size_t queued() const { return _queued; }
+    size_t running() const { return _running.size(); }
+
+    /// The tenant's counts, or nullopt for a tenant never seen.
+    std::optional<TenantStats> stats(const std::string& tenant) const;
+
+   private:
+    static constexpr size_t priorities = 3;
+
+    struct Job {
+      JobId id;
+      std::vector<std::string> argv;
+      PopenConfig cfg;
+      Clock::time_point submitted;
+    };
+
+    struct Tenant {
+      TenantOptions options;
+      // virtual time: jobs started, each counting 1/weight
+      double tag{ 0 };
+      std::array<std::deque<Job>, priorities> queues;
+      TenantStats stats;
+    };
+
+    struct Running {
+      JobId id;
+      uint32_t tenant;
+      Clock::time_point started;
+      std::unique_ptr<Popen> popen;
+    };
+
+    uint32_t tenant_index(const std::string& tenant);
+    // Start `job` for the tenant, or report that it failed to.
+    void start(uint32_t tenant, Job job);
+    // Account for the reaped child, hand it to on_exit and drop it.
+    void finish(Popen* popen);
+
+    Handlers _handlers;
+    Options _options;
+    std::unordered_map<std::string, uint32_t> _tenant_ids;
+    // a deque, as jobs (their PopenConfig) cannot be copied when a vector grows
+    std::deque<Tenant> _tenants;
+    // tenants with jobs queued
+    std::vector<uint32_t> _active;
+    // the tag of the last job started; a tenant becoming active starts here
+    double _vclock{ 0 };
+    size_t _queued{ 0 };
+    JobId _next_id{ 1 };
+    std::unordered_map<Popen*, Running> _running;
+    WaitSet _waits;
+  };
+}  // namespace subprocess
+#endif
@@ -0,0 +1,194 @@
+#ifndef SUBPROCESS_STREAM_BUFFER_POOL_H_
+#define SUBPROCESS_STREAM_BUFFER_POOL_H_
+
+// Header-only, as vendor/fdstream.hpp takes its buffers from here and must
+// stay usable without linking against the library.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace subprocess {
+
+  /**
+   * The read buffers of `Popen`'s input streams (`std_out`, `std_err`).
+   *
+   * Buffers are one page each, page aligned, and carved out of slabs
+   * mapped a few hundred KB at a time. Each thread keeps a free list, so
+   * taking or returning a buffer takes no lock and no allocation. A stream
+   * takes its buffer on its first read and returns it when it is closed,
+   * released or destroyed; a stream that is never read costs none, and
+   * moving a stream (as returning a `Popen` does) no longer copies one.
+   *
+   * Slabs are never unmapped: the pool stays as large as the most buffers
+   * ever in use at once. Buffers beyond the few a thread keeps, and those
+   * freed by a thread that exits, go to a shared list the other threads
+   * draw from before mapping more.
+   */
+  class StreamBufferPool {
+   public:
+    static constexpr size_t buffer_size = 4096;
+
+    struct Options {
+      /// Bytes mapped at a time, carved into buffers.
+      size_t slab_bytes{ 64 * buffer_size };
+      /// Back slabs with huge pages (MAP_HUGETLB), when some are reserved
+      /// (vm.nr_hugepages); slabs are rounded up to 2 MiB then. Falls back
+      /// to normal pages.
+      bool huge_pages{ false };
+    };
+
+    struct Stats {
+      /// Buffers handed out.
+      uint64_t acquired{ 0 };
+      /// Slabs mapped, and how many of them with huge pages.
+      uint64_t slabs{ 0 };
+      uint64_t huge_slabs{ 0 };
+    };
+
+    /// Options for the slabs mapped from now on, by any thread.
+    static void configure(Options options);
+
+    /// A buffer of `buffer_size` bytes. Throws std::bad_alloc if no slab
+    /// can be mapped.
+    static char* acquire();
+
+    /// Give back a buffer from `acquire`, from any thread.
+    static void release(char* buffer);
+
+    /// Counts since the process started, over all threads.
+    static Stats stats();
+  };
+
+  namespace internal {
+    constexpr size_t huge_page_size = 2 * 1024 * 1024;
+    // buffers moved from the shared list at a time
+    constexpr size_t refill_batch = 64;
+    // buffers a thread keeps; past that, a batch goes to the shared list
+    constexpr size_t local_max = 2 * refill_batch;
+
+    struct PoolShared {
+      std::mutex mutex;
+      std::vector<char*> free;
+      StreamBufferPool::Options options;
+      std::atomic<uint64_t> acquired{ 0 };
+      std::atomic<uint64_t> slabs{ 0 };
+      std::atomic<uint64_t> huge_slabs{ 0 };
+    };
+
+    // Never destroyed, so that streams outliving static destruction can
+    // still give their buffers back.
+    inline PoolShared& pool_shared() {
+      static PoolShared* instance = new PoolShared;
+      return *instance;
+    }
+
+    // Trivially destructible, so still readable while the thread's pool is
+    // being destroyed, and after.
+    inline thread_local bool pool_local_gone = false;
+
+    struct PoolLocal {
+      std::vector<char*> free;
+
+      ~PoolLocal() {
+        pool_local_gone = true;
+        auto& s = pool_shared();
+        std::lock_guard<std::mutex> lock{ s.mutex };
+        s.free.insert(s.free.end(), free.begin(), free.end());
+      }
+    };
+
+    inline thread_local PoolLocal pool_local;
+
+    // Map a slab and carve it into `free`.
+    inline void map_slab(std::vector<char*>& free, StreamBufferPool::Options options) {
+      auto& s = pool_shared();
+      size_t bytes = std::max(options.slab_bytes, StreamBufferPool::buffer_size);
+      void* slab = MAP_FAILED;
+      if (options.huge_pages) {
+        bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        slab = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (slab != MAP_FAILED) s.huge_slabs++;
+      }
+      if (slab == MAP_FAILED) {
+        slab = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      }
+      if (slab == MAP_FAILED) throw std::bad_alloc();
+      s.slabs++;
+      size_t count = bytes / StreamBufferPool::buffer_size;
+      free.reserve(free.size() + count);
+      for (size_t i = count; i > 0; i--) {
+        free.push_back(static_cast<char*>(slab) + (i - 1) * StreamBufferPool::buffer_size);
+      }
+    }
+  }  // namespace internal
+
+  inline void StreamBufferPool::configure(Options options) {
+    auto& s = internal::pool_shared();
+    std::lock_guard<std::mutex> lock{ s.mutex };
+    s.options = options;
+  }
+
+  inline char* StreamBufferPool::acquire() {
+    auto& s = internal::pool_shared();
+    auto& local = internal::pool_local;
+    s.acquired.fetch_add(1, std::memory_order_relaxed);
+    if (internal::pool_local_gone) {
+      // a stream read during thread exit
+      std::lock_guard<std::mutex> lock{ s.mutex };
+      if (s.free.empty()) internal::map_slab(s.free, s.options);
+      char* buffer = s.free.back();
+      s.free.pop_back();
+      return buffer;
+    }
+    if (local.free.empty()) {
+      Options options;
+      {
+        std::lock_guard<std::mutex> lock{ s.mutex };
+        size_t n = std::min(internal::refill_batch, s.free.size());
+        local.free.insert(local.free.end(), s.free.end() - static_cast<ptrdiff_t>(n), s.free.end());
+        s.free.resize(s.free.size() - n);
+        options = s.options;
+      }
+      if (local.free.empty()) internal::map_slab(local.free, options);
+    }
+    char* buffer = local.free.back();
+    local.free.pop_back();
+    return buffer;
+  }
+
+  inline void StreamBufferPool::release(char* buffer) {
+    if (buffer == nullptr) return;
+    auto& s = internal::pool_shared();
+    if (internal::pool_local_gone) {
+      std::lock_guard<std::mutex> lock{ s.mutex };
+      s.free.push_back(buffer);
+      return;
+    }
+    auto& local = internal::pool_local;
+    local.free.push_back(buffer);
+    if (local.free.size() > internal::local_max) {
+      // A thread releasing buffers that others acquire would hoard them, and
+      // the others keep mapping slabs. The oldest go, the most recent stay
+      // warm.
+      auto spilled = local.free.begin() + static_cast<ptrdiff_t>(internal::refill_batch);
+      {
+        std::lock_guard<std::mutex> lock{ s.mutex };
+        s.free.insert(s.free.end(), local.free.begin(), spilled);
+      }
+      local.free.erase(local.free.begin(), spilled);
+    }
+  }
+
+  inline StreamBufferPool::Stats StreamBufferPool::stats() {
+    auto& s = internal::pool_shared();
+    return Stats{ s.acquired.load(), s.slabs.load(), s.huge_slabs.load() };
+  }
+}  // namespace subprocess
+#endif
@@ -0,0 +1,100 @@
+#ifndef SUBPROCESS_WAIT_SET_H_
+#define SUBPROCESS_WAIT_SET_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Popen.hpp"
+#include "PopenError.hpp"
+#include "Result.hpp"
+
+struct epoll_event;
+
+namespace subprocess {
+
+  /**
+   * Wait for the first, or all, of many children to finish.
+   *
+   * Unlike `ChildTable` and `ChildIoLoop`, a `WaitSet` does not take the
+   * children over: it watches `Popen` instances that stay where they are,
+   * and reaps them through the `Popen`, which then holds the exit status as
+   * if it had been waited for itself. A `Popen` must not be moved or
+   * destroyed while in a set.
+   *
+   * Each child's exit is watched through a pidfd in one epoll instance, so
+   * a wait costs in proportion to the children that have finished, not to
+   * all those watched. Where no pidfd can be opened (kernels before 5.3, or
+   * out of descriptors) the child is polled instead, with a single
+   * waitid(P_ALL) telling whether any child at all needs reaping before
+   * each round.
+   *
+   * Not thread safe, though other threads may wait on the `Popen`s.
+   */
+  class WaitSet {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    WaitSet();
+    /// Stop watching; the children are left as they are.
+    ~WaitSet();
+    WaitSet(const WaitSet&) = delete;
+    WaitSet& operator=(const WaitSet&) = delete;
+
+    /// Watch `popen` until it is reported finished, or removed.
+    std::optional<PopenError> add(Popen& popen);
+
+    /// Stop watching `popen`, if it is in the set.
+    void remove(Popen& popen);
+
+    /// Children watched and not yet reported finished.
+    size_t size() const { return _slots.size(); }
+
+    /**
+     * Wait until at least one child has finished, or until `deadline`
+     * (forever if nullopt), and reap every child found finished.
+     *
+     * Returns how many were found; they are listed in `finished()` and
+     * leave the set. Returns 0 at the deadline, or at once if the set is
+     * empty.
+     */
+    Result<size_t> wait_any(std::optional<Clock::time_point> deadline = std::nullopt);
+
+    /// Like `wait_any`, but wait until every child has finished, or until
+    /// `deadline`.
+    Result<size_t> wait_all(std::optional<Clock::time_point> deadline = std::nullopt);
+
+    /// The children the last `wait_any` or `wait_all` found finished, in
+    /// the order they were found. Their `exit_status()` is set.
+    const std::vector<Popen*>& finished() const { return _finished; }
+
+   private:
+    struct Entry {
+      Popen* popen{ nullptr };
+      int pidfd{ -1 };
+    };
+
+    // Wait up to `deadline` for some child to finish, and reap all those
+    // that have. Returns how many were added to `_finished`.
+    Result<size_t> collect(std::optional<Clock::time_point> deadline);
+    // Add the child in `slot`, which has been reaped, to `_finished`.
+    void report(uint32_t slot);
+    // Close the child's pidfd and free its slot.
+    void forget(uint32_t slot);
+
+    int _epoll_fd;
+    std::vector<Entry> _entries;
+    std::vector<uint32_t> _free_slots;
+    std::unordered_map<Popen*, uint32_t> _slots;
+    // children without a pidfd, polled
+    std::vector<uint32_t> _polled;
+    // children that had finished before they were added
+    std::vector<uint32_t> _ready;
+    std::vector<epoll_event> _events;
+    std::vector<Popen*> _finished;
+  };
+}  // namespace subprocess
+#endif
@@ -1,6 +1,8 @@
 #ifndef SUBPROCESS_POSIX_H_
 #define SUBPROCESS_POSIX_H_
 
+#include <atomic>
+#include <stdint.h>
 #include <tuple>
 #include <fcntl.h>
 #include <iostream>
@@ -14,11 +16,50 @@ Result<std::tuple<int, int>> pipe();
 
 void set_inheritable(int fd, bool heritable);
 
+void set_nonblocking(int fd, bool nonblocking);
+
+// Open a pidfd for the process, which becomes readable when it exits.
+// Returns -1 with errno set (ENOSYS on kernels older than 5.3).
+int pidfd_open(pid_t pid);
+
+// Sleep while `word` holds `expected` (or until woken spuriously; callers
+// re-check), and wake every thread sleeping on `word`.
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected);
+void futex_wake_all(std::atomic<uint32_t>& word);
+
+// fork(), but with the child starting in the cgroup open as `cgroup_fd`
+// (clone3() with CLONE_INTO_CGROUP). Returns -1 with errno set to ENOSYS,
+// E2BIG or EINVAL on kernels older than 5.7. Being a raw syscall, it skips
+// what glibc's fork() does for the child: no atfork handlers run, and the
+// malloc and stdio locks are not reset, so the child must not allocate or
+// use stdio before it execs.
+pid_t fork_into_cgroup(int cgroup_fd);
+
+// Move the calling process into the cgroup open as `cgroup_fd`. Safe
+// between fork() and exec(). Returns 0 or an errno value.
+int32_t join_cgroup(int cgroup_fd);
+
 ExitStatus decode_exit_status(int status);
 
 void panic(std::string msg);
 
 int32_t reset_sigpipe();
 
+// Blocks SIGPIPE in the calling thread while alive, so that writing to a
+// pipe whose reader is gone fails with EPIPE rather than killing the
+// process. A SIGPIPE raised meanwhile is taken off the pending set before
+// the mask is restored (unless one was already pending beforehand).
+class SigpipeBlock {
+ public:
+  SigpipeBlock();
+  ~SigpipeBlock();
+  SigpipeBlock(const SigpipeBlock&) = delete;
+  SigpipeBlock& operator=(const SigpipeBlock&) = delete;
+
+ private:
+  bool _was_pending{ false };
+  bool _was_blocked{ false };
+};
+
 }
 #endif
\ No newline at end of file
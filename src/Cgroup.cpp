@@ -0,0 +1,238 @@
+#include "subprocess/Cgroup.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace subprocess;
+
+namespace {
+  // Control files are small; the largest we read is cgroup.procs, which is
+  // read again until empty if it does not fit.
+  constexpr size_t max_file_size = 64 * 1024;
+  constexpr int max_kill_passes = 100;
+
+  std::optional<PopenError> write_file(int dir_fd, const char* name, const std::string& value) {
+    int fd = ::openat(dir_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return PopenError{PopenError::IoError, name, errno};
+    ssize_t n = ::write(fd, value.data(), value.size());
+    int write_errno = errno;
+    ::close(fd);
+    if (n < 0) return PopenError{PopenError::IoError, name, write_errno};
+    return std::nullopt;
+  }
+
+  // The file's contents, or nullopt if it cannot be read.
+  std::optional<std::string> read_file(int dir_fd, const char* name) {
+    int fd = ::openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    std::string contents(max_file_size, '\0');
+    ssize_t n = ::read(fd, contents.data(), contents.size());
+    ::close(fd);
+    if (n < 0) return std::nullopt;
+    contents.resize(static_cast<size_t>(n));
+    return contents;
+  }
+
+  std::optional<uint64_t> read_number(int dir_fd, const char* name) {
+    auto contents = read_file(dir_fd, name);
+    if (!contents.has_value() || contents->empty()) return std::nullopt;
+    return ::strtoull(contents->c_str(), nullptr, 10);
+  }
+
+  // One "key value" line of a flat-keyed file such as cpu.stat.
+  std::optional<uint64_t> keyed_number(const std::string& contents, const std::string& key) {
+    std::istringstream lines{ contents };
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (line.compare(0, key.size() + 1, key + " ") == 0) {
+        return ::strtoull(line.c_str() + key.size() + 1, nullptr, 10);
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::string limit_value(uint64_t value) {
+    return value == UINT64_MAX ? "max" : std::to_string(value);
+  }
+}  // namespace
+
+Cgroup::Cgroup(std::string path, int fd, bool owned)
+: _path{std::move(path)}
+, _fd{fd}
+, _owned{owned}
+{ }
+
+Cgroup::Cgroup(Cgroup&& other)
+: _path{std::move(other._path)}
+, _fd{std::exchange(other._fd, -1)}
+, _owned{std::exchange(other._owned, false)}
+{ }
+
+Cgroup& Cgroup::operator=(Cgroup&& other) {
+  if (this != &other) {
+    close();
+    _path = std::move(other._path);
+    _fd = std::exchange(other._fd, -1);
+    _owned = std::exchange(other._owned, false);
+  }
+  return *this;
+}
+
+Cgroup::~Cgroup() {
+  close();
+}
+
+void Cgroup::close() {
+  // nothing sensible to do with an error from a destructor
+  if (_owned) remove();
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+Result<Cgroup> Cgroup::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return PopenError{PopenError::IoError, "open() cgroup", errno};
+  return Cgroup{ path, fd, false };
+}
+
+Result<Cgroup> Cgroup::create(const std::string& parent, const std::string& name, const CgroupLimits& limits) {
+  if (name.empty() || name.find('/') != std::string::npos) {
+    return PopenError{PopenError::LogicError, "cgroup name must be a single path component"};
+  }
+  int parent_fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (parent_fd < 0) return PopenError{PopenError::IoError, "open() cgroup", errno};
+
+  // Enable only what is missing: writing a controller that is already on
+  // is harmless, but needs permissions a delegated subtree may not have.
+  auto enabled = read_file(parent_fd, "cgroup.subtree_control").value_or("");
+  auto has = [&](const std::string& controller) {
+    std::istringstream words{ enabled };
+    std::string word;
+    while (words >> word) {
+      if (word == controller) return true;
+    }
+    return false;
+  };
+  std::string wanted;
+  if (limits.memory_max.has_value() && !has("memory")) wanted += " +memory";
+  if (limits.cpu_max.has_value() && !has("cpu")) wanted += " +cpu";
+  if (limits.pids_max.has_value() && !has("pids")) wanted += " +pids";
+  // a failure shows up below, as the limit's control file missing
+  if (!wanted.empty()) write_file(parent_fd, "cgroup.subtree_control", wanted.substr(1));
+
+  if (::mkdirat(parent_fd, name.c_str(), 0755) != 0) {
+    int mkdir_errno = errno;
+    ::close(parent_fd);
+    return PopenError{PopenError::IoError, "mkdir() cgroup", mkdir_errno};
+  }
+  int fd = ::openat(parent_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  int open_errno = errno;
+  if (fd < 0) ::unlinkat(parent_fd, name.c_str(), AT_REMOVEDIR);
+  ::close(parent_fd);
+  if (fd < 0) return PopenError{PopenError::IoError, "open() cgroup", open_errno};
+
+  std::string path = parent;
+  if (path.empty() || path.back() != '/') path += '/';
+  Cgroup cgroup{ path + name, fd, true };
+  // on error the cgroup removes itself
+  if (auto err = cgroup.set_limits(limits)) return *err;
+  return Result<Cgroup>{ std::move(cgroup) };
+}
+
+std::optional<std::string> Cgroup::self() {
+  // "0::/path" is the cgroup v2 entry
+  std::ifstream cgroups{ "/proc/self/cgroup" };
+  std::string line, relative;
+  bool found = false;
+  while (std::getline(cgroups, line)) {
+    if (line.compare(0, 3, "0::") == 0) {
+      relative = line.substr(3);
+      found = true;
+      break;
+    }
+  }
+  if (!found) return std::nullopt;
+
+  // mountinfo: id parent dev root mountpoint options [optional...] - fstype ...
+  std::ifstream mounts{ "/proc/self/mountinfo" };
+  while (std::getline(mounts, line)) {
+    auto sep = line.find(" - ");
+    if (sep == std::string::npos || line.compare(sep + 3, 8, "cgroup2 ") != 0) continue;
+    std::istringstream fields{ line.substr(0, sep) };
+    std::string field, mountpoint;
+    for (int i = 0; i < 5 && fields >> field; i++) mountpoint = field;
+    if (relative == "/") return mountpoint;
+    return mountpoint + relative;
+  }
+  return std::nullopt;
+}
+
+std::optional<PopenError> Cgroup::set_limits(const CgroupLimits& limits) {
+  if (limits.memory_max.has_value()) {
+    if (auto err = write_file(_fd, "memory.max", limit_value(*limits.memory_max))) return err;
+  }
+  if (limits.cpu_max.has_value()) {
+    auto value = limit_value(limits.cpu_max->quota_us) + " " + std::to_string(limits.cpu_max->period_us);
+    if (auto err = write_file(_fd, "cpu.max", value)) return err;
+  }
+  if (limits.pids_max.has_value()) {
+    if (auto err = write_file(_fd, "pids.max", limit_value(*limits.pids_max))) return err;
+  }
+  return std::nullopt;
+}
+
+Result<CgroupStats> Cgroup::stats() const {
+  if (_fd < 0) return PopenError{PopenError::LogicError, "cgroup is closed"};
+  CgroupStats stats{};
+  stats.memory_current = read_number(_fd, "memory.current");
+  stats.memory_peak = read_number(_fd, "memory.peak");
+  stats.pids_current = read_number(_fd, "pids.current");
+  auto cpu = read_file(_fd, "cpu.stat");
+  if (!cpu.has_value()) return PopenError{PopenError::IoError, "cpu.stat", errno};
+  stats.cpu_usage_usec = keyed_number(*cpu, "usage_usec");
+  stats.cpu_user_usec = keyed_number(*cpu, "user_usec");
+  stats.cpu_system_usec = keyed_number(*cpu, "system_usec");
+  return stats;
+}
+
+std::optional<PopenError> Cgroup::kill() {
+  auto err = write_file(_fd, "cgroup.kill", "1");
+  if (!err.has_value() || err->errnum != ENOENT) return err;
+
+  // No cgroup.kill: a process may fork between reading the list and
+  // killing it, so go again until the cgroup is empty.
+  for (int pass = 0; pass < max_kill_passes; pass++) {
+    auto procs = read_file(_fd, "cgroup.procs");
+    if (!procs.has_value()) return PopenError{PopenError::IoError, "cgroup.procs", errno};
+    if (procs->empty()) return std::nullopt;
+    err = signal(SIGKILL);
+    if (err.has_value()) return err;
+  }
+  return PopenError{PopenError::IoError, "cgroup.procs", EAGAIN};
+}
+
+std::optional<PopenError> Cgroup::signal(int signo) {
+  auto procs = read_file(_fd, "cgroup.procs");
+  if (!procs.has_value()) return PopenError{PopenError::IoError, "cgroup.procs", errno};
+  std::istringstream pids{ *procs };
+  pid_t pid;
+  while (pids >> pid) ::kill(pid, signo);
+  return std::nullopt;
+}
+
+std::optional<PopenError> Cgroup::remove() {
+  _owned = false;
+  if (::rmdir(_path.c_str()) != 0) return PopenError{PopenError::IoError, "rmdir() cgroup", errno};
+  return std::nullopt;
+}
@@ -0,0 +1,285 @@
+#include "subprocess/ChildIoLoop.hpp"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "subprocess/posix.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  // how often children without a pidfd are polled for exit once their
+  // pipes have closed
+  constexpr auto unwatched_exit_poll = 10ms;
+}
+
+ChildIoLoop::ChildIoLoop(Handlers handlers)
+: ChildIoLoop(std::move(handlers), Options{})
+{ }
+
+ChildIoLoop::ChildIoLoop(Handlers handlers, Options options)
+: _handlers{std::move(handlers)}
+, _options{options}
+, _epoll_fd{::epoll_create1(EPOLL_CLOEXEC)}
+, _read_buf(options.read_chunk)
+, _events(static_cast<size_t>(std::max(options.max_events, 1)))
+{
+  if (_epoll_fd < 0) panic("epoll_create1() failed");
+}
+
+ChildIoLoop::~ChildIoLoop() {
+  // Children still running are reaped in the destructor, as a `Popen`
+  // would: close their pipes so they see EOF/SIGPIPE, then wait.
+  for (uint32_t slot = 0; slot < _children.size(); slot++) {
+    Child& child = _children[slot];
+    if (child.pid < 0) continue;
+    for (auto stream : { Stream::In, Stream::Out, Stream::Err, Stream::Exit }) {
+      close_stream(slot, stream);
+    }
+    if (!child.exited) reap(slot, true);
+  }
+  ::close(_epoll_fd);
+}
+
+ChildIoLoop::Id ChildIoLoop::id_of(uint32_t slot) const {
+  return (static_cast<Id>(_children[slot].generation) << 32) | slot;
+}
+
+ChildIoLoop::Child* ChildIoLoop::lookup(Id id) {
+  auto slot = static_cast<uint32_t>(id & 0xffffffff);
+  auto generation = static_cast<uint32_t>(id >> 32);
+  if (slot >= _children.size()) return nullptr;
+  Child& child = _children[slot];
+  if (child.pid < 0 || child.generation != generation) return nullptr;
+  return &child;
+}
+
+void ChildIoLoop::watch(uint32_t slot, Stream stream, int fd, uint32_t events) {
+  struct epoll_event ev = {};
+  ev.events = events;
+  ev.data.u64 = (static_cast<uint64_t>(slot) << 2) | static_cast<uint64_t>(stream);
+  if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    ::epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  }
+}
+
+void ChildIoLoop::close_stream(uint32_t slot, Stream stream) {
+  Child& child = _children[slot];
+  int& fd = stream == Stream::Exit ? child.pidfd : child.fds[static_cast<int>(stream)];
+  if (fd < 0) return;
+  ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  fd = -1;
+  if (stream == Stream::In) child.pending_input.clear();
+}
+
+Result<ChildIoLoop::Id> ChildIoLoop::add(Popen&& popen) {
+  auto pid = popen.pid();
+  if (!pid.has_value()) {
+    return PopenError{PopenError::LogicError, "ChildIoLoop::add: child is not running"};
+  }
+
+  uint32_t slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(_children.size());
+    _children.emplace_back();
+  }
+  Child& child = _children[slot];
+  child.pid = *pid;
+  child.exited = false;
+  child.close_stdin_when_drained = false;
+  child.status.reset();
+  child.fds[0] = popen.std_in.has_value() ? popen.std_in->release() : -1;
+  child.fds[1] = popen.std_out.has_value() ? popen.std_out->release() : -1;
+  child.fds[2] = popen.std_err.has_value() ? popen.std_err->release() : -1;
+  popen.detach();
+  _live++;
+
+  for (int i = 0; i < 3; i++) {
+    if (child.fds[i] >= 0) set_nonblocking(child.fds[i], true);
+  }
+  // stdin is only watched for writability while input is pending
+  if (child.fds[0] >= 0) watch(slot, Stream::In, child.fds[0], 0);
+  if (child.fds[1] >= 0) watch(slot, Stream::Out, child.fds[1], EPOLLIN);
+  if (child.fds[2] >= 0) watch(slot, Stream::Err, child.fds[2], EPOLLIN);
+
+  child.pidfd = pidfd_open(child.pid);
+  if (child.pidfd >= 0) {
+    set_inheritable(child.pidfd, false);
+    watch(slot, Stream::Exit, child.pidfd, EPOLLIN);
+  } else if (child.fds[1] < 0 && child.fds[2] < 0) {
+    _unwatched_exits.push_back(slot);
+  }
+  return id_of(slot);
+}
+
+bool ChildIoLoop::write(Id id, const char* data, size_t len) {
+  Child* child = lookup(id);
+  if (child == nullptr || child->fds[0] < 0 || child->close_stdin_when_drained) return false;
+  if (child->pending_input.size() + len > _options.max_pending_input) return false;
+  bool was_empty = child->pending_input.empty();
+  child->pending_input.append(data, len);
+  auto slot = static_cast<uint32_t>(id & 0xffffffff);
+  if (was_empty) watch(slot, Stream::In, child->fds[0], EPOLLOUT);
+  return true;
+}
+
+void ChildIoLoop::close_stdin(Id id) {
+  Child* child = lookup(id);
+  if (child == nullptr) return;
+  auto slot = static_cast<uint32_t>(id & 0xffffffff);
+  if (child->pending_input.empty()) {
+    close_stream(slot, Stream::In);
+  } else {
+    child->close_stdin_when_drained = true;
+  }
+}
+
+size_t ChildIoLoop::size() const {
+  return _live;
+}
+
+void ChildIoLoop::flush_input(uint32_t slot) {
+  Child& child = _children[slot];
+  // a child gone since epoll_wait() makes the write EPIPE, not SIGPIPE
+  SigpipeBlock block_sigpipe;
+  while (!child.pending_input.empty()) {
+    auto n = ::write(child.fds[0], child.pending_input.data(), child.pending_input.size());
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) return;
+      // EPIPE or worse: the child is not going to read any more
+      close_stream(slot, Stream::In);
+      return;
+    }
+    child.pending_input.erase(0, static_cast<size_t>(n));
+  }
+  if (child.close_stdin_when_drained) {
+    close_stream(slot, Stream::In);
+  } else {
+    watch(slot, Stream::In, child.fds[0], 0);
+  }
+}
+
+void ChildIoLoop::reap(uint32_t slot, bool block) {
+  Child& child = _children[slot];
+  int status = 0;
+  pid_t pid;
+  do {
+    pid = ::waitpid(child.pid, &status, block ? 0 : WNOHANG);
+  } while (pid < 0 && errno == EINTR);
+  if (pid == child.pid) {
+    child.status = decode_exit_status(status);
+  } else if (pid < 0) {
+    // someone else reaped it; the status is lost
+    child.status = ExitStatus{ ExitStatus::Undetermined{} };
+  } else {
+    return;
+  }
+  child.exited = true;
+}
+
+void ChildIoLoop::maybe_finish(uint32_t slot) {
+  Child& child = _children[slot];
+  if (!child.exited || child.fds[1] >= 0 || child.fds[2] >= 0) return;
+  close_stream(slot, Stream::In);
+  close_stream(slot, Stream::Exit);
+  Id id = id_of(slot);
+  ExitStatus status = std::move(*child.status);
+  child.pid = -1;
+  child.generation++;
+  child.pending_input = std::string{};
+  _free_slots.push_back(slot);
+  _live--;
+  if (_handlers.on_exit) _handlers.on_exit(id, status);
+}
+
+void ChildIoLoop::handle(uint32_t slot, Stream stream, uint32_t events) {
+  Child& child = _children[slot];
+  if (child.pid < 0) return;
+  Id id = id_of(slot);
+  switch (stream) {
+    case Stream::In:
+      if (child.fds[0] < 0) return;
+      if (events & EPOLLERR) {
+        // the child closed its end of stdin
+        close_stream(slot, Stream::In);
+      } else {
+        flush_input(slot);
+      }
+      return;
+    case Stream::Exit:
+      reap(slot, false);
+      maybe_finish(slot);
+      return;
+    case Stream::Out:
+    case Stream::Err: {
+      int fd = child.fds[static_cast<int>(stream)];
+      if (fd < 0) return;
+      auto n = ::read(fd, _read_buf.data(), _read_buf.size());
+      if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+      if (n <= 0) {
+        close_stream(slot, stream);
+        Child& after = _children[slot];
+        if (after.pidfd < 0 && after.fds[1] < 0 && after.fds[2] < 0) {
+          _unwatched_exits.push_back(slot);
+        }
+        maybe_finish(slot);
+        return;
+      }
+      auto& handler = stream == Stream::Out ? _handlers.on_stdout : _handlers.on_stderr;
+      if (handler) handler(id, _read_buf.data(), static_cast<size_t>(n));
+      return;
+    }
+  }
+}
+
+Result<size_t> ChildIoLoop::run_once(std::optional<std::chrono::milliseconds> timeout) {
+  int timeout_ms = timeout.has_value() ? static_cast<int>(timeout->count()) : -1;
+  if (!_unwatched_exits.empty()) {
+    auto poll_ms = static_cast<int>(unwatched_exit_poll.count());
+    timeout_ms = timeout_ms < 0 ? poll_ms : std::min(timeout_ms, poll_ms);
+  }
+
+  int n = ::epoll_wait(_epoll_fd, _events.data(), static_cast<int>(_events.size()), timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR) return size_t{ 0 };
+    return PopenError{PopenError::IoError, "epoll_wait()", errno};
+  }
+  for (int i = 0; i < n; i++) {
+    const auto& ev = _events[static_cast<size_t>(i)];
+    handle(static_cast<uint32_t>(ev.data.u64 >> 2), static_cast<Stream>(ev.data.u64 & 3), ev.events);
+  }
+
+  size_t handled = static_cast<size_t>(n);
+  if (!_unwatched_exits.empty()) {
+    auto pending = std::move(_unwatched_exits);
+    _unwatched_exits.clear();
+    for (auto slot : pending) {
+      reap(slot, false);
+      if (_children[slot].exited) {
+        maybe_finish(slot);
+        handled++;
+      } else {
+        _unwatched_exits.push_back(slot);
+      }
+    }
+  }
+  return handled;
+}
+
+std::optional<PopenError> ChildIoLoop::run() {
+  while (_live > 0) {
+    auto res = run_once(std::nullopt);
+    if (!res.ok()) return res.take_error();
+  }
+  return std::nullopt;
+}
@@ -0,0 +1,188 @@
+#include "subprocess/ChildTable.hpp"
+
+#include <errno.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "subprocess/posix.hpp"
+
+using namespace subprocess;
+
+ChildTable::~ChildTable() {
+  // as a `Popen` would: close the pipes so children see EOF/SIGPIPE, then wait
+  for (uint32_t slot = 0; slot < _states.size(); slot++) {
+    if (_states[slot] == State::Free) continue;
+    close_pipes(slot);
+    if (_states[slot] == State::Running) reap(slot, true);
+  }
+}
+
+ChildTable::Id ChildTable::id_of(uint32_t slot) const {
+  return (static_cast<Id>(_generations[slot]) << 32) | slot;
+}
+
+int64_t ChildTable::slot_of(Id id) const {
+  auto slot = static_cast<uint32_t>(id & 0xffffffff);
+  auto generation = static_cast<uint32_t>(id >> 32);
+  if (slot >= _states.size() || _states[slot] == State::Free || _generations[slot] != generation) return -1;
+  return slot;
+}
+
+Result<ChildTable::Id> ChildTable::add(Popen&& popen) {
+  auto pid = popen.pid();
+  if (!pid.has_value()) {
+    return PopenError{PopenError::LogicError, "ChildTable::add: child is not running"};
+  }
+
+  uint32_t slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(_states.size());
+    _pids.push_back(-1);
+    _pidfds.push_back(-1);
+    _generations.push_back(0);
+    _states.push_back(State::Free);
+    _statuses.push_back(0);
+    _fds.push_back({ -1, -1, -1 });
+  }
+  _pids[slot] = *pid;
+  // without one the child is polled with waitpid() instead
+  _pidfds[slot] = pidfd_open(*pid);
+  _states[slot] = State::Running;
+  _statuses[slot] = 0;
+  _fds[slot] = { popen.std_in.has_value() ? popen.std_in->release() : -1,
+                 popen.std_out.has_value() ? popen.std_out->release() : -1,
+                 popen.std_err.has_value() ? popen.std_err->release() : -1 };
+  popen.detach();
+  _size++;
+  _running++;
+  return id_of(slot);
+}
+
+bool ChildTable::reap(uint32_t slot, bool block) {
+  int status = 0;
+  pid_t pid;
+  do {
+    pid = ::waitpid(_pids[slot], &status, block ? 0 : WNOHANG);
+  } while (pid < 0 && errno == EINTR);
+  if (pid == 0) return false;
+  // pid < 0: someone else reaped it; the status is lost
+  _statuses[slot] = pid == _pids[slot] ? status : -1;
+  _states[slot] = State::Exited;
+  _running--;
+  if (_pidfds[slot] >= 0) {
+    ::close(_pidfds[slot]);
+    _pidfds[slot] = -1;
+  }
+  return true;
+}
+
+std::vector<ChildTable::Id> ChildTable::reap_exited() {
+  std::vector<Id> exited;
+  _pollfds.clear();
+  _poll_slots.clear();
+  for (uint32_t slot = 0; slot < _states.size(); slot++) {
+    if (_states[slot] != State::Running) continue;
+    if (_pidfds[slot] >= 0) {
+      _pollfds.push_back({ _pidfds[slot], POLLIN, 0 });
+      _poll_slots.push_back(slot);
+    } else if (reap(slot, false)) {
+      exited.push_back(id_of(slot));
+    }
+  }
+  if (_pollfds.empty()) return exited;
+
+  int ready;
+  do {
+    ready = ::poll(_pollfds.data(), _pollfds.size(), 0);
+  } while (ready < 0 && errno == EINTR);
+  for (size_t i = 0; i < _pollfds.size() && ready > 0; i++) {
+    if (_pollfds[i].revents == 0) continue;
+    ready--;
+    if (reap(_poll_slots[i], false)) exited.push_back(id_of(_poll_slots[i]));
+  }
+  return exited;
+}
+
+Result<ExitStatus> ChildTable::wait(Id id) {
+  auto slot = slot_of(id);
+  if (slot < 0) return PopenError{PopenError::LogicError, "ChildTable::wait: no such child"};
+  auto s = static_cast<uint32_t>(slot);
+  if (_states[s] == State::Running) reap(s, true);
+  return *exit_status(id);
+}
+
+void ChildTable::close_pipes(uint32_t slot) {
+  auto streams = _streams.find(slot);
+  if (streams != _streams.end()) {
+    // a stream closed by its user has closed our descriptor too
+    auto& [in, out, err] = streams->second;
+    if (in.has_value()) _fds[slot][0] = in->is_open() ? in->release() : -1;
+    if (out.has_value()) _fds[slot][1] = out->is_open() ? out->release() : -1;
+    if (err.has_value()) _fds[slot][2] = err->is_open() ? err->release() : -1;
+    _streams.erase(streams);
+  }
+  for (int& fd : _fds[slot]) {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+  }
+}
+
+void ChildTable::remove(Id id) {
+  auto slot = slot_of(id);
+  if (slot < 0) return;
+  auto s = static_cast<uint32_t>(slot);
+  close_pipes(s);
+  if (_states[s] == State::Running) reap(s, true);
+  _states[s] = State::Free;
+  _pids[s] = -1;
+  _generations[s]++;
+  _free_slots.push_back(s);
+  _size--;
+}
+
+std::optional<pid_t> ChildTable::pid(Id id) const {
+  auto slot = slot_of(id);
+  if (slot < 0) return std::nullopt;
+  return _pids[static_cast<uint32_t>(slot)];
+}
+
+std::optional<ExitStatus> ChildTable::exit_status(Id id) const {
+  auto slot = slot_of(id);
+  if (slot < 0 || _states[static_cast<uint32_t>(slot)] != State::Exited) return std::nullopt;
+  int status = _statuses[static_cast<uint32_t>(slot)];
+  if (status < 0) return ExitStatus{ ExitStatus::Undetermined{} };
+  return decode_exit_status(status);
+}
+
+int ChildTable::fd(Id id, int stream) const {
+  auto slot = slot_of(id);
+  if (slot < 0 || stream < 0 || stream > 2) return -1;
+  return _fds[static_cast<uint32_t>(slot)][static_cast<size_t>(stream)];
+}
+
+boost::fdostream* ChildTable::std_in(Id id) {
+  int fd_in = fd(id, 0);
+  if (fd_in < 0) return nullptr;
+  auto& stream = _streams[static_cast<uint32_t>(id & 0xffffffff)].in;
+  if (!stream.has_value()) stream.emplace(fd_in);
+  return &*stream;
+}
+
+boost::fdistream* ChildTable::std_out(Id id) {
+  int fd_out = fd(id, 1);
+  if (fd_out < 0) return nullptr;
+  auto& stream = _streams[static_cast<uint32_t>(id & 0xffffffff)].out;
+  if (!stream.has_value()) stream.emplace(fd_out);
+  return &*stream;
+}
+
+boost::fdistream* ChildTable::std_err(Id id) {
+  int fd_err = fd(id, 2);
+  if (fd_err < 0) return nullptr;
+  auto& stream = _streams[static_cast<uint32_t>(id & 0xffffffff)].err;
+  if (!stream.has_value()) stream.emplace(fd_err);
+  return &*stream;
+}
@@ -0,0 +1,266 @@
+#include "subprocess/DeadlineManager.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "subprocess/posix.hpp"
+
+using namespace subprocess;
+
+namespace {
+  constexpr uint64_t max_tick = (uint64_t{ 1 } << 48) - 1;
+  constexpr uint16_t unlinked = UINT16_MAX;
+}
+
+DeadlineManager::DeadlineManager()
+: DeadlineManager(Options{})
+{ }
+
+DeadlineManager::DeadlineManager(Options options)
+: _epoch{Clock::now()}
+, _resolution{std::max<int64_t>(options.resolution.count(), 1)}
+, _timer_fd{::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)}
+{
+  if (_timer_fd < 0) panic("timerfd_create() failed");
+  _heads.fill(none);
+}
+
+DeadlineManager::~DeadlineManager() {
+  ::close(_timer_fd);
+}
+
+DeadlineManager::Id DeadlineManager::id_of(uint32_t slot) const {
+  return (static_cast<Id>(_timers[slot].generation) << 32) | slot;
+}
+
+uint32_t DeadlineManager::slot_of(Id id) const {
+  auto slot = static_cast<uint32_t>(id & 0xffffffff);
+  auto generation = static_cast<uint32_t>(id >> 32);
+  if (slot >= _timers.size() || _timers[slot].kind == Kind::Free || _timers[slot].generation != generation) {
+    return none;
+  }
+  return slot;
+}
+
+uint64_t DeadlineManager::tick_at(Clock::time_point time, bool round_up) const {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time - _epoch).count();
+  if (ns <= 0) return 0;
+  auto ticks = static_cast<uint64_t>(round_up ? (ns - 1) / _resolution + 1 : ns / _resolution);
+  // so that arm() can still express it in nanoseconds
+  return std::min({ ticks, max_tick, static_cast<uint64_t>(INT64_MAX / 2 / _resolution) });
+}
+
+DeadlineManager::Id DeadlineManager::add(Popen& popen, Clock::time_point deadline, Action action) {
+  uint32_t slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(_timers.size());
+    _timers.emplace_back();
+  }
+  Timer& timer = _timers[slot];
+  timer.popen = &popen;
+  if (auto* signal = std::get_if<Signal>(&action)) {
+    timer.kind = Kind::Signal;
+    timer.arg = static_cast<uint32_t>(signal->signo);
+  } else if (auto* terminate = std::get_if<Terminate>(&action)) {
+    timer.kind = Kind::Terminate;
+    auto grace = std::chrono::duration_cast<std::chrono::nanoseconds>(terminate->grace).count();
+    auto ticks = std::max<int64_t>(grace, 0) / _resolution + 1;
+    timer.arg = static_cast<uint32_t>(std::min<int64_t>(ticks, UINT32_MAX));
+  } else {
+    timer.kind = Kind::Callback;
+    _callbacks[slot] = std::move(std::get<Callback>(action).fn);
+  }
+  _size++;
+  schedule(slot, tick_at(deadline, true));
+  arm();
+  return id_of(slot);
+}
+
+bool DeadlineManager::cancel(Id id) {
+  uint32_t slot = slot_of(id);
+  if (slot == none) return false;
+  unlink(slot);
+  release(slot);
+  return true;
+}
+
+void DeadlineManager::schedule(uint32_t slot, uint64_t expires) {
+  _timers[slot].expires = std::min(std::max(expires, _now + 1), max_tick);
+  link(slot);
+}
+
+void DeadlineManager::link(uint32_t slot) {
+  Timer& timer = _timers[slot];
+  // The level is that of the highest bit in which `expires` and `_now`
+  // differ: the bucket index is then above `_now`'s at that level, so the
+  // bucket comes due, and cascades, before `expires`.
+  auto level = static_cast<unsigned>(63 - __builtin_clzll(timer.expires ^ _now)) / level_bits;
+  auto index = static_cast<uint32_t>(timer.expires >> (level * level_bits)) & (buckets - 1);
+  auto bucket = level * buckets + index;
+  timer.prev = none;
+  timer.next = _heads[bucket];
+  if (timer.next != none) _timers[timer.next].prev = slot;
+  _heads[bucket] = slot;
+  timer.bucket = static_cast<uint16_t>(bucket);
+  _occupied[level] |= uint64_t{ 1 } << index;
+}
+
+void DeadlineManager::unlink(uint32_t slot) {
+  Timer& timer = _timers[slot];
+  if (timer.bucket == unlinked) return;
+  if (timer.prev != none) {
+    _timers[timer.prev].next = timer.next;
+  } else {
+    _heads[timer.bucket] = timer.next;
+    if (timer.next == none) {
+      _occupied[timer.bucket / buckets] &= ~(uint64_t{ 1 } << (timer.bucket % buckets));
+    }
+  }
+  if (timer.next != none) _timers[timer.next].prev = timer.prev;
+  timer.prev = none;
+  timer.next = none;
+  timer.bucket = unlinked;
+}
+
+uint32_t DeadlineManager::take_bucket(uint32_t bucket) {
+  uint32_t first = _heads[bucket];
+  _heads[bucket] = none;
+  _occupied[bucket / buckets] &= ~(uint64_t{ 1 } << (bucket % buckets));
+  return first;
+}
+
+void DeadlineManager::release(uint32_t slot) {
+  Timer& timer = _timers[slot];
+  if (timer.kind == Kind::Callback) _callbacks.erase(slot);
+  timer.kind = Kind::Free;
+  timer.popen = nullptr;
+  timer.generation++;
+  _free_slots.push_back(slot);
+  _size--;
+}
+
+std::optional<uint64_t> DeadlineManager::next_due() const {
+  std::optional<uint64_t> due;
+  for (unsigned level = 0; level < levels; level++) {
+    unsigned shift = level * level_bits;
+    auto current = static_cast<unsigned>(_now >> shift) & (buckets - 1);
+    // only buckets above the current one are ever filled
+    uint64_t above = current == buckets - 1 ? 0 : ~((uint64_t{ 2 } << current) - 1);
+    uint64_t mask = _occupied[level] & above;
+    if (mask == 0) continue;
+    auto index = static_cast<uint64_t>(__builtin_ctzll(mask));
+    uint64_t round = _now >> (shift + level_bits) << (shift + level_bits);
+    uint64_t at = round | (index << shift);
+    if (!due.has_value() || at < *due) due = at;
+  }
+  return due;
+}
+
+void DeadlineManager::advance(uint64_t target) {
+  while (true) {
+    auto due = next_due();
+    if (!due.has_value() || *due > target) break;
+    uint64_t tick = *due;
+    _now = tick;
+    // higher levels first, so that what they cascade into a bucket due
+    // now is taken with it
+    for (unsigned level = levels; level-- > 0;) {
+      unsigned shift = level * level_bits;
+      if ((tick & ((uint64_t{ 1 } << shift) - 1)) != 0) continue;
+      auto bucket = level * buckets + (static_cast<uint32_t>(tick >> shift) & (buckets - 1));
+      for (uint32_t slot = take_bucket(bucket); slot != none;) {
+        Timer& timer = _timers[slot];
+        uint32_t next = timer.next;
+        timer.prev = none;
+        timer.next = none;
+        timer.bucket = unlinked;
+        if (timer.expires <= tick) {
+          _due.push_back(id_of(slot));
+        } else {
+          link(slot);
+        }
+        slot = next;
+      }
+    }
+  }
+  _now = std::max(_now, target);
+}
+
+void DeadlineManager::arm() {
+  auto due = next_due();
+  if (due == _armed) return;
+  struct itimerspec spec = {};
+  if (due.has_value()) {
+    auto at = _epoch + std::chrono::nanoseconds(static_cast<int64_t>(*due) * _resolution);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  // all zero disarms it
+  ::timerfd_settime(_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+  _armed = due;
+}
+
+size_t DeadlineManager::expire() {
+  uint64_t expirations;
+  // EAGAIN if it has not fired: then nothing is due, unless the caller
+  // slept past a deadline some other way
+  if (::read(_timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) _armed.reset();
+  advance(tick_at(Clock::now(), false));
+
+  // an action may add or cancel deadlines, or even expire() again
+  auto due = std::move(_due);
+  _due.clear();
+  size_t ran = 0;
+  for (Id id : due) {
+    uint32_t slot = slot_of(id);
+    if (slot == none) continue;
+    Popen& popen = *_timers[slot].popen;
+    ran++;
+    switch (_timers[slot].kind) {
+      case Kind::Signal: {
+        auto signo = static_cast<int>(_timers[slot].arg);
+        release(slot);
+        popen.signal_tree(signo);
+        break;
+      }
+      case Kind::Terminate:
+        popen.signal_tree(SIGTERM);
+        // the same id, so that cancelling it spares the child
+        _timers[slot].kind = Kind::Kill;
+        schedule(slot, _now + _timers[slot].arg);
+        break;
+      case Kind::Kill:
+        release(slot);
+        popen.signal_tree(SIGKILL);
+        break;
+      case Kind::Callback: {
+        auto fn = std::move(_callbacks[slot]);
+        release(slot);
+        fn(popen);
+        break;
+      }
+      case Kind::Free:
+        break;
+    }
+  }
+  due.clear();
+  if (_due.empty()) _due = std::move(due);
+  arm();
+  return ran;
+}
+
+Result<size_t> DeadlineManager::run_once(std::optional<std::chrono::milliseconds> timeout) {
+  struct pollfd pfd = { _timer_fd, POLLIN, 0 };
+  int n = ::poll(&pfd, 1, timeout.has_value() ? static_cast<int>(timeout->count()) : -1);
+  if (n < 0 && errno != EINTR) return PopenError{PopenError::IoError, "poll()", errno};
+  return expire();
+}
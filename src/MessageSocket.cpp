@@ -0,0 +1,166 @@
+#include "subprocess/MessageSocket.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "subprocess/PopenError.hpp"
+
+using namespace subprocess;
+
+namespace {
+  // Largest number of descriptors accepted with one message.
+  constexpr size_t max_fds = 64;
+
+  // Run `op` until it transfers something, retrying EINTR and, with a
+  // deadline, waiting for `events` while the socket would block.
+  template<typename Op>
+  boost::io_result transfer(int fd, short events, std::optional<boost::deadline> until, Op op) {
+    while (true) {
+      ssize_t n = op();
+      if (n >= 0) return { boost::io_status::ok, static_cast<size_t>(n), 0 };
+      if (errno == EINTR) continue;
+      if (errno == EPIPE || errno == ECONNRESET) return { boost::io_status::eof, 0, 0 };
+      if (!boost::detail::is_would_block(errno)) return { boost::io_status::error, 0, errno };
+      if (!until.has_value()) return { boost::io_status::would_block, 0, 0 };
+      int ready = boost::detail::wait_fd(fd, events, *until);
+      if (ready == 0) return { boost::io_status::timed_out, 0, 0 };
+      if (ready < 0) return { boost::io_status::error, 0, errno };
+    }
+  }
+
+  // Take the descriptors out of a received message's control data.
+  void collect_fds(struct msghdr& msg, std::vector<int>* fds) {
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+      size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < count; i++) {
+        int fd;
+        ::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        if (fds != nullptr) {
+          fds->push_back(fd);
+        } else {
+          ::close(fd);
+        }
+      }
+    }
+  }
+}  // namespace
+
+MessageSocket::MessageSocket(int fd)
+: _fd{fd}
+{ }
+
+MessageSocket::MessageSocket(MessageSocket&& other)
+: _fd{other.release()}
+{ }
+
+MessageSocket& MessageSocket::operator=(MessageSocket&& other) {
+  if (this != &other) {
+    close();
+    _fd = other.release();
+  }
+  return *this;
+}
+
+MessageSocket::~MessageSocket() {
+  close();
+}
+
+Result<std::pair<MessageSocket, MessageSocket>> MessageSocket::pair(int type) {
+  int fds[2];
+  if (::socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, fds) != 0) {
+    return PopenError{PopenError::IoError, "socketpair()", errno};
+  }
+  return std::make_pair(MessageSocket{ fds[0] }, MessageSocket{ fds[1] });
+}
+
+void MessageSocket::close() {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+void MessageSocket::shutdown_write() {
+  if (_fd >= 0) ::shutdown(_fd, SHUT_WR);
+}
+
+boost::io_result MessageSocket::send(const char* data, size_t len, const std::vector<int>& fds,
+                                     std::optional<boost::deadline> until) {
+  if (fds.size() > max_fds) return { boost::io_status::error, 0, EINVAL };
+  struct iovec iov = { const_cast<char*>(data), len };
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  alignas(struct cmsghdr) char control[CMSG_SPACE(max_fds * sizeof(int))];
+  if (!fds.empty()) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+    ::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+  }
+  return transfer(_fd, POLLOUT, until, [&] { return ::sendmsg(_fd, &msg, MSG_NOSIGNAL); });
+}
+
+boost::io_result MessageSocket::recv(char* buf, size_t len, std::vector<int>* fds,
+                                     std::optional<boost::deadline> until) {
+  struct iovec iov = { buf, len };
+  struct msghdr msg = {};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(max_fds * sizeof(int))];
+  auto res = transfer(_fd, POLLIN, until, [&] {
+    msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    return ::recvmsg(_fd, &msg, MSG_CMSG_CLOEXEC);
+  });
+  if (res.status != boost::io_status::ok) return res;
+  collect_fds(msg, fds);
+  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) return { boost::io_status::error, res.count, EMSGSIZE };
+  if (res.count == 0 && len > 0) return { boost::io_status::eof, 0, 0 };
+  return res;
+}
+
+boost::io_result MessageSocket::send_batch(const std::vector<std::string_view>& messages,
+                                           std::optional<boost::deadline> until) {
+  if (messages.empty()) return { boost::io_status::ok, 0, 0 };
+  std::vector<struct iovec> iovs(messages.size());
+  std::vector<struct mmsghdr> headers(messages.size());
+  for (size_t i = 0; i < messages.size(); i++) {
+    iovs[i] = { const_cast<char*>(messages[i].data()), messages[i].size() };
+    headers[i].msg_hdr.msg_iov = &iovs[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+  return transfer(_fd, POLLOUT, until, [&] {
+    return ::sendmmsg(_fd, headers.data(), static_cast<unsigned>(headers.size()), MSG_NOSIGNAL);
+  });
+}
+
+boost::io_result MessageSocket::recv_batch(std::vector<std::string>& out, size_t max_messages, size_t max_size,
+                                           std::optional<boost::deadline> until) {
+  if (max_messages == 0) return { boost::io_status::ok, 0, 0 };
+  std::vector<char> storage(max_messages * max_size);
+  std::vector<struct iovec> iovs(max_messages);
+  std::vector<struct mmsghdr> headers(max_messages);
+  for (size_t i = 0; i < max_messages; i++) {
+    iovs[i] = { storage.data() + i * max_size, max_size };
+    headers[i].msg_hdr.msg_iov = &iovs[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+  auto res = transfer(_fd, POLLIN, until, [&] {
+    return ::recvmmsg(_fd, headers.data(), static_cast<unsigned>(max_messages), MSG_WAITFORONE, nullptr);
+  });
+  if (res.status != boost::io_status::ok) return res;
+  for (size_t i = 0; i < res.count; i++) {
+    if (headers[i].msg_len == 0) return { boost::io_status::eof, i, 0 };
+    if (headers[i].msg_hdr.msg_flags & MSG_TRUNC) return { boost::io_status::error, i, EMSGSIZE };
+    out.emplace_back(storage.data() + i * max_size, headers[i].msg_len);
+  }
+  return res;
+}
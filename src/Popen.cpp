@@ -2,9 +2,15 @@
 #include "subprocess/posix.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <thread>
@@ -14,24 +20,141 @@ using namespace subprocess;
 using namespace std::chrono_literals;
 
 Result<Popen> Popen::create(const std::vector<std::string>& argv, const PopenConfig& cfg) {
+  return create(argv, cfg, nullptr);
+}
+
+Result<Popen> Popen::create(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                            SharedSpawn* shared) {
+  return create(argv, cfg, shared, StdLayout{ cfg.stdin, cfg.stdout, cfg.stderr });
+}
+
+Result<Popen> Popen::create(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                            SharedSpawn* shared, const StdLayout& layout) {
   if (argv.size() == 0) {
     return PopenError{PopenError::LogicError, "argv must not be empty"};
   }
   Popen inst{ ChildState::Preparing(), cfg.detached };
-  auto res = inst.os_start(argv, cfg);
+  auto res = inst.os_start(argv, cfg, shared, layout);
   if (res.has_value()) {
     return *res;
   }
   return Result<Popen>{std::move(inst)};
 }
 
+Popen::Popen(ChildState&& state, bool _detached)
+: child_state{std::move(state)}
+, detached{_detached}
+{ }
+
+Popen::SpawnScratch& Popen::scratch() {
+  thread_local SpawnScratch spawn_scratch;
+  return spawn_scratch;
+}
+
+Popen::Popen(Popen&& other)
+: child_state{std::move(other.child_state)}
+, detached{other.detached}
+, std_in{std::move(other.std_in)}
+, std_out{std::move(other.std_out)}
+, std_err{std::move(other.std_err)}
+, ring_in{std::move(other.ring_in)}
+, ring_out{std::move(other.ring_out)}
+, ring_err{std::move(other.ring_err)}
+, sock_in{std::move(other.sock_in)}
+, sock_out{std::move(other.sock_out)}
+, sock_err{std::move(other.sock_err)}
+, extra_in{std::move(other.extra_in)}
+, extra_out{std::move(other.extra_out)}
+, extra_sockets{std::move(other.extra_sockets)}
+, cgroup{std::move(other.cgroup)}
+, phase{other.phase.load(std::memory_order_relaxed)}
+, spawned_pid{other.spawned_pid}
+, exec_fail_fd{std::exchange(other.exec_fail_fd, -1)}
+, exec_error{std::move(other.exec_error)}
+, group{other.group}
+, sampler{std::exchange(other.sampler, nullptr)}
+, sample_id{other.sample_id}
+{
+  // the child now belongs to us; the moved-from instance must not wait on it.
+  other.detached = true;
+}
+
+Popen& Popen::operator=(Popen&& other) {
+  if (this != &other) {
+    release();
+    child_state = std::move(other.child_state);
+    detached = other.detached;
+    std_in = std::move(other.std_in);
+    std_out = std::move(other.std_out);
+    std_err = std::move(other.std_err);
+    ring_in = std::move(other.ring_in);
+    ring_out = std::move(other.ring_out);
+    ring_err = std::move(other.ring_err);
+    sock_in = std::move(other.sock_in);
+    sock_out = std::move(other.sock_out);
+    sock_err = std::move(other.sock_err);
+    extra_in = std::move(other.extra_in);
+    extra_out = std::move(other.extra_out);
+    extra_sockets = std::move(other.extra_sockets);
+    cgroup = std::move(other.cgroup);
+    phase.store(other.phase.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    spawned_pid = other.spawned_pid;
+    exec_fail_fd = std::exchange(other.exec_fail_fd, -1);
+    exec_error = std::move(other.exec_error);
+    group = other.group;
+    sampler = std::exchange(other.sampler, nullptr);
+    sample_id = other.sample_id;
+    other.detached = true;
+  }
+  return *this;
+}
+
+Popen::~Popen() {
+  release();
+}
+
+void Popen::release() {
+  close_streams();
+  if (!detached && child_state.is_a<ChildState::Running>()) {
+    // nothing sensible to do with an error from a destructor
+    wait();
+  }
+  if (exec_fail_fd >= 0) {
+    ::close(exec_fail_fd);
+    exec_fail_fd = -1;
+  }
+  if (sampler != nullptr) {
+    sampler->untrack(sample_id);
+    sampler = nullptr;
+  }
+}
+
+void Popen::close_streams() {
+  if (std_in.has_value()) std_in->close();
+  if (std_out.has_value()) std_out->close();
+  if (std_err.has_value()) std_err->close();
+  // as with pipes: the child sees end of file, or that we stopped reading
+  if (ring_in.has_value()) ring_in->close();
+  if (ring_out.has_value()) ring_out->close();
+  if (ring_err.has_value()) ring_err->close();
+  if (sock_in.has_value()) sock_in->close();
+  if (sock_out.has_value()) sock_out->close();
+  if (sock_err.has_value()) sock_err->close();
+  for (auto& [fd, stream] : extra_in) stream.close();
+  for (auto& [fd, stream] : extra_out) stream.close();
+  for (auto& [fd, socket] : extra_sockets) socket.close();
+}
+
+void Popen::detach() {
+  detached = true;
+}
+
 Result<boost::fdostream> prepare_pipe_to_child(int& child_end) {
   auto pi = pipe();
   if (!pi.ok()) return pi.take_error();
   auto [read, write] = pi.take_value();
   int parent_end = write;
   child_end = read;
-  set_inheritable(parent_end, false);
   return std::move(boost::fdostream(parent_end));
 }
 
@@ -41,16 +164,48 @@ Result<boost::fdistream> prepare_pipe_from_child(int& child_end) {
   auto [read, write] = pi.take_value();
   int parent_end = read;
   child_end = write;
-  set_inheritable(parent_end, false);
   return std::move(boost::fdistream(parent_end));
 }
 
+Result<MessageSocket> prepare_socket(const Redirection::Socket& socket, int& child_end) {
+  auto pair = MessageSocket::pair(socket.type);
+  if (!pair.ok()) return pair.take_error();
+  auto [parent_end, child] = pair.take_value();
+  child_end = child.release();
+  return std::move(parent_end);
+}
+
 Result<const std::nullopt_t> prepare_file(int fd, int& child_end) {
-  set_inheritable(fd, true);
-  child_end = fd;
+  // Hand the child our own duplicate, so that closing the child ends
+  // after fork() never closes a descriptor owned by the Redirection.
+  int dup_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd < 0) {
+    return PopenError{PopenError::IoError, "dup()", errno};
+  }
+  child_end = dup_fd;
   return std::nullopt;
 }
 
+void Popen::close_child_ends(const std::vector<ChildFd>& child_fds) {
+  for (const auto& child_fd : child_fds) {
+    if (child_fd.owned) ::close(child_fd.source);
+  }
+}
+
+// The standard streams' part of the child's descriptor map. Descriptors 0,
+// 1 and 2 are inherited from the parent and are never ours to close, and a
+// merged stream shares its end with the other output stream, so each end is
+// owned by at most one entry.
+void Popen::add_std_child_fds(std::tuple<int, int, int> child_ends, std::vector<ChildFd>& child_fds) {
+  int sources[3] = { std::get<0>(child_ends), std::get<1>(child_ends), std::get<2>(child_ends) };
+  for (int target = 0; target < 3; target++) {
+    int source = sources[target];
+    if (source == target) continue;
+    bool first_use = std::find(sources, sources + target, source) == sources + target;
+    child_fds.push_back({ target, source, source > 2 && first_use });
+  }
+}
+
 enum class MergeKind {
   ErrToOut, // 2>&1
   OutToErr, // 1>&2
@@ -62,7 +217,11 @@ Result<std::tuple<int, int, int>> Popen::setup_streams(const Redirection&& stin,
   int child_stdin = 0, child_stdout = 1, child_stderr = 2;
   MergeKind merge = MergeKind::None;
 
-  {
+  if (stin.is_a<Redirection::Socket>()) {
+    auto socket = prepare_socket(stin.get<Redirection::Socket>(), child_stdin);
+    if (!socket.ok()) return socket.take_error();
+    this->sock_in = socket.take_value();
+  } else {
     Result<const std::nullopt_t> res = stin.match(
       [&, this](const Redirection::Pipe&) -> Result<const std::nullopt_t> {
         auto stream = prepare_pipe_to_child(child_stdin);
@@ -79,7 +238,11 @@ Result<std::tuple<int, int, int>> Popen::setup_streams(const Redirection&& stin,
     if (!res.ok()) return res.take_error();
   }
 
-  {
+  if (stout.is_a<Redirection::Socket>()) {
+    auto socket = prepare_socket(stout.get<Redirection::Socket>(), child_stdout);
+    if (!socket.ok()) return socket.take_error();
+    this->sock_out = socket.take_value();
+  } else {
     Result<const std::nullopt_t> res = stout.match(
       [&, this](const Redirection::Pipe&) -> Result<const std::nullopt_t> {
         auto stream = prepare_pipe_from_child(child_stdout);
@@ -94,7 +257,11 @@ Result<std::tuple<int, int, int>> Popen::setup_streams(const Redirection&& stin,
     if (!res.ok()) return res.take_error();
   }
 
-  {
+  if (sterr.is_a<Redirection::Socket>()) {
+    auto socket = prepare_socket(sterr.get<Redirection::Socket>(), child_stderr);
+    if (!socket.ok()) return socket.take_error();
+    this->sock_err = socket.take_value();
+  } else {
     Result<const std::nullopt_t> res = sterr.match(
       [&, this](const Redirection::Pipe&) -> Result<const std::nullopt_t> {
         auto stream = prepare_pipe_from_child(child_stderr);
@@ -109,7 +276,8 @@ Result<std::tuple<int, int, int>> Popen::setup_streams(const Redirection&& stin,
     if (!res.ok()) return res.take_error();
   }
 
-  // TODO: make sure we test these. Do we need to dup() to get a second reference to the same file?
+  // A merged stream shares the other stream's end; dup2() in the child
+  // gives it its own descriptor to the same file.
   if (merge == MergeKind::ErrToOut) {
     child_stderr = child_stdout;
   } else if (merge == MergeKind::OutToErr) {
@@ -119,38 +287,332 @@ Result<std::tuple<int, int, int>> Popen::setup_streams(const Redirection&& stin,
   return std::make_tuple(child_stdin, child_stdout, child_stderr);
 }
 
-std::optional<PopenError> Popen::os_start(const std::vector<std::string>& argv, const PopenConfig& config) {
+std::optional<PopenError> Popen::setup_extra_fds(const std::map<int, Redirection>& extra_fds,
+                                                 std::vector<ChildFd>& child_fds) {
+  for (const auto& [target, redirection] : extra_fds) {
+    if (target <= 2) {
+      return PopenError{PopenError::LogicError, "extra_fds must be above 2; use stdin, stdout and stderr"};
+    }
+    if (redirection.is_a<Redirection::SharedRing>()) {
+      return PopenError{PopenError::LogicError, "Redirection::SharedRing not valid for extra_fds"};
+    }
+    int source = -1;
+    if (redirection.is_a<Redirection::Socket>()) {
+      auto socket = prepare_socket(redirection.get<Redirection::Socket>(), source);
+      if (!socket.ok()) return socket.take_error();
+      extra_sockets.emplace(target, socket.take_value());
+      child_fds.push_back({ target, source, true });
+      continue;
+    }
+    Result<const std::nullopt_t> res = redirection.match(
+      [&, this, target = target](const Redirection::Pipe& pipe) -> Result<const std::nullopt_t> {
+        if (pipe.direction == Redirection::Pipe::Direction::ToChild) {
+          auto stream = prepare_pipe_to_child(source);
+          if (!stream.ok()) return stream.take_error();
+          extra_in.emplace(target, stream.take_value());
+        } else {
+          auto stream = prepare_pipe_from_child(source);
+          if (!stream.ok()) return stream.take_error();
+          extra_out.emplace(target, stream.take_value());
+        }
+        return std::nullopt;
+      },
+      [&](const Redirection::FileDescriptor& file){ return prepare_file(file.fd, source); },
+      [&](const Redirection::Merge&) -> Result<const std::nullopt_t> {
+        return PopenError{PopenError::LogicError, "Redirection::Merge not valid for extra_fds"};
+      },
+      []{ /* leave the descriptor alone */ return std::nullopt; }
+    );
+    if (!res.ok()) return res.take_error();
+    if (source >= 0) child_fds.push_back({ target, source, true });
+  }
+  return std::nullopt;
+}
+
+std::optional<PopenError> Popen::setup_cgroup(const PopenConfig& config) {
+  if (!config.cgroup.has_value()) return std::nullopt;
+  const auto& wanted = *config.cgroup;
+  if (wanted.create_leaf) {
+    static std::atomic<uint64_t> leaves{ 0 };
+    auto name = "subprocess-" + std::to_string(::getpid()) + "-" + std::to_string(leaves++);
+    auto created = Cgroup::create(wanted.path, name, wanted.limits);
+    if (!created.ok()) return created.take_error();
+    cgroup = created.take_value();
+  } else {
+    auto opened = Cgroup::open(wanted.path);
+    if (!opened.ok()) return opened.take_error();
+    cgroup = opened.take_value();
+    if (auto err = cgroup->set_limits(wanted.limits)) return err;
+  }
+  return std::nullopt;
+}
+
+std::optional<PopenError> Popen::setup_rings(const StdLayout& layout, int min_fd) {
+  struct Wanted {
+    const Redirection& redirection;
+    std::optional<RingChannel>& ring;
+    RingChannel::Side side;
+  };
+  for (auto wanted : { Wanted{ layout.in, ring_in, RingChannel::Side::Writer },
+                       Wanted{ layout.out, ring_out, RingChannel::Side::Reader },
+                       Wanted{ layout.err, ring_err, RingChannel::Side::Reader } }) {
+    if (!wanted.redirection.is_a<Redirection::SharedRing>()) continue;
+    auto capacity = wanted.redirection.get<Redirection::SharedRing>().capacity;
+    wanted.ring = RingChannel::create(capacity, wanted.side, min_fd);
+    if (!wanted.ring.has_value()) {
+      return PopenError{PopenError::IoError, "memfd_create()", errno};
+    }
+  }
+  return std::nullopt;
+}
+
+// Whether the child needs an environment of its own rather than ours. Rings
+// add variables naming their descriptors, so they need one too.
+static bool explicit_env(const PopenConfig& config, std::array<int, 3> ring_fds) {
+  return config.env.has_value() ||
+         std::any_of(ring_fds.begin(), ring_fds.end(), [](int fd) { return fd >= 0; });
+}
+
+// Fill in the child's explicit environment.
+static void child_env(const PopenConfig& config, std::array<int, 3> ring_fds, RaggedCstrArray& env) {
+  static const char* const names[3] = { "STDIN", "STDOUT", "STDERR" };
+
+  std::vector<EnvVar> inherited;
+  if (!config.env.has_value()) inherited = PopenConfig::currentEnv();
+  const auto& vars = config.env.has_value() ? *config.env : inherited;
+
+  std::vector<EnvVar> ring_vars;
+  for (size_t i = 0; i < 3; i++) {
+    if (ring_fds[i] >= 0) {
+      ring_vars.emplace_back(std::string{ RingChannel::env_prefix } + names[i], std::to_string(ring_fds[i]));
+    }
+  }
+  auto is_ring_var = [&](const std::string& key) {
+    return std::any_of(ring_vars.begin(), ring_vars.end(), [&](const EnvVar& v) { return v.first == key; });
+  };
+
+  size_t chars = 0;
+  for (const auto& [key, value] : vars) chars += key.size() + 1 + value.size();
+  for (const auto& [key, value] : ring_vars) chars += key.size() + 1 + value.size();
+  env.reserve(vars.size() + ring_vars.size(), chars);
+  for (const auto& [key, value] : vars) {
+    if (!is_ring_var(key)) env.push({ key, "=", value });
+  }
+  for (const auto& [key, value] : ring_vars) env.push({ key, "=", value });
+}
+
+Result<Popen::ChildAttrs> Popen::prepare_attrs(const PopenConfig& config) {
+  ChildAttrs attrs{};
+  if (!config.cpu_affinity.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : config.cpu_affinity) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return PopenError{PopenError::LogicError, "cpu_affinity: CPU number out of range"};
+      }
+      CPU_SET(static_cast<size_t>(cpu), &set);
+    }
+    attrs.affinity = set;
+  }
+  attrs.scheduling = config.scheduling;
+  if (config.nice.has_value() && (*config.nice < -20 || *config.nice > 19)) {
+    return PopenError{PopenError::LogicError, "nice must be between -20 and 19"};
+  }
+  attrs.nice = config.nice;
+  if (config.io_priority.has_value()) {
+    const auto& prio = *config.io_priority;
+    bool idle = prio.io_class == IoPriority::Class::Idle;
+    if (!idle && (prio.level < 0 || prio.level > 7)) {
+      return PopenError{PopenError::LogicError, "io_priority level must be between 0 and 7"};
+    }
+    // IOPRIO_PRIO_VALUE(class, data) from linux/ioprio.h
+    attrs.io_priority = (static_cast<int>(prio.io_class) << 13) | (idle ? 0 : prio.level);
+  }
+  if (config.numa_policy.has_value()) {
+    const auto bits = 8 * sizeof(unsigned long);
+    for (int node : config.numa_policy->nodes) {
+      if (node < 0 || static_cast<size_t>(node) >= ChildAttrs::max_numa_nodes) {
+        return PopenError{PopenError::LogicError, "numa_policy: node number out of range"};
+      }
+      auto n = static_cast<size_t>(node);
+      attrs.numa_nodes[n / bits] |= 1UL << (n % bits);
+    }
+    attrs.numa_mode = static_cast<int>(config.numa_policy->mode);
+  }
+  attrs.rlimits = config.rlimits;
+  return attrs;
+}
+
+int32_t Popen::apply_attrs(const ChildAttrs& attrs) {
+  if (attrs.affinity.has_value()) {
+    if (::sched_setaffinity(0, sizeof(cpu_set_t), &*attrs.affinity) != 0) return errno;
+  }
+  if (attrs.numa_mode.has_value()) {
+    // the kernel reads one bit fewer than maxnode says
+    if (::syscall(SYS_set_mempolicy, *attrs.numa_mode, attrs.numa_nodes.data(),
+                  ChildAttrs::max_numa_nodes + 1) != 0) {
+      return errno;
+    }
+  }
+  if (attrs.scheduling.has_value()) {
+    struct sched_param param = {};
+    param.sched_priority = attrs.scheduling->priority;
+    if (::sched_setscheduler(0, attrs.scheduling->policy, &param) != 0) return errno;
+  }
+  if (attrs.nice.has_value()) {
+    if (::setpriority(PRIO_PROCESS, 0, *attrs.nice) != 0) return errno;
+  }
+  if (attrs.io_priority.has_value()) {
+    // IOPRIO_WHO_PROCESS
+    if (::syscall(SYS_ioprio_set, 1, 0, *attrs.io_priority) != 0) return errno;
+  }
+  for (const auto& limit : attrs.rlimits) {
+    struct rlimit rlim = { limit.soft, limit.hard };
+    if (::setrlimit(limit.resource, &rlim) != 0) return errno;
+  }
+  return 0;
+}
+
+std::vector<Result<Popen>> Popen::create_many(const std::vector<std::vector<std::string>>& argvs,
+                                              const PopenConfig& cfg, size_t threads) {
+  SharedSpawn shared;
+  if (cfg.executable.has_value() || (!argvs.empty() && !argvs[0].empty())) {
+    shared.name = cfg.executable.has_value() ? *cfg.executable : argvs[0][0];
+    shared.path = PrepExec::resolve(shared.name).value_or("");
+  }
+  // with rings, each child's environment names its own descriptors
+  bool rings = cfg.stdin.is_a<Redirection::SharedRing>() || cfg.stdout.is_a<Redirection::SharedRing>() ||
+               cfg.stderr.is_a<Redirection::SharedRing>();
+  if (cfg.env.has_value() && !rings) {
+    shared.env.emplace();
+    child_env(cfg, { -1, -1, -1 }, *shared.env);
+  }
+
+  std::vector<Result<Popen>> results;
+  results.reserve(argvs.size());
+  for (size_t i = 0; i < argvs.size(); i++) results.emplace_back(PopenError{PopenError::LogicError, "not spawned"});
+  threads = std::max<size_t>(1, std::min(threads, argvs.size()));
+  // each thread spawns every threads-th child, with its own scratch
+  auto spawn_from = [&](size_t first) {
+    for (size_t i = first; i < argvs.size(); i += threads) results[i] = create(argvs[i], cfg, &shared);
+  };
+  std::vector<std::thread> helpers;
+  helpers.reserve(threads - 1);
+  for (size_t t = 1; t < threads; t++) helpers.emplace_back(spawn_from, t);
+  spawn_from(0);
+  for (auto& helper : helpers) helper.join();
+  return results;
+}
+
+std::optional<PopenError> Popen::os_start(const std::vector<std::string>& argv, const PopenConfig& config,
+                                          SharedSpawn* shared, const StdLayout& layout) {
   auto exec_fail_pipeR = pipe();
   if (!exec_fail_pipeR.ok()) return exec_fail_pipeR.take_error();
   auto exec_fail_pipe = exec_fail_pipeR.take_value();
-  set_inheritable(std::get<0>(exec_fail_pipe), false);
-  set_inheritable(std::get<1>(exec_fail_pipe), false);
   {
-    auto child_endsR = setup_streams(std::move(config.stdin), std::move(config.stdout), std::move(config.stderr));
-    if (!child_endsR.ok()) return child_endsR.take_error();
+    auto child_endsR = setup_streams(std::move(layout.in), std::move(layout.out), std::move(layout.err));
+    if (!child_endsR.ok()) {
+      ::close(std::get<0>(exec_fail_pipe));
+      ::close(std::get<1>(exec_fail_pipe));
+      return child_endsR.take_error();
+    }
+    // Everything the child gets besides what it inherits as is: the
+    // standard streams, extra_fds, and rings. Rings keep their own numbers,
+    // so they are put above every other target.
+    auto& spawn = scratch();
+    auto& child_fds = spawn.child_fds;
+    child_fds.clear();
+    int max_target = config.extra_fds.empty() ? 2 : std::max(2, config.extra_fds.rbegin()->first);
+    size_t rings = 0;
+    for (const auto* r : { &layout.in, &layout.out, &layout.err }) {
+      rings += r->is_a<Redirection::SharedRing>();
+    }
     auto child_ends = child_endsR.take_value();
-    std::optional<std::vector<std::string>> childEnv;
-    if (config.env.has_value()) {
-      childEnv.emplace(std::vector<std::string>(config.env->size()));
-      std::transform(
-        config.env->begin(), config.env->end(),
-        std::back_inserter(*childEnv),
-        [](const EnvVar& ev) {
-          return ev.first + "=" + ev.second;
-        });
-    }
-    std::string cmd_to_exec = config.executable.value_or(argv[0]);
-    PrepExec preparedExec(cmd_to_exec, argv, childEnv);
-
-    pid_t child_pid = ::fork();
+    // one allocation at most, none once this thread has spawned a child
+    // with as many, and none when the child inherits everything
+    size_t wanted = 3 + config.extra_fds.size() + rings;
+    if (wanted > 3 || child_ends != std::make_tuple(0, 1, 2)) child_fds.reserve(wanted);
+    add_std_child_fds(child_ends, child_fds);
+    auto attrsR = prepare_attrs(config);
+    if (!attrsR.ok()) {
+      close_child_ends(child_fds);
+      ::close(std::get<0>(exec_fail_pipe));
+      ::close(std::get<1>(exec_fail_pipe));
+      return attrsR.take_error();
+    }
+    auto attrs = attrsR.take_value();
+    auto err = setup_extra_fds(config.extra_fds, child_fds);
+    if (!err.has_value()) err = setup_rings(layout, max_target + 1);
+    if (!err.has_value()) err = setup_cgroup(config);
+    if (err.has_value()) {
+      close_child_ends(child_fds);
+      ::close(std::get<0>(exec_fail_pipe));
+      ::close(std::get<1>(exec_fail_pipe));
+      return err;
+    }
+    for (const auto* ring : { &ring_in, &ring_out, &ring_err }) {
+      if (ring->has_value()) child_fds.push_back({ (*ring)->fd(), (*ring)->fd(), false });
+    }
+    if (config.nonblocking) {
+      if (std_in.has_value()) set_nonblocking(std_in->fd(), true);
+      if (std_out.has_value()) set_nonblocking(std_out->fd(), true);
+      if (std_err.has_value()) set_nonblocking(std_err->fd(), true);
+      if (sock_in.has_value()) set_nonblocking(sock_in->fd(), true);
+      if (sock_out.has_value()) set_nonblocking(sock_out->fd(), true);
+      if (sock_err.has_value()) set_nonblocking(sock_err->fd(), true);
+      for (auto& [fd, stream] : extra_in) set_nonblocking(stream.fd(), true);
+      for (auto& [fd, stream] : extra_out) set_nonblocking(stream.fd(), true);
+      for (auto& [fd, socket] : extra_sockets) set_nonblocking(socket.fd(), true);
+    }
+    std::array<int, 3> ring_fds{ ring_in.has_value() ? ring_in->fd() : -1,
+                                 ring_out.has_value() ? ring_out->fd() : -1,
+                                 ring_err.has_value() ? ring_err->fd() : -1 };
+    PrepExec& preparedExec = spawn.exec;
+    const auto& exe = config.executable.has_value() ? *config.executable : argv[0];
+    bool resolved = shared != nullptr && !shared->path.empty() && exe == shared->name;
+    preparedExec.prepare(resolved ? shared->path : exe, argv);
+    if (shared != nullptr && shared->env.has_value()) {
+      preparedExec.share_env(shared->env->asCharStar());
+    } else if (explicit_env(config, ring_fds)) {
+      child_env(config, ring_fds, preparedExec.env());
+    }
+
+    pid_t child_pid;
+    bool in_cgroup = false;
+    // Whichever way it is forked, the child below only makes syscalls on
+    // what was prepared above: fork_into_cgroup's child gets none of glibc's
+    // fork handling, so a malloc there could deadlock on a lock another
+    // thread held at the clone. Keep it that way (allocation_test checks).
+    if (cgroup.has_value()) {
+      child_pid = fork_into_cgroup(cgroup->fd());
+      in_cgroup = child_pid >= 0;
+      // kernels before 5.7: the child joins the cgroup itself
+      if (child_pid < 0 && (errno == ENOSYS || errno == E2BIG || errno == EINVAL)) child_pid = ::fork();
+    } else {
+      child_pid = ::fork();
+    }
     if (child_pid < 0) {
-      return PopenError{PopenError::IoError, std::string("fork(): ") + strerror(errno)};
+      int fork_errno = errno;
+      close_child_ends(child_fds);
+      ::close(std::get<0>(exec_fail_pipe));
+      ::close(std::get<1>(exec_fail_pipe));
+      // out of processes or memory: nothing wrong with the request itself
+      bool overloaded = fork_errno == EAGAIN || fork_errno == ENOMEM;
+      return PopenError{overloaded ? PopenError::Overloaded : PopenError::IoError, "fork()", fork_errno};
     } else if (child_pid == 0) {
       // i am the child
       ::close(std::get<0>(exec_fail_pipe));
-      int32_t result = do_exec(
+      // the error pipe must survive the dup2()s into the child's descriptors
+      int report_fd = std::get<1>(exec_fail_pipe);
+      if (report_fd <= max_target) {
+        report_fd = ::fcntl(report_fd, F_DUPFD_CLOEXEC, max_target + 1);
+      }
+      int32_t result = 0;
+      if (cgroup.has_value() && !in_cgroup) result = join_cgroup(cgroup->fd());
+      if (result == 0) result = do_exec(
         preparedExec,
-        child_ends,
+        child_fds,
+        attrs,
         config.cwd,
         config.setuid,
         config.setgid,
@@ -158,34 +620,75 @@ std::optional<PopenError> Popen::os_start(const std::vector<std::string>& argv,
       );
       // if we are here, it means that exec has failed. Notify
       // the parent and exit.
-      ::write(std::get<1>(exec_fail_pipe), &(result), sizeof(result));
-      ::close(std::get<1>(exec_fail_pipe));
-      std::exit(127);
+      ::write(report_fd, &(result), sizeof(result));
+      ::_exit(127);
     } else {
-      if (std::get<0>(child_ends) != 0) ::close(std::get<0>(child_ends));
-      if (std::get<1>(child_ends) != 1) ::close(std::get<1>(child_ends));
-      if (std::get<2>(child_ends) != 2) ::close(std::get<2>(child_ends));
+      close_child_ends(child_fds);
       child_state = ChildState::Running{child_pid};
+      spawned_pid = child_pid;
+      if (config.setpgid) {
+        // The child does this too; doing it here as well means the group
+        // exists as soon as we return, whichever of us runs first.
+        ::setpgid(child_pid, child_pid);
+        group = child_pid;
+      }
     }
   }
   ::close(std::get<1>(exec_fail_pipe));
+  exec_fail_fd = std::get<0>(exec_fail_pipe);
+  if (!config.async_exec) {
+    collect_exec(true);
+    if (exec_error.has_value()) return exec_error;
+  }
+  if (config.sampler != nullptr) {
+    // sampling is a nicety, not worth failing the spawn for; the pid
+    // stays the same across exec, so it may start before
+    auto tracked = config.sampler->track(*pid());
+    if (tracked.ok()) {
+      sampler = config.sampler;
+      sample_id = tracked.take_value();
+    }
+  }
+  return std::nullopt;
+}
+
+bool Popen::collect_exec(bool block) {
+  if (exec_fail_fd < 0) return true;
+  if (!block) {
+    struct pollfd pfd = { exec_fail_fd, POLLIN, 0 };
+    // hung up (exec'd) also counts as ready
+    if (::poll(&pfd, 1, 0) <= 0) return false;
+  }
   int32_t err;
-  auto readCnt = ::read(std::get<0>(exec_fail_pipe), &err, sizeof(err));
-  ::close(std::get<0>(exec_fail_pipe));
-  if (readCnt == 0) {
-    // no error written, ok
-    return std::nullopt;
-  } else if (readCnt == sizeof(err)) {
-    return PopenError{PopenError::IoError, std::string("Following error reported from exec (within child): ") + strerror(err)};
-  } else {
-    return PopenError{PopenError::LogicError, "invalid read_count from exec pipe"};
+  ssize_t readCnt;
+  do {
+    readCnt = ::read(exec_fail_fd, &err, sizeof(err));
+  } while (readCnt < 0 && errno == EINTR);
+  ::close(exec_fail_fd);
+  exec_fail_fd = -1;
+  if (readCnt == sizeof(err)) {
+    exec_error = PopenError{PopenError::IoError, "exec() (reported from within child)", err};
+  } else if (readCnt != 0) {
+    // no error written is ok
+    exec_error = PopenError{PopenError::LogicError, "invalid read_count from exec pipe"};
   }
+  return true;
+}
+
+std::optional<PopenError> Popen::exec_result() {
+  // as the reaper, since waitpid() may be collecting it in another thread
+  if (spawned_pid >= 0 && begin_reaping(true)) {
+    collect_exec(true);
+    end_reaping(Running);
+  }
+  return exec_error;
 }
 
 int32_t Popen::do_exec(
   PrepExec& just_exec,
-  std::tuple<int, int, int> child_ends,
-  std::optional<std::string> cwd,
+  std::vector<ChildFd>& child_fds,
+  const ChildAttrs& attrs,
+  const std::optional<std::string>& cwd,
   std::optional<uint32_t> setuid,
   std::optional<uint32_t> setgid,
   bool setpgid
@@ -195,29 +698,39 @@ int32_t Popen::do_exec(
       return errno;
     }
   }
-  if (std::get<0>(child_ends) != 0) {
-    if (::dup2(std::get<0>(child_ends), 0) == -1) {
-      return errno;
+  // A source that is also another entry's target would be overwritten by
+  // that entry's dup2(), so first move every such source above all the
+  // targets. After that no dup2() can clobber a source still needed, which
+  // makes any permutation (3<->4, say) safe, without allocating. The
+  // sources and the moved copies are close-on-exec and vanish at exec().
+  int above = 3;
+  for (const auto& child_fd : child_fds) above = std::max(above, child_fd.target + 1);
+  for (auto& child_fd : child_fds) {
+    if (child_fd.source == child_fd.target) continue;
+    bool clobbered = std::any_of(child_fds.begin(), child_fds.end(),
+                                 [&](const ChildFd& other) { return other.target == child_fd.source; });
+    if (clobbered) {
+      child_fd.source = ::fcntl(child_fd.source, F_DUPFD_CLOEXEC, above);
+      if (child_fd.source < 0) return errno;
     }
-    ::close(std::get<0>(child_ends));
   }
-  if (std::get<1>(child_ends) != 1) {
-    if (::dup2(std::get<1>(child_ends), 1) == -1) {
+  for (const auto& child_fd : child_fds) {
+    if (child_fd.source == child_fd.target) {
+      if (::fcntl(child_fd.target, F_SETFD, 0) != 0) return errno;
+    } else if (::dup2(child_fd.source, child_fd.target) == -1) {
       return errno;
     }
-    ::close(std::get<1>(child_ends));
-  }
-  if (std::get<2>(child_ends) != 2) {
-    if (::dup2(std::get<2>(child_ends), 2) == -1) {
-      return errno;
-    }
-    ::close(std::get<2>(child_ends));
   }
 
   if (auto err = reset_sigpipe()) {
     return err;
   }
 
+  // before dropping privileges, which raising priorities may need
+  if (auto err = apply_attrs(attrs)) {
+    return err;
+  }
+
   if (setuid.has_value()) {
     if (::setuid(*setuid) != 0) {
       return errno;
@@ -239,73 +752,158 @@ int32_t Popen::do_exec(
 }
 
 
+Result<CaptureData> Popen::communicate(const std::string& input) {
+  if (std_in.has_value()) set_nonblocking(std_in->fd(), true);
+  if (std_out.has_value()) set_nonblocking(std_out->fd(), true);
+  if (std_err.has_value()) set_nonblocking(std_err->fd(), true);
+
+  std::string out, err;
+  size_t written = 0;
+  char buf[16384];
+  bool in_open = std_in.has_value() && std_in->is_open();
+  bool out_open = std_out.has_value() && std_out->is_open();
+  bool err_open = std_err.has_value() && std_err->is_open();
+  if (in_open && input.empty()) {
+    std_in->close();
+    in_open = false;
+  }
+
+  while (in_open || out_open || err_open) {
+    struct pollfd fds[3];
+    nfds_t nfds = 0;
+    if (in_open) fds[nfds++] = { std_in->fd(), POLLOUT, 0 };
+    if (out_open) fds[nfds++] = { std_out->fd(), POLLIN, 0 };
+    if (err_open) fds[nfds++] = { std_err->fd(), POLLIN, 0 };
+    if (::poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR) continue;
+      return PopenError{PopenError::IoError, "poll()", errno};
+    }
+
+    // every stream is tried; one not ready just reports would_block
+    if (in_open) {
+      // a child that exits without reading makes this EPIPE, not SIGPIPE
+      SigpipeBlock block_sigpipe;
+      auto res = std_in->write_some(input.data() + written, input.size() - written);
+      written += res.count;
+      if (res.status == boost::io_status::error) return PopenError{PopenError::IoError, "write()", res.err};
+      // eof: the child stopped reading, which is its business
+      if (res.status != boost::io_status::would_block) {
+        std_in->close();
+        in_open = false;
+      }
+    }
+    for (auto [stream, dest, open] : { std::tuple{ &std_out, &out, &out_open },
+                                       std::tuple{ &std_err, &err, &err_open } }) {
+      while (*open) {
+        auto res = (*stream)->read_some(buf, sizeof(buf));
+        if (res.status == boost::io_status::would_block) break;
+        if (res.status == boost::io_status::error) return PopenError{PopenError::IoError, "read()", res.err};
+        if (res.status != boost::io_status::ok) {
+          *open = false;
+          break;
+        }
+        dest->append(buf, res.count);
+      }
+    }
+  }
+
+  auto status = wait();
+  if (!status.ok()) return status.take_error();
+  return CaptureData{ std::move(out), std::move(err), status.take_value() };
+}
+
 std::optional<ExitStatus> Popen::exit_status() const {
-  if (child_state.is_a<ChildState::Finished>()) {
-    auto finished = child_state.get<ChildState::Finished>();
-    return std::make_optional<ExitStatus>(std::move(finished.exit_status));
+  if (phase.load(std::memory_order_acquire) == Finished) {
+    return child_state.get<ChildState::Finished>().exit_status;
   }
   return std::nullopt;
 }
 
 std::optional<pid_t> Popen::pid() const {
-  if (child_state.is_a<ChildState::Running>()) {
-    return child_state.get<ChildState::Running>().pid;
+  if (spawned_pid >= 0 && phase.load(std::memory_order_acquire) != Finished) {
+    return spawned_pid;
   }
   return std::nullopt;
 }
 
 
 Result<ExitStatus> Popen::wait() {
-  while (child_state.is_a<ChildState::Running>()) {
+  while (phase.load(std::memory_order_acquire) != Finished) {
     auto res = waitpid(true);
     if (!res.ok()) return res.take_error();
   }
+  if (exec_error.has_value()) return *exec_error;
   return *exit_status();
 }
 
 
 
 Result<const std::nullopt_t> Popen::waitpid(bool block) {
-  return child_state.match(
-    [](const ChildState::Preparing&) -> Result<const std::nullopt_t> { panic("child_state == Preparing"); return std::nullopt; },
-    [block, this](const ChildState::Running& r) -> Result<const std::nullopt_t> {
-      int status = 0;
-      pid_t pid = ::waitpid(r.pid, &status, block ? 0 : WNOHANG);
-      if (pid < 0) {
-        if (errno == ECHILD) {
-          // Someone else has waited for the child
-          // (another thread, a signal handler...).
-          // The PID no longer exists and we cannot
-          // find its exit status.
-          this->child_state = ChildState::Finished{ExitStatus::Undetermined{}};
-          return std::nullopt;
-        }
-        return PopenError{PopenError::IoError, std::string("waitpid: ") + strerror(errno)};
-      }
-      if (pid == r.pid) {
-        this->child_state = ChildState::Finished{ExitStatus::Exited{status}};
-      }
-      return std::nullopt;
-    },
-    [](const ChildState::Finished&) -> Result<const std::nullopt_t> { return std::nullopt; }
-  );
+  if (spawned_pid < 0) panic("child_state == Preparing");
+
+  if (!begin_reaping(block)) return std::nullopt;
+
+  // Only this thread gets here until `phase` moves on.
+  std::optional<PopenError> error;
+  int status = 0;
+  pid_t pid = ::waitpid(spawned_pid, &status, block ? 0 : WNOHANG);
+  if (pid == spawned_pid) {
+    child_state = ChildState::Finished{decode_exit_status(status)};
+  } else if (pid < 0 && errno == ECHILD) {
+    // Someone else has waited for the child
+    // (a signal handler, code not going through
+    // this Popen...). The PID no longer exists and
+    // we cannot find its exit status.
+    child_state = ChildState::Finished{ExitStatus::Undetermined{}};
+  } else if (pid < 0 && errno != EINTR) {
+    // EINTR: interrupted by a signal; our caller loops and tries again
+    error = PopenError{PopenError::IoError, "waitpid()", errno};
+  }
+  bool finished = child_state.is_a<ChildState::Finished>();
+  // With the child gone this cannot block for long; otherwise it saves a
+  // waiting caller the pipe later. Done here so that the other threads
+  // only ever read `exec_error`, once Finished.
+  collect_exec(finished);
+
+  end_reaping(finished ? Finished : Running);
+  if (error.has_value()) return *error;
+  return std::nullopt;
 }
 
-Result<std::optional<ExitStatus>> Popen::wait_timeout(std::chrono::milliseconds us) {
-  if (child_state.is_a<ChildState::Finished>()) {
-    return std::make_optional(child_state.get<ChildState::Finished>().exit_status);
+bool Popen::begin_reaping(bool block) {
+  uint32_t seen = phase.load(std::memory_order_acquire);
+  while (true) {
+    if (seen == Finished) return false;
+    if (seen == Running) {
+      if (phase.compare_exchange_weak(seen, Reaping, std::memory_order_acquire)) return true;
+      continue;
+    }
+    // another thread is reaping
+    if (!block) return false;
+    if (seen == ReapingWaited || phase.compare_exchange_weak(seen, ReapingWaited, std::memory_order_acquire)) {
+      futex_wait(phase, ReapingWaited);
+    }
+    seen = phase.load(std::memory_order_acquire);
   }
+}
+
+void Popen::end_reaping(Phase next) {
+  if (phase.exchange(next, std::memory_order_acq_rel) == ReapingWaited) futex_wake_all(phase);
+}
 
+Result<std::optional<ExitStatus>> Popen::wait_timeout(std::chrono::milliseconds us) {
   auto deadline = std::chrono::system_clock::now() + us;
   // double delay at every iteration, maxing at 100ms
   auto delay = 1ms;
 
   while (true) {
+    // once Finished, without a system call
     auto success = this->waitpid(false);
     if (!success.ok()) return success.take_error();
 
-    if (child_state.is_a<ChildState::Finished>()) {
-      return std::make_optional(child_state.get<ChildState::Finished>().exit_status);
+    if (phase.load(std::memory_order_acquire) == Finished) {
+      if (exec_error.has_value()) return *exec_error;
+      return exit_status();
     }
 
     auto now = std::chrono::system_clock::now();
@@ -319,6 +917,131 @@ Result<std::optional<ExitStatus>> Popen::wait_timeout(std::chrono::milliseconds
 
 std::optional<ExitStatus> Popen::poll() {
   auto res = wait_timeout(0ms);
-  if (!res.ok()) return std::nullopt;
+  // a failed exec is an error there, but the child has still finished
+  if (!res.ok()) return exit_status();
   return res.take_value();
 }
+
+std::vector<ResourceSample> Popen::resource_samples() const {
+  if (sampler == nullptr) return {};
+  return sampler->samples(sample_id);
+}
+
+std::optional<PopenError> Popen::send_signal(int signo) {
+  auto running = pid();
+  if (!running.has_value()) return std::nullopt;
+  // ESRCH: exited, but not yet waited for
+  if (::kill(*running, signo) != 0 && errno != ESRCH) {
+    return PopenError{PopenError::IoError, "kill()", errno};
+  }
+  return std::nullopt;
+}
+
+std::optional<PopenError> Popen::signal_tree(int signo) {
+  if (cgroup.has_value()) {
+    return signo == SIGKILL ? cgroup->kill() : cgroup->signal(signo);
+  }
+  // Until it is reaped, the leader (a zombie at worst) keeps the group id
+  // taken. After that, the group may empty and its id be reused by an
+  // unrelated group, so only the leader is left to signal, which is gone.
+  if (group != 0 && phase.load(std::memory_order_acquire) != Finished) {
+    if (::killpg(group, signo) != 0 && errno != ESRCH) {
+      return PopenError{PopenError::IoError, "killpg()", errno};
+    }
+    return std::nullopt;
+  }
+  return send_signal(signo);
+}
+
+std::optional<PopenError> Popen::kill_tree() {
+  auto err = signal_tree(SIGKILL);
+  close_streams();
+  return err;
+}
+
+Result<ExitStatus> Popen::terminate(std::chrono::milliseconds grace) {
+  return std::move(terminate_all({ this }, grace).front());
+}
+
+// Wait until each of `pids` has exited, without reaping any, or until
+// `deadline`. Exits are watched through pidfds, in a single poll() for
+// all of them; without pidfds (before Linux 5.3, or out of descriptors)
+// they are polled for.
+static void wait_for_exits(const std::vector<pid_t>& pids, std::chrono::steady_clock::time_point deadline) {
+  std::vector<struct pollfd> watched;
+  std::vector<pid_t> polled;
+  watched.reserve(pids.size());
+  for (pid_t pid : pids) {
+    int fd = pidfd_open(pid);
+    if (fd >= 0) {
+      watched.push_back({ fd, POLLIN, 0 });
+    } else if (errno != ESRCH) {
+      // ENOSYS, or out of descriptors (EMFILE, ENFILE): still watched
+      polled.push_back(pid);
+    }
+  }
+
+  // double the polling delay at every iteration, maxing at 100ms
+  auto delay = 1ms;
+  while (!watched.empty() || !polled.empty()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) break;
+    auto timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+    if (!polled.empty()) timeout = std::min(timeout, delay);
+
+    int n = ::poll(watched.data(), watched.size(), static_cast<int>(timeout.count()));
+    if (n < 0 && errno != EINTR) break;
+    // drop the exited, so each poll() only watches the rest
+    for (size_t i = 0; n > 0 && i < watched.size();) {
+      if (watched[i].revents != 0) {
+        ::close(watched[i].fd);
+        watched[i] = watched.back();
+        watched.pop_back();
+      } else {
+        i++;
+      }
+    }
+
+    polled.erase(std::remove_if(polled.begin(), polled.end(), [](pid_t pid) {
+      siginfo_t info = {};
+      // WNOWAIT: leave the child for its Popen to reap
+      return ::waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+             info.si_pid != 0;
+    }), polled.end());
+    delay = std::min<std::chrono::milliseconds>({delay * 2, 100ms});
+  }
+  for (const auto& p : watched) ::close(p.fd);
+}
+
+std::vector<Result<ExitStatus>> Popen::terminate_all(const std::vector<Popen*>& popens,
+                                                     std::chrono::milliseconds grace) {
+  auto deadline = std::chrono::steady_clock::now() + grace;
+  std::vector<pid_t> pids;
+  pids.reserve(popens.size());
+  for (auto* popen : popens) {
+    // a failure to ask politely is made up for by the SIGKILL below
+    popen->signal_tree(SIGTERM);
+    if (auto pid = popen->pid()) pids.push_back(*pid);
+  }
+  wait_for_exits(pids, deadline);
+
+  // only those still running are escalated; the others exited on their
+  // own and keep their streams, with whatever output is left unread
+  std::vector<std::optional<PopenError>> kill_errors;
+  kill_errors.reserve(popens.size());
+  for (auto* popen : popens) {
+    kill_errors.push_back(popen->poll().has_value() ? std::nullopt : popen->kill_tree());
+  }
+
+  std::vector<Result<ExitStatus>> results;
+  results.reserve(popens.size());
+  for (size_t i = 0; i < popens.size(); i++) {
+    // waiting for a child we failed to kill could take forever
+    if (kill_errors[i].has_value() && popens[i]->pid().has_value()) {
+      results.push_back(std::move(*kill_errors[i]));
+    } else {
+      results.push_back(popens[i]->wait());
+    }
+  }
+  return results;
+}
@@ -1,18 +1,17 @@
 #include "subprocess/PopenError.hpp"
 
+#include <system_error>
+
 using namespace subprocess;
 
-PopenError::PopenError(ErrKind _kind, const std::string& _message)
+PopenError::PopenError(ErrKind _kind, const char* _context, int _errnum)
 : kind{_kind}
-, message{_message}
-{ }
-
-PopenError::PopenError(PopenError&& other)
-: kind{other.kind}
-, message{std::move(other.message)}
+, context{_context}
+, errnum{_errnum}
 { }
 
-PopenError::PopenError(const PopenError& other)
-: kind{other.kind}
-, message{other.message}
-{ }
+std::string PopenError::message() const {
+  if (errnum == 0) return context;
+  // std::generic_category is thread-safe, unlike strerror()
+  return std::string(context) + ": " + std::generic_category().message(errnum);
+}
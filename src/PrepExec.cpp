@@ -1,21 +1,29 @@
 #include "subprocess/PrepExec.hpp"
 
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 using namespace subprocess;
 
 PrepExec::PrepExec(
-  const std::string& _cmd,
+  std::string _cmd,
   const std::vector<std::string>& args,
-  const std::optional<std::vector<std::string>>& env
-)
-: cmd{_cmd}
-, argvec{args}
-{
+  std::optional<RaggedCstrArray> env
+) {
+  prepare(_cmd, args);
   if (env.has_value()) {
-    envvec = RaggedCstrArray{*env};
+    envvec = std::move(*env);
+    use_env = true;
   }
+}
+
+void PrepExec::prepare(const std::string& _cmd, const std::vector<std::string>& args) {
+  cmd = _cmd;
+  argvec.assign(args);
+  use_env = false;
+  shared_envp = nullptr;
+  search = false;
 
   // Allocate enough room for "<pathdir>/<command>\0", pathdir
   // being the longest component of PATH.
@@ -24,7 +32,8 @@ PrepExec::PrepExec(
      // use the parent's PATH to determine what to exec
     const char* searchPathRaw = std::getenv("PATH");
     if (searchPathRaw != nullptr) {
-      searchpath = std::string(searchPathRaw);
+      searchpath = searchPathRaw;
+      search = true;
       size_t pos = 0;
       size_t thisDirSize = 0;
       size_t biggestDirSize = 0;
@@ -40,29 +49,62 @@ PrepExec::PrepExec(
       max_exe_len += biggestDirSize;
     }
   }
-  prealloc_exe.reserve(max_exe_len);
+  // never shrinks the capacity
+  prealloc_exe.resize(max_exe_len);
+}
+
+RaggedCstrArray& PrepExec::env() {
+  envvec.clear();
+  use_env = true;
+  return envvec;
+}
+
+void PrepExec::share_env(char** envp) {
+  shared_envp = envp;
+}
+
+std::optional<std::string> PrepExec::resolve(const std::string& cmd) {
+  const char* searchPathRaw = std::getenv("PATH");
+  if (searchPathRaw == nullptr || cmd.find("/") != std::string::npos) return std::nullopt;
+  std::string candidate;
+  const char* dir = searchPathRaw;
+  while (true) {
+    const char* end = ::strchrnul(dir, ':');
+    if (*dir != '/') return std::nullopt;
+    candidate.assign(dir, end);
+    candidate += '/';
+    candidate += cmd;
+    // what exec() would get past: a directory, or a file we cannot run
+    struct stat st;
+    if (::stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+        ::access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    }
+    if (*end == '\0') return std::nullopt;
+    dir = end + 1;
+  }
 }
 
 int32_t PrepExec::exec() {
   // Invoked after fork() - no heap allocation allowed.
-  if (searchpath.has_value()) {
+  if (search) {
     int32_t errCode = 0;
     // POSIX requires execvp and execve, but not execvpe (although
     // glibc provides one), so we have to iterate over PATH ourselves
     size_t start = 0;
-    size_t end = searchpath->find(":");
+    size_t end = searchpath.find(":");
     while (start != std::string::npos) { // for each PATH component,
       // 1. build the full path to the executable, storing
       //   the value in prealloc_exe. prealloc_exe is guaranteed
       //   to be as long as (longest PATH component + 1 for slash + exe name + 1 for null terminator)
-      //   (see ctor for prealloc_exe.reserve())
+      //   (see prepare() for prealloc_exe.resize())
       size_t ix = 0;
       while (start < end) { // 1a. the PATH segment
-        prealloc_exe[ix++] = searchpath->at(start++);
+        prealloc_exe[ix++] = searchpath.at(start++);
       } // exit condition: start == end, the position of the next ":" or std::string::npos
       if (start != std::string::npos) {
         start++;
-        end = searchpath->find(":", start);
+        end = searchpath.find(":", start);
       }
       prealloc_exe[ix++] = '/'; // 1b. a seperating '/'
       for (auto ch : cmd) { // 1c. the executable name
@@ -89,8 +131,10 @@ int32_t PrepExec::exec() {
 }
 
 int32_t PrepExec::libc_exec() {
-  if (envvec.has_value()) {
-    ::execve(prealloc_exe.data(), argvec.asCharStar(), envvec->asCharStar());
+  if (shared_envp != nullptr) {
+    ::execve(prealloc_exe.data(), argvec.asCharStar(), shared_envp);
+  } else if (use_env) {
+    ::execve(prealloc_exe.data(), argvec.asCharStar(), envvec.asCharStar());
   } else {
     ::execv(prealloc_exe.data(), argvec.asCharStar());
   }
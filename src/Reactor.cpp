@@ -0,0 +1,155 @@
+#include "subprocess/Reactor.hpp"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "subprocess/posix.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  // how often child exits are polled for without pidfd support
+  constexpr auto polled_exit_interval = 5ms;
+  constexpr size_t max_events = 64;
+}
+
+EpollReactor::EpollReactor()
+: _epoll_fd{::epoll_create1(EPOLL_CLOEXEC)}
+, _events(max_events)
+{
+  if (_epoll_fd < 0) panic("epoll_create1() failed");
+}
+
+EpollReactor::~EpollReactor() {
+  for (auto& [fd, watch] : _watches) {
+    if (watch.exited) ::close(fd);
+  }
+  ::close(_epoll_fd);
+}
+
+std::optional<PopenError> EpollReactor::update(int fd, Watch& watch, bool is_new) {
+  struct epoll_event ev = {};
+  if (watch.readable || watch.exited) ev.events |= EPOLLIN;
+  if (watch.writable) ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+  if (::epoll_ctl(_epoll_fd, is_new ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) != 0) {
+    return PopenError{PopenError::IoError, "epoll_ctl()", errno};
+  }
+  return std::nullopt;
+}
+
+std::optional<PopenError> EpollReactor::on_readable(int fd, Callback cb) {
+  auto [it, is_new] = _watches.try_emplace(fd);
+  it->second.readable = std::move(cb);
+  auto err = update(fd, it->second, is_new);
+  if (err.has_value() && is_new) _watches.erase(it);
+  return err;
+}
+
+std::optional<PopenError> EpollReactor::on_writable(int fd, Callback cb) {
+  auto [it, is_new] = _watches.try_emplace(fd);
+  it->second.writable = std::move(cb);
+  auto err = update(fd, it->second, is_new);
+  if (err.has_value() && is_new) _watches.erase(it);
+  return err;
+}
+
+std::optional<PopenError> EpollReactor::on_exit(pid_t pid, Callback cb) {
+  int pidfd = pidfd_open(pid);
+  if (pidfd < 0) {
+    if (errno != ENOSYS) return PopenError{PopenError::IoError, "pidfd_open()", errno};
+    _polled_exits.push_back(PolledExit{ pid, std::move(cb) });
+    return std::nullopt;
+  }
+  set_inheritable(pidfd, false);
+  auto& watch = _watches[pidfd];
+  watch.exited = std::move(cb);
+  auto err = update(pidfd, watch, true);
+  if (err.has_value()) {
+    _watches.erase(pidfd);
+    ::close(pidfd);
+  }
+  return err;
+}
+
+void EpollReactor::cancel(int fd) {
+  auto it = _watches.find(fd);
+  if (it == _watches.end()) return;
+  ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  if (it->second.exited) ::close(fd);
+  _watches.erase(it);
+}
+
+bool EpollReactor::has_pending() const {
+  return !_watches.empty() || !_polled_exits.empty();
+}
+
+Result<size_t> EpollReactor::run_once(std::optional<std::chrono::milliseconds> timeout) {
+  int timeout_ms = timeout.has_value() ? static_cast<int>(timeout->count()) : -1;
+  if (!_polled_exits.empty()) {
+    auto poll_ms = static_cast<int>(polled_exit_interval.count());
+    timeout_ms = timeout_ms < 0 ? poll_ms : std::min(timeout_ms, poll_ms);
+  }
+
+  int n = ::epoll_wait(_epoll_fd, _events.data(), static_cast<int>(_events.size()), timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR) return size_t{ 0 };
+    return PopenError{PopenError::IoError, "epoll_wait()", errno};
+  }
+
+  // Collect every ready callback before running any: a callback may
+  // register or cancel watches, which invalidates iterators into _watches.
+  std::vector<Callback> ready;
+  for (int i = 0; i < n; i++) {
+    const auto& ev = _events[static_cast<size_t>(i)];
+    int fd = ev.data.fd;
+    auto it = _watches.find(fd);
+    if (it == _watches.end()) continue;
+    Watch& watch = it->second;
+    bool errored = ev.events & (EPOLLERR | EPOLLHUP);
+    if (watch.exited) {
+      ready.push_back(std::move(watch.exited));
+      ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      ::close(fd);
+      _watches.erase(it);
+      continue;
+    }
+    if (watch.readable && (ev.events & EPOLLIN || errored)) {
+      ready.push_back(std::move(watch.readable));
+      watch.readable = nullptr;
+    }
+    if (watch.writable && (ev.events & EPOLLOUT || errored)) {
+      ready.push_back(std::move(watch.writable));
+      watch.writable = nullptr;
+    }
+    if (!watch.readable && !watch.writable) {
+      ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      _watches.erase(it);
+    } else {
+      update(fd, watch, false);
+    }
+  }
+
+  if (!_polled_exits.empty()) {
+    auto polled = std::move(_polled_exits);
+    _polled_exits.clear();
+    for (auto& p : polled) {
+      siginfo_t info = {};
+      // WNOWAIT: leave the child for its Popen to reap
+      if (::waitid(P_PID, static_cast<id_t>(p.pid), &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+          info.si_pid == 0) {
+        _polled_exits.push_back(std::move(p));
+      } else {
+        ready.push_back(std::move(p.cb));
+      }
+    }
+  }
+
+  for (auto& cb : ready) cb();
+  return ready.size();
+}
@@ -48,7 +48,7 @@ Redirection::FileDescriptor& Redirection::FileDescriptor::operator=(FileDescript
 Result<Redirection> Redirection::Open(const std::filesystem::path& path, int flags, mode_t mode) {
   auto fd = ::open(path.c_str(), flags, mode);
   if (fd < 0) {
-    return PopenError{PopenError::ErrKind::IoError, std::string("open(): ") + std::to_string(errno) + std::string(" ") + strerror(errno)};
+    return PopenError{PopenError::ErrKind::IoError, "open()", errno};
   }
   return Redirection{Redirection::FileDescriptor(fd)};
 }
@@ -78,17 +78,3 @@ std::string Redirection::toString() const {
   return internal::variant_to_string(_state);
 }
 
-
-
-Result<const std::nullopt_t> Redirection::match(
-  std::function<Result<const std::nullopt_t>(const Pipe&)> pipe_case,
-  std::function<Result<const std::nullopt_t>(const FileDescriptor&)> file_case,
-  std::function<Result<const std::nullopt_t>(const Merge&)> merge_case,
-  std::function<Result<const std::nullopt_t>()> none_case
-) const {
-  if (is_a<Pipe>()) return pipe_case(get<Pipe>());
-  if (is_a<FileDescriptor>()) return file_case(get<FileDescriptor>());
-  if (is_a<Merge>()) return merge_case(get<Merge>());
-  if (is_a<None>()) return none_case();
-  return std::nullopt;
-}
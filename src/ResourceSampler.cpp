@@ -0,0 +1,185 @@
+#include "subprocess/ResourceSampler.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "subprocess/PopenError.hpp"
+
+using namespace subprocess;
+
+namespace {
+  // Enough for any stat, statm or io file.
+  constexpr size_t max_file_size = 1024;
+
+  int open_proc_file(pid_t pid, const char* name) {
+    char path[64];
+    ::snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return ::open(path, O_RDONLY | O_CLOEXEC);
+  }
+
+  // The file's contents from the start, NUL-terminated; 0 once the process
+  // is gone, as a read fails (ESRCH) or returns nothing then.
+  size_t read_file(int fd, char (&buf)[max_file_size]) {
+    ssize_t n = ::pread(fd, buf, max_file_size - 1, 0);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    return static_cast<size_t>(n);
+  }
+
+  // The value following `key` (which includes the newline before it).
+  uint64_t keyed_number(const char* contents, const char* key) {
+    const char* found = ::strstr(contents, key);
+    return found != nullptr ? ::strtoull(found + ::strlen(key), nullptr, 10) : 0;
+  }
+}  // namespace
+
+ResourceSampler::ResourceSampler()
+: ResourceSampler{Options{}}
+{ }
+
+ResourceSampler::ResourceSampler(Options options)
+: _options{options}
+, _tick_usec{1000000 / ::sysconf(_SC_CLK_TCK)}
+, _page_size{static_cast<uint64_t>(::sysconf(_SC_PAGESIZE))}
+{
+  _options.samples_per_child = std::max<size_t>(_options.samples_per_child, 1);
+}
+
+ResourceSampler::~ResourceSampler() {
+  stop();
+  for (auto& child : _children) close_files(child);
+}
+
+void ResourceSampler::close_files(Child& child) {
+  for (int* fd : { &child.stat_fd, &child.statm_fd, &child.io_fd }) {
+    if (*fd >= 0) ::close(*fd);
+    *fd = -1;
+  }
+}
+
+Result<ResourceSampler::Id> ResourceSampler::track(pid_t pid) {
+  Child child{};
+  child.stat_fd = open_proc_file(pid, "stat");
+  if (child.stat_fd < 0) return PopenError{PopenError::IoError, "open() /proc/<pid>/stat", errno};
+  child.statm_fd = open_proc_file(pid, "statm");
+  // needs ptrace access, and the kernel's per-task I/O accounting
+  child.io_fd = open_proc_file(pid, "io");
+  child.ring.resize(_options.samples_per_child);
+
+  std::lock_guard<std::mutex> lock{ _mutex };
+  child.id = _next_id++;
+  _children.push_back(std::move(child));
+  return _children.back().id;
+}
+
+void ResourceSampler::untrack(Id id) {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  auto it = std::find_if(_children.begin(), _children.end(), [id](const Child& c) { return c.id == id; });
+  if (it == _children.end()) return;
+  close_files(*it);
+  // order does not matter, so fill the hole with the last child
+  if (it != _children.end() - 1) *it = std::move(_children.back());
+  _children.pop_back();
+}
+
+std::vector<ResourceSample> ResourceSampler::samples(Id id) const {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  auto it = std::find_if(_children.begin(), _children.end(), [id](const Child& c) { return c.id == id; });
+  if (it == _children.end()) return {};
+  std::vector<ResourceSample> out;
+  out.reserve(it->count);
+  size_t first = it->count < it->ring.size() ? 0 : it->next;
+  for (size_t i = 0; i < it->count; i++) out.push_back(it->ring[(first + i) % it->ring.size()]);
+  return out;
+}
+
+bool ResourceSampler::read_sample(const Child& child, ResourceSample& sample) const {
+  char buf[max_file_size];
+  if (read_file(child.stat_fd, buf) == 0) return false;
+  // the command name may contain anything, so fields are counted from its end
+  const char* state = ::strrchr(buf, ')');
+  if (state == nullptr || state[1] == '\0') return false;
+  state += 2;
+  // a zombie has released its memory; there is nothing left to sample
+  if (*state == 'Z' || *state == 'X') return false;
+  const char* p = ::strchr(state, ' ');
+  if (p == nullptr) return false;
+  // fields 4 (ppid) to 20 (num_threads) of proc(5)
+  uint64_t fields[17] = {};
+  for (auto& field : fields) {
+    char* end;
+    field = ::strtoull(p, &end, 10);
+    p = end;
+  }
+  sample.user_time = std::chrono::microseconds{ static_cast<int64_t>(fields[14 - 4]) * _tick_usec };
+  sample.system_time = std::chrono::microseconds{ static_cast<int64_t>(fields[15 - 4]) * _tick_usec };
+  sample.threads = static_cast<uint32_t>(fields[20 - 4]);
+
+  sample.vm_bytes = sample.rss_bytes = 0;
+  if (child.statm_fd >= 0 && read_file(child.statm_fd, buf) > 0) {
+    char* end;
+    sample.vm_bytes = ::strtoull(buf, &end, 10) * _page_size;
+    sample.rss_bytes = ::strtoull(end, nullptr, 10) * _page_size;
+  }
+  sample.read_bytes = sample.write_bytes = 0;
+  if (child.io_fd >= 0 && read_file(child.io_fd, buf) > 0) {
+    sample.read_bytes = keyed_number(buf, "\nread_bytes: ");
+    sample.write_bytes = keyed_number(buf, "\nwrite_bytes: ");
+  }
+  return true;
+}
+
+size_t ResourceSampler::sample_once() {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  size_t running = 0;
+  for (auto& child : _children) {
+    if (child.exited) continue;
+    ResourceSample sample{};
+    sample.time = std::chrono::steady_clock::now();
+    if (!read_sample(child, sample)) {
+      child.exited = true;
+      close_files(child);
+      continue;
+    }
+    child.ring[child.next] = sample;
+    child.next = (child.next + 1) % child.ring.size();
+    child.count = std::min(child.count + 1, child.ring.size());
+    running++;
+  }
+  return running;
+}
+
+void ResourceSampler::start() {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  if (_thread.joinable()) return;
+  _stopping = false;
+  _thread = std::thread{ [this] {
+    std::unique_lock<std::mutex> sleeping{ _mutex };
+    while (!_stopping) {
+      sleeping.unlock();
+      sample_once();
+      sleeping.lock();
+      _wake.wait_for(sleeping, _options.interval, [this] { return _stopping; });
+    }
+  } };
+}
+
+void ResourceSampler::stop() {
+  {
+    std::lock_guard<std::mutex> lock{ _mutex };
+    _stopping = true;
+  }
+  _wake.notify_all();
+  if (_thread.joinable()) _thread.join();
+}
+
+size_t ResourceSampler::size() const {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  return _children.size();
+}
@@ -0,0 +1,381 @@
+#include "subprocess/ResultCache.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+
+#include "subprocess/Popen.hpp"
+#include "subprocess/PrepExec.hpp"
+
+using namespace subprocess;
+
+namespace {
+  // SHA-256 (FIPS 180-4), enough of it to digest a key.
+  class Sha256 {
+   public:
+    void update(const void* data, size_t len) {
+      auto bytes = static_cast<const uint8_t*>(data);
+      _length += len;
+      while (len > 0) {
+        size_t n = std::min(len, sizeof(_block) - _used);
+        ::memcpy(_block + _used, bytes, n);
+        _used += n;
+        bytes += n;
+        len -= n;
+        if (_used == sizeof(_block)) {
+          compress();
+          _used = 0;
+        }
+      }
+    }
+
+    // A length-prefixed field, so that no two sequences of fields feed
+    // the same bytes.
+    void field(const std::string& value) {
+      uint64_t len = value.size();
+      update(&len, sizeof(len));
+      update(value.data(), value.size());
+    }
+
+    std::string hex_digest() {
+      uint64_t bits = _length * 8;
+      uint8_t pad = 0x80;
+      update(&pad, 1);
+      pad = 0;
+      while (_used != 56) update(&pad, 1);
+      uint8_t big_endian[8];
+      for (int i = 0; i < 8; i++) big_endian[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+      update(big_endian, 8);
+
+      static const char digits[] = "0123456789abcdef";
+      std::string hex;
+      for (uint32_t word : _state) {
+        for (int shift = 28; shift >= 0; shift -= 4) hex += digits[(word >> shift) & 0xf];
+      }
+      return hex;
+    }
+
+   private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress() {
+      static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+      };
+      uint32_t w[64];
+      for (size_t i = 0; i < 16; i++) {
+        w[i] = static_cast<uint32_t>(_block[4 * i]) << 24 | static_cast<uint32_t>(_block[4 * i + 1]) << 16 |
+               static_cast<uint32_t>(_block[4 * i + 2]) << 8 | static_cast<uint32_t>(_block[4 * i + 3]);
+      }
+      for (size_t i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+      }
+      auto [a, b, c, d, e, f, g, h] = _state;
+      for (size_t i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+      }
+      std::array<uint32_t, 8> next{ a, b, c, d, e, f, g, h };
+      for (size_t i = 0; i < 8; i++) _state[i] += next[i];
+    }
+
+    std::array<uint32_t, 8> _state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    uint8_t _block[64];
+    size_t _used{ 0 };
+    uint64_t _length{ 0 };
+  };
+
+  // The layout of an entry: this header, then stdout, then stderr.
+  struct EntryHeader {
+    char magic[8];
+    int32_t exit_code;
+    uint32_t reserved;
+    uint64_t stdout_len;
+    uint64_t stderr_len;
+  };
+  constexpr char entry_magic[8] = { 'S', 'P', 'R', 'C', 'A', 'C', 'H', '1' };
+
+  bool is_key(const char* name) {
+    return ::strlen(name) == 64 && ::strspn(name, "0123456789abcdef") == 64;
+  }
+
+  // Where the child's execve() will find `program`, by the same PATH search
+  // it will make; nullopt if that cannot be known in advance.
+  std::optional<std::string> resolve_executable(const std::string& program) {
+    if (program.find('/') != std::string::npos) return program;
+    return PrepExec::resolve(program);
+  }
+
+  std::optional<PopenError> digest_file(Sha256& sha, const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return PopenError{PopenError::IoError, "open() input file", errno};
+    char buf[65536];
+    while (true) {
+      ssize_t n = ::read(fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) {
+        int read_errno = errno;
+        ::close(fd);
+        return PopenError{PopenError::IoError, "read() input file", read_errno};
+      }
+      if (n == 0) break;
+      sha.update(buf, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::write(fd, data, len);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return false;
+      data += n;
+      len -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+}  // namespace
+
+ResultCache::ResultCache(std::string directory, Options options, uint64_t total_bytes)
+: _directory{std::move(directory)}
+, _options{std::move(options)}
+, _total_bytes{total_bytes}
+{ }
+
+Result<ResultCache> ResultCache::open(const std::string& directory) {
+  return open(directory, Options{});
+}
+
+Result<ResultCache> ResultCache::open(const std::string& directory, Options options) {
+  if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    return PopenError{PopenError::IoError, "mkdir() cache directory", errno};
+  }
+  DIR* dir = ::opendir(directory.c_str());
+  if (dir == nullptr) return PopenError{PopenError::IoError, "opendir() cache directory", errno};
+  uint64_t total = 0;
+  while (auto entry = ::readdir(dir)) {
+    struct stat st;
+    if (is_key(entry->d_name) && ::fstatat(::dirfd(dir), entry->d_name, &st, 0) == 0) {
+      total += static_cast<uint64_t>(st.st_size);
+    }
+  }
+  ::closedir(dir);
+  return ResultCache{ directory, std::move(options), total };
+}
+
+Result<std::string> ResultCache::key(const std::vector<std::string>& argv, const PopenConfig& config,
+                                     const std::string& input,
+                                     const std::vector<std::string>& input_files) const {
+  if (argv.empty()) return PopenError{PopenError::LogicError, "argv must not be empty"};
+  Sha256 sha;
+
+  auto executable = resolve_executable(config.executable.value_or(argv[0]));
+  struct stat st;
+  if (!executable.has_value() || ::stat(executable->c_str(), &st) != 0) {
+    return PopenError{PopenError::IoError, "stat() executable", executable.has_value() ? errno : ENOENT};
+  }
+  uint64_t identity[5] = { st.st_dev, st.st_ino,
+                           static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_mtim.tv_sec),
+                           static_cast<uint64_t>(st.st_mtim.tv_nsec) };
+  sha.update(identity, sizeof(identity));
+
+  sha.field(std::to_string(argv.size()));
+  for (const auto& arg : argv) sha.field(arg);
+
+  // later duplicates win, as in the child's environment
+  std::map<std::string, std::string> env;
+  for (auto& [name, value] : config.env.has_value() ? *config.env : PopenConfig::currentEnv()) {
+    env[name] = value;
+  }
+  if (_options.env_keys.has_value()) {
+    for (const auto& name : *_options.env_keys) {
+      auto it = env.find(name);
+      sha.field(name);
+      sha.field(it != env.end() ? "=" + it->second : "");
+    }
+  } else {
+    sha.field(std::to_string(env.size()));
+    for (const auto& [name, value] : env) {
+      sha.field(name);
+      sha.field(value);
+    }
+  }
+
+  std::string cwd;
+  if (config.cwd.has_value()) {
+    cwd = *config.cwd;
+  } else {
+    char buf[4096];
+    if (::getcwd(buf, sizeof(buf)) == nullptr) return PopenError{PopenError::IoError, "getcwd()", errno};
+    cwd = buf;
+  }
+  sha.field(cwd);
+  sha.field(input);
+
+  sha.field(std::to_string(input_files.size()));
+  for (const auto& path : input_files) {
+    sha.field(path);
+    Sha256 contents;
+    if (auto err = digest_file(contents, path)) return *err;
+    sha.field(contents.hex_digest());
+  }
+  return sha.hex_digest();
+}
+
+std::optional<CaptureData> ResultCache::lookup(const std::string& key) {
+  // anything else could name a file outside the cache, which a failed
+  // parse below would unlink
+  if (!is_key(key.c_str())) {
+    _stats.misses++;
+    return std::nullopt;
+  }
+  std::string path = _directory + "/" + key;
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    _stats.misses++;
+    return std::nullopt;
+  }
+  struct stat st;
+  std::optional<CaptureData> data;
+  if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(EntryHeader)) {
+    auto size = static_cast<size_t>(st.st_size);
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      auto bytes = static_cast<const char*>(mapped);
+      EntryHeader header;
+      ::memcpy(&header, bytes, sizeof(header));
+      if (::memcmp(header.magic, entry_magic, sizeof(entry_magic)) == 0 &&
+          header.stdout_len <= size - sizeof(header) &&
+          header.stderr_len == size - sizeof(header) - header.stdout_len) {
+        const char* out = bytes + sizeof(header);
+        const char* err = out + header.stdout_len;
+        data.emplace(CaptureData{ std::string(out, header.stdout_len), std::string(err, header.stderr_len),
+                                  ExitStatus::Exited{ header.exit_code } });
+      }
+      ::munmap(mapped, size);
+    }
+  }
+  if (data.has_value()) {
+    // the modification time records when the entry was last used
+    ::futimens(fd, nullptr);
+    _stats.hits++;
+  } else {
+    // truncated or from another version: drop it
+    ::unlink(path.c_str());
+    _stats.misses++;
+  }
+  ::close(fd);
+  return data;
+}
+
+std::optional<PopenError> ResultCache::store(const std::string& key, const CaptureData& data) {
+  if (!is_key(key.c_str())) return PopenError{PopenError::LogicError, "not a cache key"};
+  if (!data.exit_status.is_a<ExitStatus::Exited>()) {
+    return PopenError{PopenError::LogicError, "only results of commands that exited are cached"};
+  }
+  EntryHeader header{};
+  ::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+  header.exit_code = data.exit_status.get<ExitStatus::Exited>().code;
+  header.stdout_len = data.stdout.size();
+  header.stderr_len = data.stderr.size();
+
+  // written aside and renamed into place, so readers never see part of it
+  std::string tmp = _directory + "/tmp.XXXXXX";
+  int fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+  if (fd < 0) return PopenError{PopenError::IoError, "mkstemp() cache entry", errno};
+  bool ok = write_all(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+            write_all(fd, data.stdout.data(), data.stdout.size()) &&
+            write_all(fd, data.stderr.data(), data.stderr.size());
+  int write_errno = errno;
+  ::close(fd);
+  if (!ok || ::rename(tmp.c_str(), (_directory + "/" + key).c_str()) != 0) {
+    if (ok) write_errno = errno;
+    ::unlink(tmp.c_str());
+    return PopenError{PopenError::IoError, "write() cache entry", write_errno};
+  }
+
+  _total_bytes += sizeof(header) + data.stdout.size() + data.stderr.size();
+  if (_total_bytes > _options.max_bytes) evict();
+  return std::nullopt;
+}
+
+void ResultCache::evict() {
+  DIR* dir = ::opendir(_directory.c_str());
+  if (dir == nullptr) return;
+  struct Entry {
+    struct timespec used;
+    uint64_t size;
+    std::string name;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  while (auto entry = ::readdir(dir)) {
+    struct stat st;
+    if (is_key(entry->d_name) && ::fstatat(::dirfd(dir), entry->d_name, &st, 0) == 0) {
+      entries.push_back({ st.st_mtim, static_cast<uint64_t>(st.st_size), entry->d_name });
+      total += static_cast<uint64_t>(st.st_size);
+    }
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+  });
+  for (const auto& entry : entries) {
+    if (total <= _options.max_bytes) break;
+    if (::unlinkat(::dirfd(dir), entry.name.c_str(), 0) == 0) {
+      total -= entry.size;
+      _stats.evictions++;
+    }
+  }
+  ::closedir(dir);
+  _total_bytes = total;
+}
+
+Result<CaptureData> ResultCache::run(const std::vector<std::string>& argv, PopenConfig config,
+                                     const std::string& input, const std::vector<std::string>& input_files) {
+  auto keyR = key(argv, config, input, input_files);
+  if (!keyR.ok()) return keyR.take_error();
+  auto digest = keyR.take_value();
+  if (auto cached = lookup(digest)) return std::move(*cached);
+
+  config.stdin = Redirection::Pipe();
+  config.stdout = Redirection::Pipe();
+  config.stderr = Redirection::Pipe();
+  auto popen = Popen::create(argv, config);
+  if (!popen.ok()) return popen.take_error();
+  auto child = popen.take_value();
+  auto data = child.communicate(input);
+  if (!data.ok()) return data.take_error();
+  auto result = data.take_value();
+  // a command that was killed, or whose result cannot be stored, is simply
+  // run again next time
+  if (result.exit_status.is_a<ExitStatus::Exited>()) store(digest, result);
+  return result;
+}
@@ -0,0 +1,173 @@
+#include "subprocess/SpawnGovernor.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  // how long a reading of pids.current and memory.pressure stays valid
+  constexpr auto pressure_interval = 100ms;
+
+  std::optional<std::string> read_small_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    char buf[512];
+    ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+    ::close(fd);
+    if (n <= 0) return std::nullopt;
+    return std::string(buf, static_cast<size_t>(n));
+  }
+
+  // Whether the cgroup is within `headroom` of its pids.max.
+  bool near_pids_max(const std::string& cgroup, uint64_t headroom) {
+    auto max = read_small_file(cgroup + "/pids.max");
+    auto current = read_small_file(cgroup + "/pids.current");
+    if (!max.has_value() || !current.has_value() || max->compare(0, 3, "max") == 0) return false;
+    uint64_t limit = ::strtoull(max->c_str(), nullptr, 10);
+    uint64_t used = ::strtoull(current->c_str(), nullptr, 10);
+    return used + headroom >= limit;
+  }
+
+  // The "some avg10" figure of a PSI file: the percentage of the last ten
+  // seconds in which some task was stalled waiting for memory.
+  std::optional<double> memory_pressure(const std::string& cgroup) {
+    auto psi = read_small_file(cgroup + "/memory.pressure");
+    if (!psi.has_value()) return std::nullopt;
+    auto pos = psi->find("some avg10=");
+    if (pos == std::string::npos) return std::nullopt;
+    return ::strtod(psi->c_str() + pos + 11, nullptr);
+  }
+}  // namespace
+
+SpawnGovernor::SpawnGovernor()
+: SpawnGovernor{Options{}}
+{ }
+
+SpawnGovernor::SpawnGovernor(Options options)
+: _options{std::move(options)}
+, _tokens{static_cast<double>(_options.burst)}
+, _refilled{std::chrono::steady_clock::now()}
+, _random{std::random_device{}()}
+{ }
+
+void SpawnGovernor::prune() {
+  _live.erase(std::remove_if(_live.begin(), _live.end(), [](pid_t pid) {
+    siginfo_t info = {};
+    // WNOWAIT: the child is its Popen's to reap. An error (ECHILD) means
+    // it has been reaped already.
+    return ::waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+           info.si_pid != 0;
+  }), _live.end());
+}
+
+const char* SpawnGovernor::admit(std::chrono::steady_clock::time_point now, std::chrono::nanoseconds& wait_hint) {
+  // spawns admitted but not yet created count against the limit too
+  if (_options.max_live > 0 && _live.size() + _pending >= _options.max_live) {
+    // only worth a look when at the limit
+    prune();
+    if (_live.size() + _pending >= _options.max_live) return "spawn governor: too many live children";
+  }
+
+  if (_options.max_spawns_per_second > 0) {
+    std::chrono::duration<double> elapsed = now - _refilled;
+    _tokens = std::min(static_cast<double>(_options.burst),
+                       _tokens + elapsed.count() * _options.max_spawns_per_second);
+    _refilled = now;
+    if (_tokens < 1) {
+      std::chrono::duration<double> until_next{ (1 - _tokens) / _options.max_spawns_per_second };
+      wait_hint = std::chrono::duration_cast<std::chrono::nanoseconds>(until_next);
+      return "spawn governor: spawn rate limit";
+    }
+  }
+
+  if (_options.cgroup.has_value() && now - _pressure_checked >= pressure_interval) {
+    _pressure_checked = now;
+    _pressure_reason = nullptr;
+    if (near_pids_max(*_options.cgroup, _options.pids_headroom)) {
+      _pressure_reason = "spawn governor: cgroup near pids.max";
+    } else if (_options.max_memory_pressure > 0 &&
+               memory_pressure(*_options.cgroup).value_or(0) > _options.max_memory_pressure) {
+      _pressure_reason = "spawn governor: memory pressure";
+    }
+  }
+  if (_pressure_reason != nullptr) return _pressure_reason;
+
+  if (_options.max_spawns_per_second > 0) _tokens -= 1;
+  _pending++;
+  return nullptr;
+}
+
+std::chrono::nanoseconds SpawnGovernor::jitter(std::chrono::nanoseconds limit) {
+  // "full jitter": anywhere between nothing and the limit
+  std::uniform_int_distribution<int64_t> pick{ 0, limit.count() };
+  return std::chrono::nanoseconds{ pick(_random) };
+}
+
+Result<Popen> SpawnGovernor::spawn(const std::vector<std::string>& argv, const PopenConfig& cfg) {
+  return spawn(argv, cfg, std::chrono::steady_clock::now() + _options.queue_timeout);
+}
+
+Result<Popen> SpawnGovernor::spawn(const std::vector<std::string>& argv, const PopenConfig& cfg,
+                                   std::chrono::steady_clock::time_point deadline) {
+  std::chrono::nanoseconds backoff = _options.min_backoff;
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds wait_hint{ 0 };
+    const char* refusal;
+    {
+      std::lock_guard<std::mutex> lock{ _mutex };
+      refusal = admit(now, wait_hint);
+    }
+
+    if (refusal == nullptr) {
+      auto res = Popen::create(argv, cfg);
+      std::lock_guard<std::mutex> lock{ _mutex };
+      _pending--;
+      if (res.ok()) {
+        auto child = res.take_value();
+        _live.push_back(*child.pid());
+        _stats.spawned++;
+        return Result<Popen>{ std::move(child) };
+      }
+      auto err = res.take_error();
+      if (err.kind != PopenError::Overloaded) return err;
+      if (now >= deadline) {
+        _stats.rejected++;
+        return err;
+      }
+      _stats.retries++;
+    } else if (now >= deadline) {
+      std::lock_guard<std::mutex> lock{ _mutex };
+      _stats.rejected++;
+      return PopenError{PopenError::Overloaded, refusal};
+    }
+
+    std::chrono::nanoseconds wait;
+    {
+      std::lock_guard<std::mutex> lock{ _mutex };
+      wait = wait_hint.count() > 0 ? wait_hint + jitter(_options.min_backoff) : jitter(backoff);
+    }
+    backoff = std::min<std::chrono::nanoseconds>(backoff * 2, _options.max_backoff);
+    std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(wait, deadline - now));
+  }
+}
+
+size_t SpawnGovernor::live() {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  prune();
+  return _live.size();
+}
+
+SpawnGovernor::Stats SpawnGovernor::stats() const {
+  std::lock_guard<std::mutex> lock{ _mutex };
+  return _stats;
+}
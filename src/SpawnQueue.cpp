@@ -0,0 +1,143 @@
+#include "subprocess/SpawnQueue.hpp"
+
+#include <algorithm>
+
+using namespace subprocess;
+
+SpawnQueue::SpawnQueue(Handlers handlers)
+: SpawnQueue(std::move(handlers), Options{})
+{ }
+
+SpawnQueue::SpawnQueue(Handlers handlers, Options options)
+: _handlers{std::move(handlers)}
+, _options{options}
+{ }
+
+// `_waits` goes first, then each Popen in `_running` closes its pipes and
+// waits for its child.
+SpawnQueue::~SpawnQueue() = default;
+
+uint32_t SpawnQueue::tenant_index(const std::string& tenant) {
+  auto found = _tenant_ids.find(tenant);
+  if (found != _tenant_ids.end()) return found->second;
+  auto index = static_cast<uint32_t>(_tenants.size());
+  _tenants.emplace_back();
+  _tenant_ids.emplace(tenant, index);
+  return index;
+}
+
+void SpawnQueue::set_tenant(const std::string& tenant, TenantOptions options) {
+  options.weight = std::max<uint32_t>(options.weight, 1);
+  _tenants[tenant_index(tenant)].options = options;
+}
+
+SpawnQueue::JobId SpawnQueue::submit(const std::string& tenant, std::vector<std::string> argv, PopenConfig cfg,
+                                     Priority priority) {
+  uint32_t index = tenant_index(tenant);
+  Tenant& t = _tenants[index];
+  if (t.stats.queued == 0) {
+    // no credit for the time it had nothing to run
+    t.tag = std::max(t.tag, _vclock);
+    _active.push_back(index);
+  }
+  JobId id = _next_id++;
+  t.queues[static_cast<size_t>(priority)].push_back(Job{ id, std::move(argv), std::move(cfg), Clock::now() });
+  t.stats.submitted++;
+  t.stats.queued++;
+  _queued++;
+  return id;
+}
+
+size_t SpawnQueue::dispatch() {
+  size_t started = 0;
+  while (_options.max_running == 0 || _running.size() < _options.max_running) {
+    // the highest class waiting, then the lowest tag
+    size_t best = _active.size();
+    size_t best_class = priorities;
+    for (size_t i = 0; i < _active.size(); i++) {
+      const Tenant& t = _tenants[_active[i]];
+      if (t.options.max_running != 0 && t.stats.running >= t.options.max_running) continue;
+      size_t c = 0;
+      while (t.queues[c].empty()) c++;
+      if (c < best_class || (c == best_class && t.tag < _tenants[_active[best]].tag)) {
+        best = i;
+        best_class = c;
+      }
+    }
+    if (best == _active.size()) break;
+
+    uint32_t index = _active[best];
+    Tenant& t = _tenants[index];
+    Job job = std::move(t.queues[best_class].front());
+    t.queues[best_class].pop_front();
+    t.stats.queued--;
+    _queued--;
+    if (t.stats.queued == 0) {
+      _active[best] = _active.back();
+      _active.pop_back();
+    }
+    _vclock = t.tag;
+    t.tag += 1.0 / t.options.weight;
+    start(index, std::move(job));
+    started++;
+  }
+  return started;
+}
+
+void SpawnQueue::start(uint32_t tenant, Job job) {
+  auto now = Clock::now();
+  TenantStats& stats = _tenants[tenant].stats;
+  auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(now - job.submitted);
+  stats.queue_wait += wait;
+  stats.max_queue_wait = std::max(stats.max_queue_wait, wait);
+
+  auto popen = Popen::create(job.argv, job.cfg);
+  if (!popen.ok()) {
+    stats.failed++;
+    auto error = popen.take_error();
+    if (_handlers.on_error) _handlers.on_error(job.id, error);
+    return;
+  }
+  stats.started++;
+  stats.running++;
+  auto child = std::make_unique<Popen>(popen.take_value());
+  Popen* key = child.get();
+  _running.emplace(key, Running{ job.id, tenant, now, std::move(child) });
+  _waits.add(*key);
+}
+
+void SpawnQueue::finish(Popen* popen) {
+  auto found = _running.find(popen);
+  if (found == _running.end()) return;
+  Running running = std::move(found->second);
+  _running.erase(found);
+  TenantStats& stats = _tenants[running.tenant].stats;
+  stats.running--;
+  stats.finished++;
+  stats.run_time += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - running.started);
+  if (_handlers.on_exit) _handlers.on_exit(running.id, *running.popen);
+}
+
+Result<size_t> SpawnQueue::run_once(std::optional<Clock::time_point> deadline) {
+  dispatch();
+  if (_running.empty()) return size_t{ 0 };
+  auto found = _waits.wait_any(deadline);
+  if (!found.ok()) return found.take_error();
+  for (Popen* popen : _waits.finished()) finish(popen);
+  dispatch();
+  return found.take_value();
+}
+
+std::optional<PopenError> SpawnQueue::run() {
+  while (_queued > 0 || !_running.empty()) {
+    auto res = run_once();
+    if (!res.ok()) return res.take_error();
+  }
+  return std::nullopt;
+}
+
+std::optional<SpawnQueue::TenantStats> SpawnQueue::stats(const std::string& tenant) const {
+  auto found = _tenant_ids.find(tenant);
+  if (found == _tenant_ids.end()) return std::nullopt;
+  return _tenants[found->second].stats;
+}
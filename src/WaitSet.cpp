@@ -0,0 +1,165 @@
+#include "subprocess/WaitSet.hpp"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "subprocess/posix.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  // pidfds reported per epoll_wait() call
+  constexpr size_t max_events = 256;
+}
+
+WaitSet::WaitSet()
+: _epoll_fd{::epoll_create1(EPOLL_CLOEXEC)}
+, _events(max_events)
+{
+  if (_epoll_fd < 0) panic("epoll_create1() failed");
+}
+
+WaitSet::~WaitSet() {
+  for (const auto& entry : _entries) {
+    if (entry.pidfd >= 0) ::close(entry.pidfd);
+  }
+  ::close(_epoll_fd);
+}
+
+std::optional<PopenError> WaitSet::add(Popen& popen) {
+  if (_slots.count(&popen) != 0) {
+    return PopenError{PopenError::LogicError, "WaitSet::add: already in the set"};
+  }
+  uint32_t slot;
+  if (!_free_slots.empty()) {
+    slot = _free_slots.back();
+    _free_slots.pop_back();
+  } else {
+    slot = static_cast<uint32_t>(_entries.size());
+    _entries.emplace_back();
+  }
+  Entry& entry = _entries[slot];
+  entry.popen = &popen;
+  _slots[&popen] = slot;
+
+  auto pid = popen.pid();
+  if (!pid.has_value()) {
+    _ready.push_back(slot);
+    return std::nullopt;
+  }
+  entry.pidfd = pidfd_open(*pid);
+  if (entry.pidfd >= 0) {
+    set_inheritable(entry.pidfd, false);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = slot;
+    if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, entry.pidfd, &ev) == 0) return std::nullopt;
+    ::close(entry.pidfd);
+    entry.pidfd = -1;
+  }
+  _polled.push_back(slot);
+  return std::nullopt;
+}
+
+void WaitSet::remove(Popen& popen) {
+  auto found = _slots.find(&popen);
+  if (found == _slots.end()) return;
+  uint32_t slot = found->second;
+  _polled.erase(std::remove(_polled.begin(), _polled.end(), slot), _polled.end());
+  _ready.erase(std::remove(_ready.begin(), _ready.end(), slot), _ready.end());
+  forget(slot);
+}
+
+void WaitSet::forget(uint32_t slot) {
+  Entry& entry = _entries[slot];
+  if (entry.pidfd >= 0) {
+    ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, entry.pidfd, nullptr);
+    ::close(entry.pidfd);
+  }
+  _slots.erase(entry.popen);
+  entry = Entry{};
+  _free_slots.push_back(slot);
+}
+
+void WaitSet::report(uint32_t slot) {
+  _finished.push_back(_entries[slot].popen);
+  forget(slot);
+}
+
+Result<size_t> WaitSet::collect(std::optional<Clock::time_point> deadline) {
+  size_t before = _finished.size();
+  // double the polling delay at every round, maxing at 100ms
+  auto delay = 1ms;
+  while (true) {
+    for (auto slot : _ready) report(slot);
+    _ready.clear();
+
+    if (!_polled.empty()) {
+      siginfo_t info = {};
+      // WNOWAIT: leave the child for its Popen to reap
+      bool any_exited = ::waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid != 0;
+      auto polled = std::move(_polled);
+      _polled.clear();
+      for (auto slot : polled) {
+        Popen* popen = _entries[slot].popen;
+        // one reaped by another thread is no longer waiting, but has its status
+        if (any_exited ? popen->poll().has_value() : popen->exit_status().has_value()) {
+          report(slot);
+        } else {
+          _polled.push_back(slot);
+        }
+      }
+    }
+    if (_slots.empty()) return _finished.size() - before;
+
+    int timeout_ms = -1;
+    if (_finished.size() > before) {
+      timeout_ms = 0;
+    } else if (deadline.has_value()) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(*deadline - Clock::now());
+      timeout_ms = static_cast<int>(std::max<int64_t>(left.count(), 0));
+    }
+    if (!_polled.empty()) {
+      auto poll_ms = static_cast<int>(delay.count());
+      timeout_ms = timeout_ms < 0 ? poll_ms : std::min(timeout_ms, poll_ms);
+    }
+
+    int n = ::epoll_wait(_epoll_fd, _events.data(), static_cast<int>(_events.size()), timeout_ms);
+    if (n < 0 && errno != EINTR) return PopenError{PopenError::IoError, "epoll_wait()", errno};
+    for (int i = 0; i < n; i++) {
+      auto slot = static_cast<uint32_t>(_events[static_cast<size_t>(i)].data.u64);
+      Popen* popen = _entries[slot].popen;
+      // it has exited, so this does not block for long; a failed exec is
+      // an error there, but the child has still finished
+      auto res = popen->wait();
+      if (!res.ok() && !popen->exit_status().has_value()) return res.take_error();
+      report(slot);
+    }
+
+    size_t found = _finished.size() - before;
+    if (found > 0) return found;
+    if (deadline.has_value() && Clock::now() >= *deadline) return size_t{ 0 };
+    delay = std::min<std::chrono::milliseconds>({delay * 2, 100ms});
+  }
+}
+
+Result<size_t> WaitSet::wait_any(std::optional<Clock::time_point> deadline) {
+  _finished.clear();
+  return collect(deadline);
+}
+
+Result<size_t> WaitSet::wait_all(std::optional<Clock::time_point> deadline) {
+  _finished.clear();
+  while (!_slots.empty()) {
+    auto found = collect(deadline);
+    if (!found.ok()) return found.take_error();
+    // nothing before the deadline
+    if (found.take_value() == 0) break;
+  }
+  return _finished.size();
+}
@@ -1,5 +1,8 @@
 #include "subprocess/posix.hpp"
 
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
@@ -9,8 +12,11 @@ namespace subprocess {
 
 Result<std::tuple<int, int>> pipe() {
   int pipe_fds[2];
-  if (::pipe(pipe_fds) != 0) {
-    return PopenError{PopenError::ErrKind::IoError, std::string("pipe(): ") + std::to_string(errno) + std::string(" ") + strerror(errno)};
+  // Both ends are created close-on-exec, so that children spawned
+  // concurrently from other threads cannot inherit them. The ends meant
+  // for our own child become inheritable when dup2()ed into place.
+  if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+    return PopenError{PopenError::ErrKind::IoError, "pipe()", errno};
   }
   return std::make_tuple(pipe_fds[0], pipe_fds[1]);
 }
@@ -20,6 +26,59 @@ void set_inheritable(int fd, bool heritable) {
   fcntl(fd, F_SETFD, heritable ? (curr & ~FD_CLOEXEC) : (curr | FD_CLOEXEC));
 }
 
+void set_nonblocking(int fd, bool nonblocking) {
+  int curr = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, nonblocking ? (curr | O_NONBLOCK) : (curr & ~O_NONBLOCK));
+}
+
+int pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// std::atomic<uint32_t> is a plain uint32_t underneath, as futex() needs
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void futex_wake_all(std::atomic<uint32_t>& word) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+pid_t fork_into_cgroup(int cgroup_fd) {
+#ifdef SYS_clone3
+  // struct clone_args from linux/sched.h, up to `cgroup` (CLONE_ARGS_SIZE_VER2)
+  struct {
+    uint64_t flags, pidfd, child_tid, parent_tid, exit_signal, stack, stack_size, tls;
+    uint64_t set_tid, set_tid_size, cgroup;
+  } args = {};
+  args.flags = 0x200000000ULL;  // CLONE_INTO_CGROUP
+  args.exit_signal = SIGCHLD;
+  args.cgroup = static_cast<uint64_t>(cgroup_fd);
+  return static_cast<pid_t>(::syscall(SYS_clone3, &args, sizeof(args)));
+#else
+  (void)cgroup_fd;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int32_t join_cgroup(int cgroup_fd) {
+  int fd = ::openat(cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return errno;
+  // "0" is the writing process
+  int32_t err = ::write(fd, "0", 1) == 1 ? 0 : errno;
+  ::close(fd);
+  return err;
+}
+
 ExitStatus decode_exit_status(int status) {
   if (WIFEXITED(status)) {
     return ExitStatus::Exited{WEXITSTATUS(status)};
@@ -62,4 +121,31 @@ int32_t reset_sigpipe() {
   return 0;
 }
 
+SigpipeBlock::SigpipeBlock() {
+  sigset_t pending;
+  ::sigpending(&pending);
+  _was_pending = ::sigismember(&pending, SIGPIPE) == 1;
+  sigset_t set, old;
+  ::sigemptyset(&set);
+  ::sigaddset(&set, SIGPIPE);
+  ::pthread_sigmask(SIG_BLOCK, &set, &old);
+  _was_blocked = ::sigismember(&old, SIGPIPE) == 1;
+}
+
+SigpipeBlock::~SigpipeBlock() {
+  sigset_t set;
+  ::sigemptyset(&set);
+  ::sigaddset(&set, SIGPIPE);
+  if (!_was_pending) {
+    sigset_t pending;
+    ::sigpending(&pending);
+    if (::sigismember(&pending, SIGPIPE) == 1) {
+      // ours, from an EPIPE write: take it before it can be delivered
+      struct timespec zero = {};
+      while (::sigtimedwait(&set, nullptr, &zero) < 0 && errno == EINTR) {}
+    }
+  }
+  if (!_was_blocked) ::pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+}
+
 }
\ No newline at end of file
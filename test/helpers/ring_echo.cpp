@@ -0,0 +1,26 @@
+// Child side of the Redirection::SharedRing tests: copy everything from the
+// STDIN ring to the STDOUT ring until end of file.
+#include <stdio.h>
+
+#include <vector>
+
+#include "subprocess/RingChannel.hpp"
+
+using subprocess::RingChannel;
+
+int main() {
+  auto in = RingChannel::from_env("STDIN");
+  auto out = RingChannel::from_env("STDOUT");
+  if (!in.has_value() || !out.has_value()) {
+    perror("ring_echo: RingChannel::from_env");
+    return 2;
+  }
+  std::vector<char> buf(64 * 1024);
+  while (true) {
+    auto got = in->read(buf.data(), buf.size());
+    if (got.status != boost::io_status::ok) break;
+    auto put = out->write(buf.data(), got.count);
+    if (put.status != boost::io_status::ok) return 3;
+  }
+  return 0;
+}
@@ -0,0 +1,312 @@
+// Spawn soak harness.
+//
+// Spawns children concurrently from many threads, mixing redirection
+// layouts and early destruction, while periodically sampling the number of
+// open file descriptors, the number of zombie children, and the latency of
+// `Popen::create`. Exits non-zero if a leak or a latency regression past the
+// configured thresholds is detected.
+//
+// Run with --help for the list of knobs.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+
+using namespace subprocess;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+  struct Options {
+    unsigned threads = 16;
+    uint64_t spawns = 20000;           // total, across all threads
+    double duration_s = 0;             // if > 0, run for this long instead of a spawn count
+    double report_interval_s = 5;
+    long max_fd_growth = 0;            // allowed fds above baseline once everything is reaped
+    long max_zombies = 0;              // allowed zombies once everything is reaped
+    double max_p99_ms = 250;
+    double max_p999_ms = 1000;
+  };
+
+  void usage(const char* argv0) {
+    std::printf(
+      "usage: %s [options]\n"
+      "  --threads N            spawning threads (default 16)\n"
+      "  --spawns N             total children to spawn (default 20000)\n"
+      "  --duration SECONDS     run for a fixed time instead of --spawns\n"
+      "  --report-interval S    seconds between progress reports (default 5)\n"
+      "  --max-fd-growth N      fds allowed above baseline at the end (default 0)\n"
+      "  --max-zombies N        zombies allowed at the end (default 0)\n"
+      "  --max-p99-ms MS        spawn latency p99 threshold (default 250)\n"
+      "  --max-p999-ms MS       spawn latency p99.9 threshold (default 1000)\n",
+      argv0);
+  }
+
+  bool parse(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--help" || arg == "-h") return false;
+      if (i + 1 >= argc) {
+        std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+        return false;
+      }
+      const char* val = argv[++i];
+      if (arg == "--threads") opts.threads = static_cast<unsigned>(std::stoul(val));
+      else if (arg == "--spawns") opts.spawns = std::stoull(val);
+      else if (arg == "--duration") opts.duration_s = std::stod(val);
+      else if (arg == "--report-interval") opts.report_interval_s = std::stod(val);
+      else if (arg == "--max-fd-growth") opts.max_fd_growth = std::stol(val);
+      else if (arg == "--max-zombies") opts.max_zombies = std::stol(val);
+      else if (arg == "--max-p99-ms") opts.max_p99_ms = std::stod(val);
+      else if (arg == "--max-p999-ms") opts.max_p999_ms = std::stod(val);
+      else {
+        std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+        return false;
+      }
+    }
+    return opts.threads > 0;
+  }
+
+  long count_open_fds() {
+    long count = 0;
+    DIR* dir = ::opendir("/proc/self/fd");
+    if (dir == nullptr) return -1;
+    while (struct dirent* entry = ::readdir(dir)) {
+      if (entry->d_name[0] != '.') count++;
+    }
+    ::closedir(dir);
+    return count - 1;  // the fd opendir() itself holds
+  }
+
+  // Zombies are children of ours in state 'Z' in /proc/<pid>/stat.
+  long count_zombies() {
+    const pid_t self = ::getpid();
+    long count = 0;
+    DIR* dir = ::opendir("/proc");
+    if (dir == nullptr) return -1;
+    while (struct dirent* entry = ::readdir(dir)) {
+      if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+      std::ifstream stat(std::string("/proc/") + entry->d_name + "/stat");
+      std::string line;
+      if (!std::getline(stat, line)) continue;
+      // "pid (comm) state ppid ..." -- comm may contain spaces and parens
+      auto close_paren = line.rfind(')');
+      if (close_paren == std::string::npos) continue;
+      std::istringstream rest(line.substr(close_paren + 1));
+      char state = 0;
+      pid_t ppid = 0;
+      rest >> state >> ppid;
+      if (state == 'Z' && ppid == self) count++;
+    }
+    ::closedir(dir);
+    return count;
+  }
+
+  double percentile_ms(std::vector<double>& samples, double pct) {
+    if (samples.empty()) return 0;
+    auto rank = static_cast<size_t>(pct / 100.0 * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<long>(rank), samples.end());
+    return samples[rank];
+  }
+
+  struct Latencies {
+    std::mutex mutex;
+    std::vector<double> window;
+    std::vector<double> all;
+
+    void record(double ms) {
+      std::lock_guard<std::mutex> lock(mutex);
+      window.push_back(ms);
+      all.push_back(ms);
+    }
+    std::vector<double> take_window() {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::vector<double> out;
+      out.swap(window);
+      return out;
+    }
+  };
+
+  enum class Shape { Pipes, FileDescriptor, Merge, EarlyDestroy, Count };
+
+  // Spawn one child in the given shape and see it through to the end.
+  // Returns false on an unexpected failure.
+  bool run_one(Shape shape, int dev_null, Latencies& latencies) {
+    PopenConfig cfg;
+    std::vector<std::string> argv;
+    switch (shape) {
+      case Shape::Pipes:
+        cfg.stdin = Redirection::Pipe();
+        cfg.stdout = Redirection::Pipe();
+        cfg.stderr = Redirection::Pipe();
+        argv = { "cat" };
+        break;
+      case Shape::FileDescriptor:
+        cfg.stdout = Redirection::FileDescriptor(::dup(dev_null));
+        argv = { "echo", "soak" };
+        break;
+      case Shape::Merge:
+        cfg.stdout = Redirection::Pipe();
+        cfg.stderr = Redirection::Merge();
+        argv = { "sh", "-c", "echo out; echo err >&2" };
+        break;
+      case Shape::EarlyDestroy:
+        cfg.stdin = Redirection::Pipe();
+        cfg.stdout = Redirection::Pipe();
+        argv = { "cat" };
+        break;
+      case Shape::Count: return false;
+    }
+
+    auto start = Clock::now();
+    auto created = Popen::create(argv, cfg);
+    latencies.record(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    if (!created.ok()) {
+      std::fprintf(stderr, "spawn failed: %s\n", created.take_error().message().c_str());
+      return false;
+    }
+    auto child = created.take_value();
+
+    switch (shape) {
+      case Shape::Pipes: {
+        *child.std_in << "soak\n";
+        child.std_in->close();
+        std::string line;
+        std::getline(*child.std_out, line);
+        if (line != "soak") return false;
+        break;
+      }
+      case Shape::Merge: {
+        std::string output = child.std_out->slurp();
+        if (output.find("out") == std::string::npos || output.find("err") == std::string::npos)
+          return false;
+        break;
+      }
+      case Shape::EarlyDestroy:
+        // let the destructor close the pipes and reap `cat`
+        return true;
+      case Shape::FileDescriptor:
+      case Shape::Count: break;
+    }
+    auto status = child.wait();
+    return status.ok() && status.take_value().success();
+  }
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!parse(argc, argv, opts)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  const int dev_null = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+  const long baseline_fds = count_open_fds();
+  const long baseline_zombies = count_zombies();
+  // each in-flight spawn holds at most a handful of fds at once
+  const long max_in_flight_fds = baseline_fds + static_cast<long>(opts.threads) * 16;
+
+  Latencies latencies;
+  std::atomic<uint64_t> issued{ 0 };
+  std::atomic<uint64_t> completed{ 0 };
+  std::atomic<uint64_t> failures{ 0 };
+  std::atomic<bool> stop{ false };
+  const auto started = Clock::now();
+  const auto run_until = started + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(opts.duration_s));
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < opts.threads; t++) {
+    workers.emplace_back([&, t] {
+      uint64_t n = t;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (opts.duration_s > 0) {
+          if (Clock::now() >= run_until) break;
+        } else if (issued.fetch_add(1) >= opts.spawns) {
+          break;
+        }
+        auto shape = static_cast<Shape>(n++ % static_cast<uint64_t>(Shape::Count));
+        if (!run_one(shape, dev_null, latencies)) failures++;
+        completed++;
+      }
+    });
+  }
+
+  bool failed = false;
+  std::thread reporter([&] {
+    auto next = Clock::now();
+    while (!stop.load()) {
+      next += std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(opts.report_interval_s));
+      while (!stop.load() && Clock::now() < next) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+      auto window = latencies.take_window();
+      long fds = count_open_fds();
+      long zombies = count_zombies();
+      double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+      std::printf(
+        "[%8.1fs] spawned=%llu fds=%ld zombies=%ld p50=%.2fms p99=%.2fms p999=%.2fms\n", elapsed,
+        static_cast<unsigned long long>(completed.load()), fds, zombies,
+        percentile_ms(window, 50), percentile_ms(window, 99), percentile_ms(window, 99.9));
+      std::fflush(stdout);
+      if (fds > max_in_flight_fds) {
+        std::fprintf(stderr, "fd count %ld exceeds in-flight bound %ld\n", fds, max_in_flight_fds);
+        failed = true;
+      }
+    }
+  });
+
+  for (auto& w : workers) w.join();
+  stop = true;
+  reporter.join();
+
+  const long final_fds = count_open_fds();
+  const long final_zombies = count_zombies() - baseline_zombies;
+  const double p99 = percentile_ms(latencies.all, 99);
+  const double p999 = percentile_ms(latencies.all, 99.9);
+  std::printf(
+    "done: spawned=%llu failures=%llu fds=%ld (baseline %ld) zombies=%ld p99=%.2fms "
+    "p999=%.2fms\n",
+    static_cast<unsigned long long>(completed.load()),
+    static_cast<unsigned long long>(failures.load()), final_fds, baseline_fds, final_zombies, p99,
+    p999);
+
+  if (failures.load() > 0) {
+    std::fprintf(stderr, "FAIL: %llu children did not run as expected\n",
+                 static_cast<unsigned long long>(failures.load()));
+    failed = true;
+  }
+  if (final_fds - baseline_fds > opts.max_fd_growth) {
+    std::fprintf(stderr, "FAIL: leaked %ld file descriptors\n", final_fds - baseline_fds);
+    failed = true;
+  }
+  if (final_zombies > opts.max_zombies) {
+    std::fprintf(stderr, "FAIL: %ld zombie children left behind\n", final_zombies);
+    failed = true;
+  }
+  if (p99 > opts.max_p99_ms) {
+    std::fprintf(stderr, "FAIL: p99 spawn latency %.2fms > %.2fms\n", p99, opts.max_p99_ms);
+    failed = true;
+  }
+  if (p999 > opts.max_p999_ms) {
+    std::fprintf(stderr, "FAIL: p99.9 spawn latency %.2fms > %.2fms\n", p999, opts.max_p999_ms);
+    failed = true;
+  }
+  ::close(dev_null);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+#include <catch2/catch.hpp>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+
+using namespace subprocess;
+
+// Replace the global allocation functions so that allocations can be
+// counted while `counting` is set. This applies to the whole test binary,
+// but only ever counts inside `count_allocations`.
+namespace {
+  std::atomic<bool> counting{ false };
+  std::atomic<size_t> allocations{ 0 };
+  // Allocations in a forked child, before it execs: shared, so that the
+  // parent sees them.
+  std::atomic<size_t>* child_allocations{ nullptr };
+  pid_t counting_pid{ -1 };
+
+  void* counted_malloc(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+      if (::getpid() == counting_pid) {
+        allocations++;
+      } else {
+        (*child_allocations)++;
+      }
+    }
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+  }
+
+  template<typename F>
+  size_t count_allocations(F&& f) {
+    if (child_allocations == nullptr) {
+      void* mem = ::mmap(nullptr, sizeof(std::atomic<size_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                         -1, 0);
+      if (mem == MAP_FAILED) std::abort();
+      child_allocations = new (mem) std::atomic<size_t>{ 0 };
+    }
+    counting_pid = ::getpid();
+    allocations = 0;
+    *child_allocations = 0;
+    counting = true;
+    f();
+    counting = false;
+    return allocations.load();
+  }
+
+  // `count_allocations` on a new thread, so that the spawn path starts
+  // without this thread's scratch buffers, whatever ran before.
+  template<typename F>
+  size_t count_on_fresh_thread(F&& f) {
+    size_t count = 0;
+    std::thread{ [&] { count = count_allocations(f); } }.join();
+    return count;
+  }
+}  // namespace
+
+void* operator new(std::size_t size) { return counted_malloc(size); }
+void* operator new[](std::size_t size) { return counted_malloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+TEST_CASE("allocations on the spawn path") {
+  const std::vector<std::string> argv{ "true" };
+
+  SECTION("create and wait for an absolute executable") {
+    PopenConfig config;
+    config.executable = "/bin/true";
+    bool success = false;
+    size_t count = count_on_fresh_thread([&] {
+      auto child = Popen::create(argv, config).or_throw();
+      success = child.wait().or_throw().success();
+    });
+    REQUIRE(success);
+    // PrepExec: the argv buffer and its pointer array, plus the buffer the
+    // executable path is assembled in (the path itself fits in SSO). The
+    // first spawn on a thread also creates its scratch, whose argv and env
+    // start with a pointer array each; later spawns reuse all of these.
+    REQUIRE(count == 5);
+  }
+
+  SECTION("create and wait with a PATH lookup") {
+    bool success = false;
+    size_t count = count_on_fresh_thread([&] {
+      auto child = Popen::create(argv, PopenConfig{}).or_throw();
+      success = child.wait().or_throw().success();
+    });
+    REQUIRE(success);
+    // as above, plus a private copy of $PATH
+    REQUIRE(count == 6);
+  }
+
+  SECTION("spawning again on the same thread reuses the buffers") {
+    PopenConfig config;
+    config.env = std::vector<EnvVar>{ { "A", "1" }, { "B", "2" } };
+    Popen::create({ "true", "a longer argument than fits in SSO" }, config).or_throw().wait().or_throw();
+    bool success = false;
+    size_t count = count_allocations([&] {
+      auto child = Popen::create(argv, config).or_throw();
+      success = child.wait().or_throw().success();
+    });
+    REQUIRE(success);
+    REQUIRE(count == 0);
+  }
+
+  SECTION("the child does not allocate for a long cwd") {
+    PopenConfig config;
+    config.executable = "/bin/true";
+    // well past the small string buffer
+    config.cwd = "/tmp/./././././././././././././././././././././././.";
+    bool success = false;
+    count_allocations([&] {
+      auto child = Popen::create(argv, config).or_throw();
+      success = child.wait().or_throw().success();
+    });
+    REQUIRE(success);
+    REQUIRE(child_allocations->load() == 0);
+  }
+
+  SECTION("errors do not allocate until formatted") {
+    const std::vector<std::string> no_args;
+    const PopenConfig config;
+    std::optional<PopenError> err;
+    size_t count = count_allocations([&] {
+      auto res = Popen::create(no_args, config);
+      if (!res.ok()) err = res.take_error();
+    });
+    REQUIRE(count == 0);
+    REQUIRE(err.has_value());
+    REQUIRE(err->kind == PopenError::LogicError);
+  }
+}
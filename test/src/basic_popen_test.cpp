@@ -0,0 +1,37 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include "subprocess/BasicPopen.hpp"
+
+using namespace subprocess;
+
+TEST_CASE("BasicPopen") {
+  SECTION("stderr merged into a stdout pipe") {
+    using Capture = BasicPopen<policy::Inherit, policy::Pipe, policy::Merge>;
+    auto sh = Capture::create({"sh", "-c", "echo out; echo err >&2"}).or_throw();
+    REQUIRE(sh.std_out().slurp() == "out\nerr\n");
+    REQUIRE(sh.wait().or_throw().success());
+    // the Popen underneath has no stderr of its own
+    REQUIRE_FALSE(sh.popen().std_err.has_value());
+  }
+
+  SECTION("the config's own redirections are ignored") {
+    PopenConfig config;
+    config.stdout = Redirection::Pipe();
+    config.env = std::vector<EnvVar>{ { "WORD", "kept" } };
+    using Filter = BasicPopen<policy::Pipe, policy::Inherit, policy::Pipe>;
+    auto sh = Filter::create({"sh", "-c", "cat >&2; echo $WORD >&2"}, config).or_throw();
+    REQUIRE_FALSE(sh.popen().std_out.has_value());
+    sh.std_in() << "piped\n";
+    sh.std_in().close();
+    REQUIRE(sh.std_err().slurp() == "piped\nkept\n");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("errors are reported as by Popen::create") {
+    auto res = BasicPopen<policy::Inherit, policy::Pipe, policy::Inherit>::create({"/nonexistent/program"});
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.take_error().errnum == ENOENT);
+  }
+}
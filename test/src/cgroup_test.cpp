@@ -0,0 +1,101 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+using namespace subprocess;
+
+namespace {
+  bool exists(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+  }
+
+  // Our own cgroup, if we may create cgroups under it.
+  std::optional<std::string> usable_parent() {
+    auto self = Cgroup::self();
+    if (!self.has_value()) return std::nullopt;
+    auto probe = Cgroup::create(*self, "subprocess-test-probe");
+    if (!probe.ok()) return std::nullopt;
+    return self;
+  }
+}  // namespace
+
+TEST_CASE("cgroups") {
+  auto parent = usable_parent();
+  if (!parent.has_value()) {
+    WARN("cgroup v2 is not available for writing; skipping");
+    return;
+  }
+  PopenConfig config;
+  config.cgroup = CgroupConfig{ *parent, true, {} };
+
+  SECTION("the child starts in a leaf cgroup, removed after it exits") {
+    config.stdout = Redirection::Pipe();
+    std::string path;
+    {
+      auto cat = Popen::create({"cat", "/proc/self/cgroup"}, config).or_throw();
+      REQUIRE(cat.cgroup.has_value());
+      path = cat.cgroup->path();
+      REQUIRE(exists(path));
+      std::string contents{ std::istreambuf_iterator<char>(*cat.std_out), {} };
+      auto leaf = path.substr(path.rfind('/'));
+      REQUIRE(contents.find("0::") != std::string::npos);
+      REQUIRE(contents.find(leaf + "\n") != std::string::npos);
+      REQUIRE(cat.wait().or_throw().success());
+    }
+    REQUIRE_FALSE(exists(path));
+  }
+
+  SECTION("cpu usage is accounted") {
+    auto sh = Popen::create({"sh", "-c", "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done"}, config).or_throw();
+    REQUIRE(sh.wait().or_throw().success());
+    auto stats = sh.cgroup->stats().or_throw();
+    REQUIRE(stats.cpu_usage_usec.has_value());
+    REQUIRE(*stats.cpu_usage_usec > 0);
+  }
+
+  SECTION("kill tears down the whole tree") {
+    // the background sleep is not our child, nor waited for by anyone
+    auto sh = Popen::create({"sh", "-c", "sleep 100 & sleep 100"}, config).or_throw();
+    REQUIRE_FALSE(sh.cgroup->kill().has_value());
+    auto status = sh.wait().or_throw();
+    REQUIRE(status.toString() == "subprocess::ExitStatus::Signaled(9)");
+    // removal fails while the orphaned sleep is still dying
+    for (int i = 0; i < 100 && sh.cgroup->remove().has_value(); i++) ::usleep(10000);
+    REQUIRE_FALSE(exists(sh.cgroup->path()));
+  }
+
+  SECTION("limits need their controller") {
+    config.cgroup->limits.pids_max = 8;
+    auto res = Popen::create({"true"}, config);
+    if (res.ok()) {
+      REQUIRE(res.take_value().wait().or_throw().success());
+    } else {
+      // no pids controller delegated to us
+      REQUIRE(res.take_error().kind == PopenError::IoError);
+    }
+  }
+
+  SECTION("a missing cgroup is an error") {
+    config.cgroup = CgroupConfig{ *parent + "/subprocess-test-missing", false, {} };
+    auto res = Popen::create({"true"}, config);
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.take_error().kind == PopenError::IoError);
+  }
+}
+
+TEST_CASE("rlimits") {
+  PopenConfig config;
+  config.stdout = Redirection::Pipe();
+  config.rlimits = { ResourceLimit{ RLIMIT_NOFILE, 64, 64 } };
+  auto sh = Popen::create({"sh", "-c", "ulimit -n"}, config).or_throw();
+  std::string line;
+  std::getline(*sh.std_out, line);
+  REQUIRE(sh.wait().or_throw().success());
+  REQUIRE(line == "64");
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <string>
+
+#include "subprocess/ChildIoLoop.hpp"
+
+using namespace subprocess;
+
+TEST_CASE("ChildIoLoop") {
+  std::map<ChildIoLoop::Id, std::string> out;
+  std::map<ChildIoLoop::Id, std::string> err;
+  std::map<ChildIoLoop::Id, std::string> exits;
+  ChildIoLoop::Handlers handlers{
+    [&](ChildIoLoop::Id id, const char* data, size_t len) { out[id].append(data, len); },
+    [&](ChildIoLoop::Id id, const char* data, size_t len) { err[id].append(data, len); },
+    [&](ChildIoLoop::Id id, const ExitStatus& status) { exits[id] = status.toString(); },
+  };
+
+  SECTION("pumps stdin and stdout of many children") {
+    ChildIoLoop loop{ handlers };
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    std::map<ChildIoLoop::Id, std::string> expected;
+    for (int i = 0; i < 32; i++) {
+      auto id = loop.add(Popen::create({"cat"}, config).or_throw()).or_throw();
+      expected[id] = "child " + std::to_string(i) + "\n";
+      REQUIRE(loop.write(id, expected[id].data(), expected[id].size()));
+      loop.close_stdin(id);
+    }
+    REQUIRE(loop.size() == 32);
+    REQUIRE_FALSE(loop.run().has_value());
+    REQUIRE(loop.size() == 0);
+    REQUIRE(out == expected);
+    for (const auto& [id, status] : exits) {
+      REQUIRE(status == "subprocess::ExitStatus::Exited(0)");
+    }
+    REQUIRE(exits.size() == 32);
+  }
+
+  SECTION("output is delivered before the exit") {
+    ChildIoLoop loop{ handlers };
+    PopenConfig config;
+    config.stdout = Redirection::Pipe();
+    config.stderr = Redirection::Pipe();
+    auto id = loop.add(
+      Popen::create({"sh", "-c", "echo out; echo err >&2; exit 4"}, config).or_throw()).or_throw();
+    REQUIRE_FALSE(loop.run().has_value());
+    REQUIRE(out[id] == "out\n");
+    REQUIRE(err[id] == "err\n");
+    REQUIRE(exits[id] == "subprocess::ExitStatus::Exited(4)");
+  }
+
+  SECTION("children without pipes are reported too") {
+    ChildIoLoop loop{ handlers };
+    auto id = loop.add(Popen::create({"true"}, PopenConfig{}).or_throw()).or_throw();
+    REQUIRE_FALSE(loop.run().has_value());
+    REQUIRE(exits[id] == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("a child that exits partway through its input") {
+    ChildIoLoop::Options options;
+    options.max_pending_input = 1 << 20;
+    ChildIoLoop loop{ handlers, options };
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    auto id = loop.add(Popen::create({"head", "-c", "10"}, config).or_throw()).or_throw();
+    // more than the pipe holds, so writing goes on after head has gone
+    std::string input(1 << 20, 'x');
+    REQUIRE(loop.write(id, input.data(), input.size()));
+    loop.close_stdin(id);
+    REQUIRE_FALSE(loop.run().has_value());
+    REQUIRE(out[id] == std::string(10, 'x'));
+    REQUIRE(exits[id] == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("pending input is bounded") {
+    ChildIoLoop::Options options;
+    options.max_pending_input = 8;
+    ChildIoLoop loop{ handlers, options };
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    auto id = loop.add(Popen::create({"cat"}, config).or_throw()).or_throw();
+    REQUIRE(loop.write(id, "12345", 5));
+    REQUIRE_FALSE(loop.write(id, "6789", 4));
+    loop.close_stdin(id);
+    REQUIRE_FALSE(loop.write(id, "6", 1));
+    REQUIRE_FALSE(loop.run().has_value());
+    REQUIRE(out[id] == "12345");
+  }
+}
@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/ChildTable.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("ChildTable") {
+  ChildTable table;
+
+  SECTION("finds the children that exited, and only once") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    std::vector<ChildTable::Id> cats;
+    for (int i = 0; i < 8; i++) cats.push_back(table.add(Popen::create({"cat"}, config).or_throw()).or_throw());
+    auto quick = table.add(Popen::create({"sh", "-c", "exit 7"}, PopenConfig{}).or_throw()).or_throw();
+    REQUIRE(table.size() == 9);
+
+    std::vector<ChildTable::Id> exited;
+    for (int i = 0; i < 500 && exited.empty(); i++) {
+      exited = table.reap_exited();
+      if (exited.empty()) std::this_thread::sleep_for(10ms);
+    }
+    REQUIRE(exited == std::vector<ChildTable::Id>{ quick });
+    REQUIRE(table.exit_status(quick)->toString() == "subprocess::ExitStatus::Exited(7)");
+    REQUIRE(table.running() == 8);
+    REQUIRE(table.reap_exited().empty());
+
+    // closing stdin ends a cat
+    REQUIRE(table.fd(cats[0], 0) >= 0);
+    table.std_in(cats[0])->close();
+    REQUIRE(table.wait(cats[0]).or_throw().success());
+    REQUIRE(table.running() == 7);
+    REQUIRE_FALSE(table.exit_status(cats[1]).has_value());
+  }
+
+  SECTION("streams are created on demand") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    auto id = table.add(Popen::create({"cat"}, config).or_throw()).or_throw();
+    REQUIRE(table.std_err(id) == nullptr);
+    *table.std_in(id) << "hello" << std::flush;
+    table.std_in(id)->close();
+    REQUIRE(table.std_out(id)->slurp() == "hello");
+    REQUIRE(table.wait(id).or_throw().success());
+  }
+
+  SECTION("a removed child's id is not reused") {
+    auto first = table.add(Popen::create({"true"}, PopenConfig{}).or_throw()).or_throw();
+    table.remove(first);
+    REQUIRE(table.size() == 0);
+    REQUIRE_FALSE(table.pid(first).has_value());
+    auto second = table.add(Popen::create({"true"}, PopenConfig{}).or_throw()).or_throw();
+    REQUIRE(second != first);
+    REQUIRE_FALSE(table.pid(first).has_value());
+    REQUIRE(table.pid(second).has_value());
+    REQUIRE_FALSE(table.wait(first).ok());
+  }
+}
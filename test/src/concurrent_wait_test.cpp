@@ -0,0 +1,92 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+// Catch's assertions are not thread safe: the threads only record what
+// they saw, and the test checks it afterwards.
+TEST_CASE("waiting on one child from many threads") {
+  constexpr size_t threads = 16;
+
+  SECTION("every waiter sees the same exit status") {
+    for (int round = 0; round < 20; round++) {
+      auto child = Popen::create({ "sh", "-c", "sleep 0.01; exit 7" }, PopenConfig{}).or_throw();
+      std::atomic<bool> go{ false };
+      std::vector<std::string> seen(threads);
+      std::vector<std::thread> waiters;
+      for (size_t t = 0; t < threads; t++) {
+        waiters.emplace_back([&, t] {
+          while (!go.load()) std::this_thread::yield();
+          std::optional<ExitStatus> status;
+          switch (t % 4) {
+            case 0:
+              status = child.wait().or_throw();
+              break;
+            case 1:
+              while (!(status = child.poll()).has_value()) std::this_thread::yield();
+              break;
+            case 2:
+              while (!(status = child.wait_timeout(5ms).or_throw()).has_value()) {}
+              break;
+            default:
+              while (!(status = child.exit_status()).has_value()) child.pid();
+              break;
+          }
+          seen[t] = status->toString();
+        });
+      }
+      go = true;
+      for (auto& waiter : waiters) waiter.join();
+      for (const auto& status : seen) REQUIRE(status == "subprocess::ExitStatus::Exited(7)");
+      REQUIRE_FALSE(child.pid().has_value());
+    }
+  }
+
+  SECTION("pollers alone reap the child") {
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    std::vector<std::string> seen(threads);
+    std::vector<std::thread> pollers;
+    for (size_t t = 0; t < threads; t++) {
+      pollers.emplace_back([&, t] {
+        std::optional<ExitStatus> status;
+        while (!(status = child.poll()).has_value()) std::this_thread::yield();
+        seen[t] = status->toString();
+      });
+    }
+    for (auto& poller : pollers) poller.join();
+    for (const auto& status : seen) REQUIRE(status == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("a failed exec is reported to every waiter, and to exec_result") {
+    for (int round = 0; round < 20; round++) {
+      PopenConfig config;
+      config.async_exec = true;
+      auto child = Popen::create({ "/nonexistent/program" }, config).or_throw();
+      std::atomic<bool> go{ false };
+      std::vector<int> errnums(threads, 0);
+      std::vector<std::thread> waiters;
+      for (size_t t = 0; t < threads; t++) {
+        waiters.emplace_back([&, t] {
+          while (!go.load()) std::this_thread::yield();
+          if (t % 2 == 0) {
+            auto res = child.wait();
+            if (!res.ok()) errnums[t] = res.take_error().errnum;
+          } else if (auto err = child.exec_result()) {
+            errnums[t] = err->errnum;
+          }
+        });
+      }
+      go = true;
+      for (auto& waiter : waiters) waiter.join();
+      for (int errnum : errnums) REQUIRE(errnum == ENOENT);
+    }
+  }
+}
@@ -0,0 +1,91 @@
+#include "subprocess/Coroutine.hpp"
+
+#include <catch2/catch.hpp>
+
+#ifdef SUBPROCESS_HAS_COROUTINES
+
+#include <string>
+#include <vector>
+
+using namespace subprocess;
+
+TEST_CASE("coroutines") {
+  EpollReactor reactor;
+
+  SECTION("async_wait") {
+    auto sh = Popen::create({"sh", "-c", "sleep 0.05; exit 2"}, PopenConfig{}).or_throw();
+    auto status = sync_wait(reactor, async_wait(sh, reactor)).or_throw();
+    REQUIRE(status.toString() == "subprocess::ExitStatus::Exited(2)");
+    REQUIRE_FALSE(reactor.has_pending());
+  }
+
+  SECTION("async_read and async_write") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    config.nonblocking = true;
+    auto cat = Popen::create({"cat"}, config).or_throw();
+
+    auto echo = [&]() -> Task<std::string> {
+      auto wrote = co_await async_write(*cat.std_in, "ping\n", 5, reactor);
+      REQUIRE(wrote.status == boost::io_status::ok);
+      cat.std_in->close();
+      std::string got;
+      char buf[16];
+      while (true) {
+        auto res = co_await async_read(*cat.std_out, buf, sizeof(buf), reactor);
+        if (res.status != boost::io_status::ok) break;
+        got.append(buf, res.count);
+      }
+      co_return got;
+    };
+    REQUIRE(sync_wait(reactor, echo()) == "ping\n");
+    REQUIRE(cat.wait().or_throw().success());
+  }
+
+  SECTION("a child that does not read its input") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    auto t = Popen::create({"true"}, config).or_throw();
+    // EPIPE ends the input, rather than SIGPIPE ending us
+    auto capture = sync_wait(reactor, communicate_async(t, reactor, std::string(1 << 20, 'x'))).or_throw();
+    REQUIRE(capture.stdout.empty());
+    REQUIRE(capture.success());
+  }
+
+  SECTION("many children on one thread") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    config.stderr = Redirection::Pipe();
+
+    std::vector<Popen> children;
+    std::vector<Task<Result<CaptureData>>> tasks;
+    for (int i = 0; i < 16; i++) {
+      children.push_back(
+        Popen::create({"sh", "-c", "cat; echo done >&2"}, config).or_throw());
+    }
+    for (int i = 0; i < 16; i++) {
+      tasks.push_back(communicate_async(children[static_cast<size_t>(i)], reactor,
+                                        "child " + std::to_string(i) + "\n"));
+      tasks.back().start();
+    }
+    auto all_done = [&] {
+      for (auto& t : tasks) {
+        if (!t.done()) return false;
+      }
+      return true;
+    };
+    while (!all_done()) reactor.run_once(std::nullopt).or_throw();
+
+    for (int i = 0; i < 16; i++) {
+      auto capture = tasks[static_cast<size_t>(i)].result().or_throw();
+      REQUIRE(capture.stdout == "child " + std::to_string(i) + "\n");
+      REQUIRE(capture.stderr == "done\n");
+      REQUIRE(capture.success());
+    }
+  }
+}
+
+#endif
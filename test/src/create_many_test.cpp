@@ -0,0 +1,51 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace subprocess;
+
+TEST_CASE("create_many") {
+  PopenConfig config;
+  config.stdout = Redirection::Pipe();
+  std::vector<std::vector<std::string>> argvs;
+  for (int i = 0; i < 20; i++) argvs.push_back({ "echo", std::to_string(i) });
+
+  SECTION("every child gets its own arguments, in order") {
+    for (size_t threads : { size_t{ 1 }, size_t{ 4 } }) {
+      auto children = Popen::create_many(argvs, config, threads);
+      REQUIRE(children.size() == argvs.size());
+      for (size_t i = 0; i < children.size(); i++) {
+        auto child = children[i].or_throw();
+        REQUIRE(child.std_out->slurp() == std::to_string(i) + "\n");
+        REQUIRE(child.wait().or_throw().success());
+      }
+    }
+  }
+
+  SECTION("the shared environment reaches every child") {
+    config.env = std::vector<EnvVar>{ { "GREETING", "hello" } };
+    auto children = Popen::create_many({ { "sh", "-c", "echo $GREETING" }, { "sh", "-c", "echo $GREETING!" } }, config);
+    REQUIRE(children[0].or_throw().std_out->slurp() == "hello\n");
+    REQUIRE(children[1].or_throw().std_out->slurp() == "hello!\n");
+  }
+
+  SECTION("one failing child does not stop the others") {
+    argvs[3] = {};
+    argvs[5] = { "/nonexistent/program" };
+    auto children = Popen::create_many(argvs, config);
+    REQUIRE_FALSE(children[3].ok());
+    REQUIRE(children[3].take_error().kind == PopenError::LogicError);
+    REQUIRE_FALSE(children[5].ok());
+    REQUIRE(children[5].take_error().errnum == ENOENT);
+    REQUIRE(children[6].or_throw().std_out->slurp() == "6\n");
+  }
+}
+
+TEST_CASE("PrepExec::resolve") {
+  REQUIRE(PrepExec::resolve("sh").value_or("").find("/sh") != std::string::npos);
+  REQUIRE_FALSE(PrepExec::resolve("/bin/sh").has_value());
+  REQUIRE_FALSE(PrepExec::resolve("surely-no-such-program").has_value());
+}
@@ -0,0 +1,112 @@
+#include "subprocess/DeadlineManager.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <signal.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("DeadlineManager") {
+  using Clock = DeadlineManager::Clock;
+
+  SECTION("a Signal deadline signals the child once it passes") {
+    DeadlineManager deadlines;
+    auto child = Popen::create({ "sleep", "100" }, PopenConfig{}).or_throw();
+    auto start = Clock::now();
+    deadlines.add(child, start + 30ms, DeadlineManager::Signal{ SIGKILL });
+    REQUIRE(deadlines.size() == 1);
+    while (deadlines.size() > 0) deadlines.run_once(std::nullopt).or_throw();
+    REQUIRE(Clock::now() - start >= 30ms);
+    REQUIRE(child.wait().or_throw().toString() == "subprocess::ExitStatus::Signaled(9)");
+  }
+
+  SECTION("Terminate kills a child that ignores SIGTERM after the grace period") {
+    DeadlineManager deadlines;
+    auto child = Popen::create({ "sh", "-c", "trap '' TERM; exec sleep 100" }, PopenConfig{}).or_throw();
+    // give sh the time to ignore SIGTERM
+    std::this_thread::sleep_for(50ms);
+    auto start = Clock::now();
+    deadlines.add(child, start, DeadlineManager::Terminate{ 50ms });
+    REQUIRE(deadlines.run_once(std::nullopt).or_throw() == 1);
+    REQUIRE(deadlines.size() == 1);
+    REQUIRE_FALSE(child.wait_timeout(10ms).or_throw().has_value());
+    while (deadlines.size() > 0) deadlines.run_once(std::nullopt).or_throw();
+    REQUIRE(Clock::now() - start >= 50ms);
+    REQUIRE(child.wait().or_throw().toString() == "subprocess::ExitStatus::Signaled(9)");
+  }
+
+  SECTION("a cancelled deadline does nothing") {
+    DeadlineManager deadlines;
+    auto child = Popen::create({ "sleep", "0.1" }, PopenConfig{}).or_throw();
+    auto id = deadlines.add(child, Clock::now() + 10ms, DeadlineManager::Signal{ SIGKILL });
+    REQUIRE(deadlines.cancel(id));
+    REQUIRE_FALSE(deadlines.cancel(id));
+    REQUIRE(deadlines.size() == 0);
+    REQUIRE(deadlines.run_once(30ms).or_throw() == 0);
+    REQUIRE(child.wait().or_throw().toString() == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("callbacks run in deadline order, never early, across the wheel's levels") {
+    // 10us ticks: deadlines up to 300ms span three levels
+    DeadlineManager deadlines{ DeadlineManager::Options{ 10us } };
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    std::mt19937 rng{ 42 };
+    std::uniform_int_distribution<int> offset_us{ 0, 300000 };
+    auto start = Clock::now();
+    std::vector<DeadlineManager::Id> ids;
+    size_t early = 0;
+    std::vector<Clock::time_point> fired;
+    for (int i = 0; i < 2000; i++) {
+      auto deadline = start + std::chrono::microseconds(offset_us(rng));
+      ids.push_back(deadlines.add(child, deadline, DeadlineManager::Callback{ [&, deadline](Popen&) {
+        if (Clock::now() < deadline) early++;
+        fired.push_back(deadline);
+      } }));
+    }
+    // cancel every fourth
+    for (size_t i = 0; i < ids.size(); i += 4) REQUIRE(deadlines.cancel(ids[i]));
+    REQUIRE(deadlines.size() == 1500);
+
+    while (deadlines.size() > 0) deadlines.run_once(std::nullopt).or_throw();
+    REQUIRE(fired.size() == 1500);
+    REQUIRE(early == 0);
+    // within a tick the order is not kept
+    for (size_t i = 1; i < fired.size(); i++) REQUIRE(fired[i] + 10us >= fired[i - 1]);
+    child.wait();
+  }
+
+  SECTION("a callback may add and cancel deadlines") {
+    DeadlineManager deadlines;
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    int runs = 0;
+    DeadlineManager::Id later = 0;
+    deadlines.add(child, Clock::now(), DeadlineManager::Callback{ [&](Popen&) {
+      runs++;
+      deadlines.cancel(later);
+      deadlines.add(child, Clock::now() + 5ms, DeadlineManager::Callback{ [&](Popen&) { runs++; } });
+    } });
+    later = deadlines.add(child, Clock::now() + 1ms, DeadlineManager::Callback{ [&](Popen&) { runs += 100; } });
+    while (deadlines.size() > 0) deadlines.run_once(std::nullopt).or_throw();
+    REQUIRE(runs == 2);
+    child.wait();
+  }
+
+  SECTION("far deadlines wait without firing") {
+    DeadlineManager deadlines;
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    std::vector<DeadlineManager::Id> ids;
+    for (auto away : { 1h, 24h, 24h * 365 * 100 }) {
+      ids.push_back(deadlines.add(child, Clock::now() + away, DeadlineManager::Signal{ SIGKILL }));
+    }
+    REQUIRE(deadlines.run_once(20ms).or_throw() == 0);
+    REQUIRE(deadlines.size() == 3);
+    for (auto id : ids) REQUIRE(deadlines.cancel(id));
+    child.wait();
+  }
+}
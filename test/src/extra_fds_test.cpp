@@ -0,0 +1,82 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+using namespace subprocess;
+
+namespace {
+  Redirection pipe_to_child() {
+    return Redirection::Pipe{ Redirection::Pipe::Direction::ToChild };
+  }
+}  // namespace
+
+TEST_CASE("extra_fds") {
+  PopenConfig config;
+
+  SECTION("a data channel on fd 3, separate from stdout") {
+    config.stdout = Redirection::Pipe();
+    config.extra_fds.emplace(3, Redirection::Pipe());
+    auto sh = Popen::create({"sh", "-c", "echo data >&3; echo log"}, config).or_throw();
+    REQUIRE(sh.extra_out.count(3) == 1);
+    std::string data, log;
+    std::getline(sh.extra_out.at(3), data);
+    std::getline(*sh.std_out, log);
+    REQUIRE(data == "data");
+    REQUIRE(log == "log");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("a pipe to the child") {
+    config.stdout = Redirection::Pipe();
+    config.extra_fds.emplace(4, pipe_to_child());
+    auto sh = Popen::create({"sh", "-c", "read x <&4; echo got $x"}, config).or_throw();
+    sh.extra_in.at(4) << "it" << std::endl;
+    sh.extra_in.at(4).close();
+    std::string line;
+    std::getline(*sh.std_out, line);
+    REQUIRE(line == "got it");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("targets that collide with our own descriptors land correctly") {
+    // The parent's pipe ends take the lowest free descriptors, which are
+    // exactly the targets, so sources and targets overlap in every order.
+    std::string script;
+    for (int fd = 3; fd <= 9; fd++) {
+      config.extra_fds.emplace(fd, Redirection::Pipe());
+      script += "echo " + std::to_string(fd) + " >&" + std::to_string(fd) + "; ";
+    }
+    auto sh = Popen::create({"sh", "-c", script}, config).or_throw();
+    for (int fd = 3; fd <= 9; fd++) {
+      std::string line;
+      std::getline(sh.extra_out.at(fd), line);
+      REQUIRE(line == std::to_string(fd));
+    }
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("sockets") {
+    config.extra_fds.emplace(5, Redirection::Socket{ SOCK_STREAM });
+    auto sh = Popen::create({"sh", "-c", "echo hi >&5"}, config).or_throw();
+    char buf[8];
+    auto res = sh.extra_sockets.at(5).recv(buf, sizeof(buf));
+    REQUIRE(res.status == boost::io_status::ok);
+    REQUIRE(std::string(buf, res.count) == "hi\n");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("invalid entries are rejected") {
+    config.extra_fds.emplace(2, Redirection::Pipe());
+    auto low = Popen::create({"true"}, config);
+    REQUIRE_FALSE(low.ok());
+    REQUIRE(low.take_error().kind == PopenError::LogicError);
+
+    PopenConfig merge;
+    merge.extra_fds.emplace(3, Redirection::Merge());
+    auto merged = Popen::create({"true"}, merge);
+    REQUIRE_FALSE(merged.ok());
+    REQUIRE(merged.take_error().kind == PopenError::LogicError);
+  }
+}
@@ -0,0 +1,74 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+using boost::io_status;
+
+TEST_CASE("nonblocking streams") {
+  PopenConfig config;
+  config.nonblocking = true;
+  char buf[64];
+
+  SECTION("reads tell 'no data yet' apart from end of file") {
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    auto cat = Popen::create({"cat"}, config).or_throw();
+    REQUIRE(cat.std_out->fd() >= 0);
+
+    auto res = cat.std_out->read_some(buf, sizeof(buf));
+    REQUIRE(res.status == io_status::would_block);
+
+    auto start = std::chrono::steady_clock::now();
+    res = cat.std_out->read_some(buf, sizeof(buf), start + 50ms);
+    REQUIRE(res.status == io_status::timed_out);
+    REQUIRE(std::chrono::steady_clock::now() - start >= 50ms);
+
+    auto wrote = cat.std_in->write_some("hello\n", 6, std::chrono::steady_clock::now() + 1s);
+    REQUIRE(wrote.status == io_status::ok);
+    REQUIRE(wrote.count == 6);
+
+    res = cat.std_out->read_some(buf, sizeof(buf), std::chrono::steady_clock::now() + 5s);
+    REQUIRE(res.status == io_status::ok);
+    REQUIRE(std::string(buf, res.count) == "hello\n");
+
+    cat.std_in->close();
+    res = cat.std_out->read_some(buf, sizeof(buf), std::chrono::steady_clock::now() + 5s);
+    REQUIRE(res.status == io_status::eof);
+    REQUIRE(cat.wait().or_throw().success());
+  }
+
+  SECTION("the stream interface reports would-block instead of a silent EOF") {
+    config.stdout = Redirection::Pipe();
+    auto sleeper = Popen::create({"sleep", "0.2"}, config).or_throw();
+    std::string line;
+    REQUIRE_FALSE(std::getline(*sleeper.std_out, line));
+    REQUIRE(sleeper.std_out->would_block());
+    sleeper.wait().or_throw();
+    sleeper.std_out->clear();
+    REQUIRE_FALSE(std::getline(*sleeper.std_out, line));
+    REQUIRE_FALSE(sleeper.std_out->would_block());
+  }
+
+  SECTION("writes stop when the pipe is full") {
+    config.stdin = Redirection::Pipe();
+    auto sleeper = Popen::create({"sleep", "0.2"}, config).or_throw();
+    std::vector<char> chunk(1 << 16, 'x');
+    boost::io_result res{ io_status::ok, 0, 0 };
+    size_t total = 0;
+    for (int i = 0; i < 64 && res.status == io_status::ok; i++) {
+      res = sleeper.std_in->write_some(chunk.data(), chunk.size());
+      total += res.count;
+    }
+    REQUIRE(res.status == io_status::would_block);
+    REQUIRE(total > 0);
+
+    res = sleeper.std_in->write_some(chunk.data(), chunk.size(), std::chrono::steady_clock::now() + 20ms);
+    REQUIRE(res.status == io_status::timed_out);
+  }
+}
@@ -0,0 +1,64 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <sched.h>
+#include <string>
+
+using namespace subprocess;
+
+namespace {
+  // Run `script` with `config` and return the first line it prints.
+  std::string first_line(const std::string& script, PopenConfig config) {
+    config.stdout = Redirection::Pipe();
+    auto sh = Popen::create({"sh", "-c", script}, config).or_throw();
+    std::string line;
+    std::getline(*sh.std_out, line);
+    REQUIRE(sh.wait().or_throw().success());
+    return line;
+  }
+}  // namespace
+
+TEST_CASE("process attributes") {
+  PopenConfig config;
+
+  SECTION("cpu affinity") {
+    config.cpu_affinity = { 0 };
+    REQUIRE(first_line("grep Cpus_allowed_list /proc/self/status | cut -f2", std::move(config)) == "0");
+  }
+
+  SECTION("scheduling policy") {
+    config.scheduling = Scheduling{ SCHED_BATCH, 0 };
+    // field 41 of /proc/<pid>/stat is the policy
+    REQUIRE(first_line("cut -d' ' -f41 /proc/self/stat", std::move(config)) == std::to_string(SCHED_BATCH));
+  }
+
+  SECTION("nice value") {
+    config.nice = 7;
+    REQUIRE(first_line("cut -d' ' -f19 /proc/self/stat", std::move(config)) == "7");
+  }
+
+  SECTION("io priority") {
+    config.io_priority = IoPriority{ IoPriority::Class::Idle, 0 };
+    REQUIRE(first_line("ionice -p $$ 2>/dev/null || echo idle", std::move(config)) == "idle");
+  }
+
+  SECTION("numa policy") {
+    config.numa_policy = NumaPolicy{ NumaPolicy::Mode::Bind, { 0 } };
+    auto line = first_line("head -1 /proc/self/numa_maps 2>/dev/null || echo bind:0", std::move(config));
+    REQUIRE(line.find("bind:0") != std::string::npos);
+  }
+
+  SECTION("out of range values are rejected before spawning") {
+    config.cpu_affinity = { -1 };
+    auto res = Popen::create({"true"}, config);
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.take_error().kind == PopenError::LogicError);
+
+    PopenConfig nice;
+    nice.nice = 40;
+    auto res2 = Popen::create({"true"}, nice);
+    REQUIRE_FALSE(res2.ok());
+    REQUIRE(res2.take_error().kind == PopenError::LogicError);
+  }
+}
@@ -50,4 +50,33 @@ TEST_CASE("RaggedCstrArray") {
       REQUIRE(chstr[4] == nullptr);
     }
   }
+
+  GIVEN("an array moved from") {
+    RaggedCstrArray from{ { "one", "two" } };
+    WHEN("it is moved into a new array") {
+      RaggedCstrArray to{ std::move(from) };
+      THEN("the new one has the strings, and the old one is empty but usable") {
+        REQUIRE(to.size() == 2);
+        REQUIRE(to.asCharStar()[1] == std::string("two"));
+        REQUIRE(from.size() == 0);
+        REQUIRE(*from.asCharStar() == nullptr);
+        from.push("three");
+        REQUIRE(from.asCharStar()[0] == std::string("three"));
+        REQUIRE(from.asCharStar()[1] == nullptr);
+      }
+    }
+    WHEN("it is move assigned to another array") {
+      RaggedCstrArray to{ { "zero" } };
+      to = std::move(from);
+      THEN("the other one has the strings, and the old one is empty but usable") {
+        REQUIRE(to.size() == 2);
+        REQUIRE(to.asCharStar()[0] == std::string("one"));
+        REQUIRE(to.asCharStar()[2] == nullptr);
+        REQUIRE(from.size() == 0);
+        REQUIRE(*from.asCharStar() == nullptr);
+        from.push("three");
+        REQUIRE(from.size() == 1);
+      }
+    }
+  }
 }
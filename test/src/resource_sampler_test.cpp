@@ -0,0 +1,69 @@
+#include "subprocess/Popen.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("resource sampler") {
+  ResourceSampler::Options options;
+  options.interval = 10ms;
+  options.samples_per_child = 4;
+  ResourceSampler sampler{ options };
+  PopenConfig config;
+  config.sampler = &sampler;
+
+  SECTION("samples a running child until it exits") {
+    config.stdin = Redirection::Pipe();
+    auto cat = Popen::create({"cat"}, config).or_throw();
+    REQUIRE(sampler.size() == 1);
+    REQUIRE(sampler.sample_once() == 1);
+    REQUIRE(sampler.sample_once() == 1);
+    auto samples = cat.resource_samples();
+    REQUIRE(samples.size() == 2);
+    REQUIRE(samples[0].time <= samples[1].time);
+    REQUIRE(samples[1].rss_bytes > 0);
+    REQUIRE(samples[1].vm_bytes >= samples[1].rss_bytes);
+    REQUIRE(samples[1].threads == 1);
+
+    cat.std_in->close();
+    REQUIRE(cat.wait().or_throw().success());
+    REQUIRE(sampler.sample_once() == 0);
+    // what was recorded stays available
+    REQUIRE(cat.resource_samples().size() == 2);
+  }
+
+  SECTION("keeps only the latest samples") {
+    config.stdin = Redirection::Pipe();
+    auto cat = Popen::create({"cat"}, config).or_throw();
+    for (int i = 0; i < 10; i++) sampler.sample_once();
+    auto samples = cat.resource_samples();
+    REQUIRE(samples.size() == 4);
+    for (size_t i = 1; i < samples.size(); i++) REQUIRE(samples[i - 1].time <= samples[i].time);
+  }
+
+  SECTION("a background thread records cpu time as it grows") {
+    sampler.start();
+    auto sh = Popen::create({"sh", "-c", "i=0; while [ $i -lt 50000 ]; do i=$((i+1)); done"}, config).or_throw();
+    REQUIRE(sh.wait().or_throw().success());
+    sampler.stop();
+    auto samples = sh.resource_samples();
+    REQUIRE_FALSE(samples.empty());
+    REQUIRE(samples.front().user_time <= samples.back().user_time);
+  }
+
+  SECTION("a destroyed Popen is no longer tracked") {
+    {
+      auto t = Popen::create({"true"}, config).or_throw();
+    }
+    REQUIRE(sampler.size() == 0);
+  }
+
+  SECTION("without a sampler there are no samples") {
+    auto t = Popen::create({"true"}, PopenConfig{}).or_throw();
+    REQUIRE(t.resource_samples().empty());
+  }
+}
@@ -0,0 +1,135 @@
+#include "subprocess/ResultCache.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+using namespace subprocess;
+
+namespace {
+  // A fresh cache directory, removed afterwards.
+  struct TempDir {
+    std::string path;
+    TempDir() {
+      char name[] = "/tmp/subprocess-cache-XXXXXX";
+      path = ::mkdtemp(name);
+    }
+    ~TempDir() { std::filesystem::remove_all(path); }
+  };
+
+  // prints something different every time it actually runs
+  const std::vector<std::string> unique_output{ "sh", "-c", "cat; echo $$" };
+}  // namespace
+
+TEST_CASE("result cache") {
+  TempDir dir;
+
+  SECTION("a repeated command is answered from the cache") {
+    auto cache = ResultCache::open(dir.path + "/store").or_throw();
+    auto first = cache.run(unique_output, PopenConfig{}, "input\n").or_throw();
+    auto second = cache.run(unique_output, PopenConfig{}, "input\n").or_throw();
+    REQUIRE(first.stdout.find("input\n") == 0);
+    REQUIRE(second.stdout == first.stdout);
+    REQUIRE(cache.stats().misses == 1);
+    REQUIRE(cache.stats().hits == 1);
+
+    // and so is a second cache on the same directory
+    auto other = ResultCache::open(dir.path + "/store").or_throw();
+    REQUIRE(other.run(unique_output, PopenConfig{}, "input\n").or_throw().stdout == first.stdout);
+  }
+
+  SECTION("different input is a different key") {
+    auto cache = ResultCache::open(dir.path).or_throw();
+    auto a = cache.run(unique_output, PopenConfig{}, "a\n").or_throw();
+    auto b = cache.run(unique_output, PopenConfig{}, "b\n").or_throw();
+    REQUIRE(a.stdout != b.stdout);
+    REQUIRE(cache.stats().misses == 2);
+  }
+
+  SECTION("only the chosen environment variables are part of the key") {
+    ResultCache::Options options;
+    options.env_keys = std::vector<std::string>{ "COLOR" };
+    auto cache = ResultCache::open(dir.path, options).or_throw();
+    auto with_env = [](std::vector<EnvVar> env) {
+      PopenConfig config;
+      config.env = std::move(env);
+      return config;
+    };
+    auto key = [&](std::vector<EnvVar> env) { return cache.key(unique_output, with_env(std::move(env))).or_throw(); };
+    REQUIRE(key({ { "COLOR", "red" }, { "NOISE", "1" } }) == key({ { "COLOR", "red" }, { "NOISE", "2" } }));
+    REQUIRE(key({ { "COLOR", "red" } }) != key({ { "COLOR", "blue" } }));
+    REQUIRE(key({ { "COLOR", "" } }) != key({}));
+  }
+
+  SECTION("changed input files invalidate the result") {
+    auto cache = ResultCache::open(dir.path).or_throw();
+    std::string file = dir.path + "/input.txt";
+    std::ofstream{ file } << "one";
+    std::vector<std::string> cat{ "cat", file };
+    REQUIRE(cache.run(cat, PopenConfig{}, {}, { file }).or_throw().stdout == "one");
+    std::ofstream{ file } << "two";
+    REQUIRE(cache.run(cat, PopenConfig{}, {}, { file }).or_throw().stdout == "two");
+    REQUIRE(cache.stats().hits == 0);
+  }
+
+  SECTION("exit codes are cached, signals are not") {
+    auto cache = ResultCache::open(dir.path).or_throw();
+    std::vector<std::string> fail{ "sh", "-c", "echo oops >&2; exit 4" };
+    cache.run(fail, PopenConfig{}).or_throw();
+    auto cached = cache.run(fail, PopenConfig{}).or_throw();
+    REQUIRE(cache.stats().hits == 1);
+    REQUIRE(cached.stderr == "oops\n");
+    REQUIRE(cached.exit_status.get<ExitStatus::Exited>().code == 4);
+
+    std::vector<std::string> killed{ "sh", "-c", "kill -9 $$" };
+    cache.run(killed, PopenConfig{}).or_throw();
+    cache.run(killed, PopenConfig{}).or_throw();
+    REQUIRE(cache.stats().misses == 3);
+  }
+
+  SECTION("the least recently used entries are evicted") {
+    ResultCache::Options options;
+    // room for two entries of 1000 bytes of output each
+    options.max_bytes = 2200;
+    auto cache = ResultCache::open(dir.path, options).or_throw();
+    auto run = [&](const std::string& fill) {
+      // recency is a file's modification time, which is only so precise
+      std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+      return cache.run({ "sh", "-c", "head -c 1000 /dev/zero | tr '\\\\0' " + fill }, PopenConfig{}).or_throw();
+    };
+    run("a");
+    run("b");
+    // touch a, so b is the least recently used when c arrives
+    run("a");
+    run("c");
+    REQUIRE(cache.stats().evictions == 1);
+    auto hits = cache.stats().hits;
+    run("a");
+    REQUIRE(cache.stats().hits == hits + 1);
+    run("b");
+    REQUIRE(cache.stats().hits == hits + 1);
+  }
+
+  SECTION("a corrupt entry is a miss") {
+    auto cache = ResultCache::open(dir.path).or_throw();
+    auto key = cache.key(unique_output, PopenConfig{}).or_throw();
+    std::ofstream{ dir.path + "/" + key } << "garbage";
+    REQUIRE_FALSE(cache.lookup(key).has_value());
+    REQUIRE_FALSE(std::filesystem::exists(dir.path + "/" + key));
+  }
+
+  SECTION("a lookup cannot reach outside the cache") {
+    std::filesystem::create_directory(dir.path + "/store");
+    auto cache = ResultCache::open(dir.path + "/store").or_throw();
+    std::ofstream{ dir.path + "/victim" } << "not a cache entry";
+    REQUIRE_FALSE(cache.lookup("../victim").has_value());
+    REQUIRE(std::filesystem::exists(dir.path + "/victim"));
+    REQUIRE(cache.stats().misses == 1);
+  }
+}
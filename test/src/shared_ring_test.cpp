@@ -0,0 +1,170 @@
+#include "subprocess/Popen.hpp"
+#include "subprocess/RingChannel.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("RingChannel") {
+  SECTION("capacity is rounded up to a power of two") {
+    auto ring = RingChannel::create(5000, RingChannel::Side::Writer);
+    REQUIRE(ring.has_value());
+    REQUIRE(ring->capacity() == 8192);
+  }
+
+  SECTION("bytes arrive in order across wraparound, then end of file") {
+    auto writer = RingChannel::create(4096, RingChannel::Side::Writer);
+    REQUIRE(writer.has_value());
+    int fd = ::fcntl(writer->fd(), F_DUPFD_CLOEXEC, 0);
+    auto reader = RingChannel::attach(fd, RingChannel::Side::Reader);
+    REQUIRE(reader.has_value());
+
+    const size_t total = 1 << 20;
+    std::thread producer([&] {
+      std::vector<char> chunk(1000);
+      for (size_t sent = 0; sent < total;) {
+        size_t n = std::min(chunk.size(), total - sent);
+        for (size_t i = 0; i < n; i++) chunk[i] = static_cast<char>((sent + i) % 251);
+        writer->write(chunk.data(), n);
+        sent += n;
+      }
+      writer->close();
+    });
+
+    std::vector<char> buf(3000);
+    size_t received = 0;
+    bool in_order = true;
+    boost::io_result res;
+    while ((res = reader->read(buf.data(), buf.size())).status == boost::io_status::ok) {
+      for (size_t i = 0; i < res.count; i++) {
+        in_order &= buf[i] == static_cast<char>((received + i) % 251);
+      }
+      received += res.count;
+    }
+    producer.join();
+    REQUIRE(res.status == boost::io_status::eof);
+    REQUIRE(received == total);
+    REQUIRE(in_order);
+  }
+
+  SECTION("deadlines and a closed reader") {
+    auto writer = RingChannel::create(4096, RingChannel::Side::Writer);
+    REQUIRE(writer.has_value());
+    auto reader = RingChannel::attach(::fcntl(writer->fd(), F_DUPFD_CLOEXEC, 0), RingChannel::Side::Reader);
+    REQUIRE(reader.has_value());
+
+    char c;
+    auto empty = reader->read(&c, 1, std::chrono::steady_clock::now() + 10ms);
+    REQUIRE(empty.status == boost::io_status::timed_out);
+
+    std::string big(10000, 'z');
+    auto full = writer->write(big.data(), big.size(), std::chrono::steady_clock::now() + 10ms);
+    REQUIRE(full.status == boost::io_status::timed_out);
+    REQUIRE(full.count == 4096);
+
+    reader->close();
+    auto gone = writer->write("x", 1);
+    REQUIRE(gone.status == boost::io_status::eof);
+  }
+
+  SECTION("a corrupted ring is refused") {
+    auto writer = RingChannel::create(4096, RingChannel::Side::Writer);
+    REQUIRE(writer.has_value());
+    auto reader = RingChannel::attach(::fcntl(writer->fd(), F_DUPFD_CLOEXEC, 0), RingChannel::Side::Reader);
+    REQUIRE(reader.has_value());
+    REQUIRE(writer->write("abc", 3).status == boost::io_status::ok);
+
+    // a peer claiming far more than the ring holds
+    void* mem = ::mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd(), 0);
+    REQUIRE(mem != MAP_FAILED);
+    auto* words = static_cast<uint64_t*>(mem);
+    uint64_t capacity = words[1];
+    REQUIRE(capacity == 4096);
+    words[1] = 8192;
+    int fd = ::fcntl(writer->fd(), F_DUPFD_CLOEXEC, 0);
+    REQUIRE_FALSE(RingChannel::attach(fd, RingChannel::Side::Reader).has_value());
+    REQUIRE(errno == EINVAL);
+    ::close(fd);
+    words[1] = capacity;
+
+    // the tail (at 128) far behind the head: more in flight than fits
+    auto* tail = reinterpret_cast<std::atomic<size_t>*>(static_cast<char*>(mem) + 128);
+    tail->store(size_t{ 3 } - 10000);
+    char buf[16];
+    auto read = reader->read(buf, sizeof(buf));
+    REQUIRE(read.status == boost::io_status::error);
+    REQUIRE(read.err == EPROTO);
+    REQUIRE(read.count == 0);
+    auto written = writer->write("x", 1);
+    REQUIRE(written.status == boost::io_status::error);
+    REQUIRE(written.err == EPROTO);
+    ::munmap(mem, 4096);
+  }
+}
+
+TEST_CASE("Redirection::SharedRing") {
+  PopenConfig config;
+  config.stdin = Redirection::SharedRing{ 64 * 1024 };
+  config.stdout = Redirection::SharedRing{ 64 * 1024 };
+  config.stderr = Redirection::Pipe();
+
+  SECTION("the child finds its rings in the environment") {
+    auto sh = Popen::create({"sh", "-c",
+      "test -e /proc/self/fd/$SUBPROCESS_RING_STDIN && test -e /proc/self/fd/$SUBPROCESS_RING_STDOUT && echo ok >&2"},
+      config).or_throw();
+    REQUIRE(sh.ring_in.has_value());
+    REQUIRE(sh.ring_out.has_value());
+    REQUIRE_FALSE(sh.ring_err.has_value());
+    REQUIRE_FALSE(sh.std_in.has_value());
+    std::string line;
+    std::getline(*sh.std_err, line);
+    REQUIRE(line == "ok");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("data round-trips through a cooperating child") {
+    config.stderr = Redirection::None();
+    auto child = Popen::create({SUBPROCESS_RING_ECHO}, config).or_throw();
+
+    const size_t total = 4 << 20;
+    std::thread feeder([&] {
+      std::string chunk(100000, 'r');
+      for (size_t sent = 0; sent < total; sent += chunk.size()) {
+        child.ring_in->write(chunk.data(), std::min(chunk.size(), total - sent));
+      }
+      child.ring_in->close();
+    });
+    std::vector<char> buf(64 * 1024);
+    size_t received = 0;
+    boost::io_result res;
+    while ((res = child.ring_out->read(buf.data(), buf.size())).status == boost::io_status::ok) {
+      received += res.count;
+    }
+    feeder.join();
+    REQUIRE(res.status == boost::io_status::eof);
+    REQUIRE(received == total);
+    REQUIRE(child.wait().or_throw().success());
+  }
+
+  SECTION("inherited environment is kept alongside the ring variables") {
+    config.stdin = Redirection::None();
+    config.stdout = Redirection::SharedRing{};
+    config.stderr = Redirection::Pipe();
+    auto sh = Popen::create({"sh", "-c", "echo \"$HOME:${SUBPROCESS_RING_STDIN-unset}\" >&2"}, config).or_throw();
+    std::string line;
+    std::getline(*sh.std_err, line);
+    REQUIRE(line == std::string{ ::getenv("HOME") } + ":unset");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+}
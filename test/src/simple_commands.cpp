@@ -2,6 +2,7 @@
 #include <fcntl.h>
 #include <optional>
 #include <string>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "subprocess/Popen.hpp"
@@ -108,6 +109,90 @@ TEST_CASE("echo time") {
     REQUIRE(grep.std_out->slurp() == "brussels sprouts\nspinach\n");
   }
 
+  SECTION("exit codes are decoded") {
+    auto sh = Popen::create({"sh", "-c", "exit 3"}, PopenConfig{}).or_throw();
+    auto exit = sh.wait().or_throw();
+    REQUIRE_FALSE(exit.success());
+    REQUIRE(exit.toString() == "subprocess::ExitStatus::Exited(3)");
+  }
+
+  SECTION("merge stderr into stdout") {
+    PopenConfig config;
+    config.stdout = Redirection::Pipe();
+    config.stderr = Redirection::Merge();
+    auto sh = Popen::create({"sh", "-c", "echo out; echo err >&2"}, config).or_throw();
+    REQUIRE_FALSE(sh.std_err.has_value());
+    REQUIRE(sh.std_out->slurp() == "out\nerr\n");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+
+  SECTION("destroying a Popen reaps the child") {
+    pid_t pid;
+    {
+      PopenConfig config;
+      config.stdin = Redirection::Pipe();
+      auto cat = Popen::create({"cat"}, config).or_throw();
+      pid = *cat.pid();
+    }
+    // the destructor closed cat's stdin and waited for it, so the pid is gone
+    REQUIRE(::waitpid(pid, nullptr, WNOHANG) == -1);
+    REQUIRE(errno == ECHILD);
+  }
+
+  SECTION("communicate feeds stdin and collects both outputs") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    config.stderr = Redirection::Pipe();
+    // more than a pipe holds each way, so writing and reading must interleave
+    std::string input(1 << 20, 'x');
+    auto sh = Popen::create({"sh", "-c", "cat; echo done >&2; exit 3"}, config).or_throw();
+    auto data = sh.communicate(input).or_throw();
+    REQUIRE(data.stdout == input);
+    REQUIRE(data.stderr == "done\n");
+    REQUIRE(data.exit_status.get<ExitStatus::Exited>().code == 3);
+  }
+
+  SECTION("communicate survives a child that does not read its input") {
+    PopenConfig config;
+    config.stdin = Redirection::Pipe();
+    config.stdout = Redirection::Pipe();
+    // the write fails with EPIPE once `true` has gone, which under the
+    // default disposition would be SIGPIPE, killing us
+    std::string input(1 << 20, 'x');
+    auto t = Popen::create({"true"}, config).or_throw();
+    auto data = t.communicate(input).or_throw();
+    REQUIRE(data.stdout.empty());
+    REQUIRE(data.exit_status.toString() == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("a failed exec is reported by create") {
+    auto res = Popen::create({"/nonexistent/program"}, PopenConfig{});
+    REQUIRE_FALSE(res.ok());
+    REQUIRE(res.take_error().errnum == ENOENT);
+  }
+
+  SECTION("with async_exec, a failed exec is reported later") {
+    PopenConfig config;
+    config.async_exec = true;
+    auto missing = Popen::create({"/nonexistent/program"}, config).or_throw();
+    REQUIRE(missing.pid().has_value());
+    auto err = missing.exec_result();
+    REQUIRE(err.has_value());
+    REQUIRE(err->errnum == ENOENT);
+    REQUIRE(missing.exec_fd() == -1);
+    auto waited = missing.wait();
+    REQUIRE_FALSE(waited.ok());
+    REQUIRE(waited.take_error().errnum == ENOENT);
+    // reaped all the same
+    REQUIRE(missing.exit_status()->toString() == "subprocess::ExitStatus::Exited(127)");
+
+    auto sh = Popen::create({"sh", "-c", "exit 3"}, config).or_throw();
+    REQUIRE(sh.exec_fd() >= 0);
+    REQUIRE_FALSE(sh.exec_result().has_value());
+    REQUIRE(sh.wait().or_throw().toString() == "subprocess::ExitStatus::Exited(3)");
+  }
+
   // SECTION("porcelain") {
   //   auto res = Exec("echo yolo") | Exec("cat") > Redirection::Write("output.txt")
   // }
@@ -0,0 +1,112 @@
+#include "subprocess/MessageSocket.hpp"
+#include "subprocess/Popen.hpp"
+#include "subprocess/posix.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("MessageSocket") {
+  SECTION("seqpacket keeps message boundaries, batched or not") {
+    auto [a, b] = MessageSocket::pair(SOCK_SEQPACKET).or_throw();
+    REQUIRE(a.send("one", 3).status == boost::io_status::ok);
+    auto sent = a.send_batch({ "two", "three", "four" });
+    REQUIRE(sent.status == boost::io_status::ok);
+    REQUIRE(sent.count == 3);
+
+    char buf[16];
+    auto first = b.recv(buf, sizeof(buf));
+    REQUIRE(first.status == boost::io_status::ok);
+    REQUIRE(std::string(buf, first.count) == "one");
+
+    std::vector<std::string> rest;
+    auto got = b.recv_batch(rest, 8, 16);
+    REQUIRE(got.count == 3);
+    REQUIRE(rest == std::vector<std::string>{ "two", "three", "four" });
+
+    a.close();
+    REQUIRE(b.recv(buf, sizeof(buf)).status == boost::io_status::eof);
+  }
+
+  SECTION("a message too long for the buffer is reported") {
+    auto [a, b] = MessageSocket::pair(SOCK_SEQPACKET).or_throw();
+    a.send("0123456789", 10);
+    char buf[4];
+    auto res = b.recv(buf, sizeof(buf));
+    REQUIRE(res.status == boost::io_status::error);
+    REQUIRE(res.err == EMSGSIZE);
+  }
+
+  SECTION("open files are passed with SCM_RIGHTS") {
+    auto [a, b] = MessageSocket::pair(SOCK_SEQPACKET).or_throw();
+    auto [read_end, write_end] = subprocess::pipe().or_throw();
+    REQUIRE(a.send("pipe", 4, std::vector<int>{ read_end }).status == boost::io_status::ok);
+    ::close(read_end);
+
+    char buf[8];
+    std::vector<int> fds;
+    auto res = b.recv(buf, sizeof(buf), &fds);
+    REQUIRE(res.status == boost::io_status::ok);
+    REQUIRE(fds.size() == 1);
+    REQUIRE((::fcntl(fds[0], F_GETFD) & FD_CLOEXEC) != 0);
+
+    ::write(write_end, "hi", 2);
+    ::close(write_end);
+    REQUIRE(::read(fds[0], buf, sizeof(buf)) == 2);
+    ::close(fds[0]);
+  }
+
+  SECTION("nonblocking sockets report would_block, or wait for a deadline") {
+    auto [a, b] = MessageSocket::pair(SOCK_SEQPACKET).or_throw();
+    set_nonblocking(b.fd(), true);
+    char buf[4];
+    REQUIRE(b.recv(buf, sizeof(buf)).status == boost::io_status::would_block);
+    auto res = b.recv(buf, sizeof(buf), nullptr, std::chrono::steady_clock::now() + 10ms);
+    REQUIRE(res.status == boost::io_status::timed_out);
+  }
+}
+
+TEST_CASE("Redirection::Socket") {
+  PopenConfig config;
+  config.stdin = Redirection::Socket{};
+  config.stdout = Redirection::Socket{};
+
+  SECTION("a child's reads and writes stay framed") {
+    auto cat = Popen::create({"cat"}, config).or_throw();
+    REQUIRE(cat.sock_in.has_value());
+    REQUIRE(cat.sock_out.has_value());
+    REQUIRE_FALSE(cat.std_in.has_value());
+
+    auto sent = cat.sock_in->send_batch({ "alpha", "beta", "gamma" });
+    REQUIRE(sent.count == 3);
+    cat.sock_in->shutdown_write();
+
+    std::vector<std::string> messages;
+    while (messages.size() < 3) {
+      auto res = cat.sock_out->recv_batch(messages, 4, 64);
+      if (res.status != boost::io_status::ok) break;
+    }
+    REQUIRE(messages == std::vector<std::string>{ "alpha", "beta", "gamma" });
+    REQUIRE(cat.wait().or_throw().success());
+  }
+
+  SECTION("stream sockets work like pipes") {
+    config.stdin = Redirection::Socket{ SOCK_STREAM };
+    config.stdout = Redirection::Socket{ SOCK_STREAM };
+    config.stderr = Redirection::Merge();
+    auto sh = Popen::create({"sh", "-c", "read x; echo out $x; echo err $x >&2"}, config).or_throw();
+    sh.sock_in->send("42\n", 3);
+    std::string output;
+    char buf[64];
+    boost::io_result res;
+    while ((res = sh.sock_out->recv(buf, sizeof(buf))).status == boost::io_status::ok) {
+      output.append(buf, res.count);
+    }
+    REQUIRE(output == "out 42\nerr 42\n");
+    REQUIRE(sh.wait().or_throw().success());
+  }
+}
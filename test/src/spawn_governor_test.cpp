@@ -0,0 +1,98 @@
+#include "subprocess/SpawnGovernor.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("spawn governor") {
+  PopenConfig config;
+  SpawnGovernor::Options options;
+
+  SECTION("a spawn over max_live is refused, until a child exits") {
+    options.max_live = 2;
+    options.queue_timeout = 0ms;
+    SpawnGovernor governor{ options };
+    auto first = governor.spawn({"sleep", "100"}, config).or_throw();
+    auto second = governor.spawn({"sleep", "100"}, config).or_throw();
+
+    auto third = governor.spawn({"true"}, config);
+    REQUIRE(!third.ok());
+    REQUIRE(third.take_error().kind == PopenError::Overloaded);
+    REQUIRE(governor.stats().rejected == 1);
+
+    second.kill_tree();
+    REQUIRE(second.wait().or_throw().toString() == "subprocess::ExitStatus::Signaled(9)");
+    REQUIRE(governor.live() == 1);
+    governor.spawn({"true"}, config).or_throw().wait().or_throw();
+    REQUIRE(governor.stats().spawned == 3);
+    first.kill_tree();
+    first.wait().or_throw();
+  }
+
+  SECTION("concurrent spawns do not overshoot max_live") {
+    options.max_live = 2;
+    options.queue_timeout = 0ms;
+    SpawnGovernor governor{ options };
+    std::atomic<bool> go{ false };
+    std::vector<std::optional<Popen>> children(8);
+    std::vector<std::thread> threads;
+    for (auto& child : children) {
+      threads.emplace_back([&] {
+        while (!go.load()) std::this_thread::yield();
+        auto res = governor.spawn({"sleep", "100"}, config);
+        if (res.ok()) child.emplace(res.take_value());
+      });
+    }
+    go.store(true);
+    for (auto& thread : threads) thread.join();
+
+    size_t spawned = 0;
+    for (auto& child : children) {
+      if (!child.has_value()) continue;
+      spawned++;
+      child->kill_tree();
+      child->wait().or_throw();
+    }
+    REQUIRE(spawned == 2);
+    REQUIRE(governor.stats().rejected == 6);
+  }
+
+  SECTION("a spawn waits for room until its deadline") {
+    options.max_live = 1;
+    SpawnGovernor governor{ options };
+    auto first = governor.spawn({"sleep", "0.2"}, config).or_throw();
+    auto start = std::chrono::steady_clock::now();
+    auto second = governor.spawn({"true"}, config, start + 10s).or_throw();
+    REQUIRE(std::chrono::steady_clock::now() - start >= 150ms);
+    second.wait().or_throw();
+    first.wait().or_throw();
+  }
+
+  SECTION("spawns are paced by the rate limit") {
+    options.max_spawns_per_second = 20;
+    options.burst = 1;
+    SpawnGovernor governor{ options };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Popen> children;
+    for (int i = 0; i < 5; i++) children.push_back(governor.spawn({"true"}, config).or_throw());
+    // the first is free, the other four wait 50ms each
+    REQUIRE(std::chrono::steady_clock::now() - start >= 150ms);
+    for (auto& child : children) child.wait().or_throw();
+  }
+
+  SECTION("a cgroup without the control files is ignored") {
+    options.cgroup = "/nonexistent";
+    options.max_memory_pressure = 1;
+    options.queue_timeout = 0ms;
+    SpawnGovernor governor{ options };
+    governor.spawn({"true"}, config).or_throw().wait().or_throw();
+  }
+}
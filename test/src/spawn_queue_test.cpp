@@ -0,0 +1,89 @@
+#include "subprocess/SpawnQueue.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace subprocess;
+
+TEST_CASE("SpawnQueue") {
+  // job id -> tenant, and the tenants in the order their jobs exited
+  std::map<SpawnQueue::JobId, std::string> owners;
+  std::vector<std::string> order;
+  SpawnQueue::Handlers handlers;
+  handlers.on_exit = [&](SpawnQueue::JobId id, Popen& child) {
+    REQUIRE(child.exit_status().has_value());
+    order.push_back(owners.at(id));
+  };
+
+  SECTION("a tenant with many jobs does not hold back one with few") {
+    // one at a time, so jobs exit in the order they start
+    SpawnQueue queue{ handlers, SpawnQueue::Options{ 1 } };
+    for (int i = 0; i < 20; i++) owners[queue.submit("heavy", { "true" })] = "heavy";
+    for (int i = 0; i < 2; i++) owners[queue.submit("light", { "true" })] = "light";
+    REQUIRE(queue.queued() == 22);
+    REQUIRE_FALSE(queue.run().has_value());
+
+    REQUIRE(order.size() == 22);
+    auto last_light = std::find(order.rbegin(), order.rend(), "light");
+    REQUIRE(std::distance(last_light, order.rend()) <= 4);
+
+    auto heavy = *queue.stats("heavy");
+    REQUIRE(heavy.submitted == 20);
+    REQUIRE(heavy.started == 20);
+    REQUIRE(heavy.finished == 20);
+    REQUIRE(heavy.queued == 0);
+    REQUIRE(heavy.running == 0);
+    REQUIRE(heavy.max_queue_wait > queue.stats("light")->max_queue_wait);
+    REQUIRE(heavy.run_time.count() > 0);
+    REQUIRE_FALSE(queue.stats("nobody").has_value());
+  }
+
+  SECTION("jobs start in proportion to the tenants' weights") {
+    SpawnQueue queue{ handlers, SpawnQueue::Options{ 1 } };
+    queue.set_tenant("big", SpawnQueue::TenantOptions{ 3, 0 });
+    for (int i = 0; i < 16; i++) {
+      owners[queue.submit("big", { "true" })] = "big";
+      owners[queue.submit("small", { "true" })] = "small";
+    }
+    REQUIRE_FALSE(queue.run().has_value());
+    // while both have jobs queued, 3 of every 4 are big's
+    auto big = std::count(order.begin(), order.begin() + 16, "big");
+    REQUIRE(big >= 11);
+    REQUIRE(big <= 13);
+  }
+
+  SECTION("a tenant's cap leaves the other slots to the others") {
+    SpawnQueue queue{ handlers, SpawnQueue::Options{ 4 } };
+    queue.set_tenant("capped", SpawnQueue::TenantOptions{ 1, 1 });
+    for (int i = 0; i < 4; i++) owners[queue.submit("capped", { "sleep", "0.05" })] = "capped";
+    owners[queue.submit("other", { "true" })] = "other";
+    REQUIRE(queue.dispatch() == 2);
+    REQUIRE(queue.stats("capped")->running == 1);
+    REQUIRE(queue.stats("other")->running == 1);
+    REQUIRE_FALSE(queue.run().has_value());
+    REQUIRE(queue.stats("capped")->finished == 4);
+  }
+
+  SECTION("a higher priority job goes first") {
+    SpawnQueue queue{ handlers, SpawnQueue::Options{ 1 } };
+    for (int i = 0; i < 5; i++) owners[queue.submit("batch", { "true" }, PopenConfig{}, SpawnQueue::Priority::Low)] = "batch";
+    owners[queue.submit("batch", { "true" }, PopenConfig{}, SpawnQueue::Priority::High)] = "urgent";
+    REQUIRE_FALSE(queue.run().has_value());
+    REQUIRE(order.front() == "urgent");
+  }
+
+  SECTION("a job that cannot be spawned is reported and counted") {
+    std::vector<SpawnQueue::JobId> failed;
+    handlers.on_error = [&](SpawnQueue::JobId id, const PopenError&) { failed.push_back(id); };
+    SpawnQueue queue{ handlers };
+    auto id = queue.submit("t", { "/nonexistent/program" });
+    REQUIRE_FALSE(queue.run().has_value());
+    REQUIRE(failed == std::vector<SpawnQueue::JobId>{ id });
+    REQUIRE(queue.stats("t")->failed == 1);
+    REQUIRE(queue.stats("t")->started == 0);
+  }
+}
@@ -0,0 +1,100 @@
+#include <catch2/catch.hpp>
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "subprocess/Popen.hpp"
+#include "subprocess/StreamBufferPool.hpp"
+
+using namespace subprocess;
+
+TEST_CASE("stream buffer pool") {
+  SECTION("buffers are page aligned and reused") {
+    char* first = StreamBufferPool::acquire();
+    REQUIRE(reinterpret_cast<uintptr_t>(first) % StreamBufferPool::buffer_size == 0);
+    first[StreamBufferPool::buffer_size - 1] = 'x';
+    StreamBufferPool::release(first);
+    REQUIRE(StreamBufferPool::acquire() == first);
+    StreamBufferPool::release(first);
+  }
+
+  SECTION("a buffer may be given back by another thread") {
+    char* buffer = StreamBufferPool::acquire();
+    std::thread{ [buffer] { StreamBufferPool::release(buffer); } }.join();
+    // the exiting thread handed it on to the shared list
+    auto slabs = StreamBufferPool::stats().slabs;
+    char* again = StreamBufferPool::acquire();
+    REQUIRE(again != nullptr);
+    REQUIRE(StreamBufferPool::stats().slabs == slabs);
+    StreamBufferPool::release(again);
+  }
+
+  SECTION("buffers released on another thread are reused") {
+    // one thread acquires, a long-lived other releases, over and over
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<char*> handed;
+    bool done = false;
+    std::thread releaser{ [&] {
+      std::unique_lock<std::mutex> lock{ mutex };
+      while (true) {
+        changed.wait(lock, [&] { return done || !handed.empty(); });
+        if (handed.empty()) return;
+        for (char* buffer : handed) StreamBufferPool::release(buffer);
+        handed.clear();
+        changed.notify_all();
+      }
+    } };
+    auto round = [&] {
+      std::vector<char*> buffers;
+      for (int i = 0; i < 1000; i++) buffers.push_back(StreamBufferPool::acquire());
+      std::unique_lock<std::mutex> lock{ mutex };
+      handed = std::move(buffers);
+      changed.notify_all();
+      changed.wait(lock, [&] { return handed.empty(); });
+    };
+    // the releaser's own list fills up in the first two
+    round();
+    round();
+    auto slabs = StreamBufferPool::stats().slabs;
+    for (int i = 0; i < 10; i++) round();
+    {
+      std::lock_guard<std::mutex> lock{ mutex };
+      done = true;
+      changed.notify_all();
+    }
+    releaser.join();
+    REQUIRE(StreamBufferPool::stats().slabs == slabs);
+  }
+
+  SECTION("huge pages fall back to normal ones") {
+    StreamBufferPool::configure({ 2 * StreamBufferPool::buffer_size, true });
+    std::thread{ [] {
+      char* buffer = StreamBufferPool::acquire();
+      buffer[0] = 'x';
+      StreamBufferPool::release(buffer);
+    } }.join();
+    StreamBufferPool::configure({});
+  }
+
+  SECTION("a stream is only given a buffer once read, and keeps it when moved") {
+    PopenConfig config;
+    config.stdout = Redirection::Pipe();
+    auto acquired = StreamBufferPool::stats().acquired;
+    auto sh = Popen::create({"sh", "-c", "echo one; echo two"}, config).or_throw();
+    REQUIRE(StreamBufferPool::stats().acquired == acquired);
+    std::string line;
+    std::getline(*sh.std_out, line);
+    REQUIRE(line == "one");
+    REQUIRE(StreamBufferPool::stats().acquired == acquired + 1);
+    // "two" may already sit in the buffer; it must move along with it
+    Popen moved{ std::move(sh) };
+    REQUIRE(moved.std_out->slurp() == "two\n");
+    REQUIRE(moved.wait().or_throw().success());
+  }
+}
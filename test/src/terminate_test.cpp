@@ -0,0 +1,130 @@
+#include "subprocess/Popen.hpp"
+#include "subprocess/posix.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+namespace {
+  // Ignores SIGTERM, and so does the background sleep it leaves behind,
+  // in its own process group; says "ready" once that is so. Without a
+  // group, it is a single process.
+  Popen start_stubborn(bool setpgid) {
+    PopenConfig config;
+    config.setpgid = setpgid;
+    config.stdout = Redirection::Pipe();
+    auto script = setpgid ? "trap '' TERM; sleep 100 & echo ready; sleep 100"
+                          : "trap '' TERM; echo ready; exec sleep 100";
+    auto sh = Popen::create({"sh", "-c", script}, config).or_throw();
+    std::string line;
+    std::getline(*sh.std_out, line);
+    REQUIRE(line == "ready");
+    return sh;
+  }
+
+  std::string status_of(Popen& popen, std::chrono::milliseconds grace) {
+    return popen.terminate(grace).or_throw().toString();
+  }
+}  // namespace
+
+TEST_CASE("terminate") {
+  PopenConfig config;
+
+  SECTION("a child that exits on SIGTERM is not killed") {
+    auto sleep = Popen::create({"sleep", "100"}, config).or_throw();
+    REQUIRE(status_of(sleep, 10s) == "subprocess::ExitStatus::Signaled(15)");
+  }
+
+  SECTION("a child that ignores SIGTERM is killed after the grace period") {
+    auto sh = start_stubborn(false);
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(status_of(sh, 100ms) == "subprocess::ExitStatus::Signaled(9)");
+    REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+  }
+
+  SECTION("the whole process group is killed") {
+    // the background sleep holds the write end of our pipe; only once it
+    // is dead does the read end see end of file
+    auto [read_end, write_end] = subprocess::pipe().or_throw();
+    config.setpgid = true;
+    config.stdout = Redirection::FileDescriptor{ write_end };
+    auto sh = Popen::create({"sh", "-c", "trap '' TERM; sleep 100 & echo ready; sleep 100"}, config).or_throw();
+    ::close(write_end);
+    char ready[6];
+    REQUIRE(::read(read_end, ready, sizeof(ready)) == sizeof(ready));
+    REQUIRE(status_of(sh, 100ms) == "subprocess::ExitStatus::Signaled(9)");
+    REQUIRE(::read(read_end, ready, 1) == 0);
+    ::close(read_end);
+  }
+
+  SECTION("kill_tree closes our ends of the pipes") {
+    auto sh = start_stubborn(true);
+    REQUIRE_FALSE(sh.kill_tree().has_value());
+    REQUIRE_FALSE(sh.std_out->is_open());
+    REQUIRE(sh.wait().or_throw().toString() == "subprocess::ExitStatus::Signaled(9)");
+  }
+
+  SECTION("a child that exits in time keeps its unread output") {
+    config.stdout = Redirection::Pipe();
+    config.stderr = Redirection::Pipe();
+    auto sh = Popen::create({"sh", "-c", "echo bye; echo ready >&2; exec sleep 100"}, config).or_throw();
+    std::string line;
+    std::getline(*sh.std_err, line);
+    REQUIRE(line == "ready");
+    REQUIRE(status_of(sh, 10s) == "subprocess::ExitStatus::Signaled(15)");
+    REQUIRE(sh.std_out->is_open());
+    std::getline(*sh.std_out, line);
+    REQUIRE(line == "bye");
+  }
+
+  SECTION("once the leader is waited for, its group is not signaled") {
+    // the group id may belong to someone else by then
+    config.setpgid = true;
+    config.stdout = Redirection::Pipe();
+    auto sh = Popen::create({"sh", "-c", "sleep 100 >/dev/null & echo $!"}, config).or_throw();
+    std::string line;
+    std::getline(*sh.std_out, line);
+    auto member = static_cast<pid_t>(std::stol(line));
+    REQUIRE(sh.wait().or_throw().success());
+    REQUIRE_FALSE(sh.signal_tree(SIGKILL).has_value());
+    REQUIRE(::kill(member, 0) == 0);
+    ::kill(member, SIGKILL);
+  }
+
+  SECTION("signaling a finished child does nothing") {
+    auto t = Popen::create({"true"}, config).or_throw();
+    REQUIRE(t.wait().or_throw().success());
+    REQUIRE_FALSE(t.send_signal(SIGKILL).has_value());
+    REQUIRE(status_of(t, 0ms) == "subprocess::ExitStatus::Exited(0)");
+  }
+}
+
+TEST_CASE("terminate_all") {
+  PopenConfig config;
+  config.setpgid = true;
+  std::vector<Popen> children;
+  for (int i = 0; i < 50; i++) {
+    children.push_back(i % 2 ? start_stubborn(true) : Popen::create({"sleep", "100"}, config).or_throw());
+  }
+  std::vector<Popen*> popens;
+  for (auto& child : children) popens.push_back(&child);
+
+  auto start = std::chrono::steady_clock::now();
+  auto results = Popen::terminate_all(popens, 200ms);
+  // one grace period for all, not one each
+  REQUIRE(std::chrono::steady_clock::now() - start < 5s);
+  REQUIRE(results.size() == children.size());
+  for (size_t i = 0; i < results.size(); i++) {
+    REQUIRE(results[i].ok());
+    auto signo = i % 2 ? 9 : 15;
+    REQUIRE(results[i].take_value().toString() == "subprocess::ExitStatus::Signaled(" + std::to_string(signo) + ")");
+  }
+}
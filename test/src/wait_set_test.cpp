@@ -0,0 +1,93 @@
+#include "subprocess/WaitSet.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace subprocess;
+using namespace std::chrono_literals;
+
+TEST_CASE("WaitSet") {
+  WaitSet set;
+
+  SECTION("wait_any returns the child that finished first") {
+    auto slow = Popen::create({ "sleep", "100" }, PopenConfig{}).or_throw();
+    auto fast = Popen::create({ "sh", "-c", "exit 3" }, PopenConfig{}).or_throw();
+    REQUIRE_FALSE(set.add(slow).has_value());
+    REQUIRE_FALSE(set.add(fast).has_value());
+    REQUIRE(set.size() == 2);
+
+    REQUIRE(set.wait_any().or_throw() == 1);
+    REQUIRE(set.finished().size() == 1);
+    REQUIRE(set.finished().front() == &fast);
+    REQUIRE(fast.exit_status()->toString() == "subprocess::ExitStatus::Exited(3)");
+    REQUIRE(set.size() == 1);
+
+    slow.kill_tree();
+    REQUIRE(set.wait_any().or_throw() == 1);
+    REQUIRE(set.finished().front() == &slow);
+    REQUIRE(slow.exit_status()->toString() == "subprocess::ExitStatus::Signaled(9)");
+    REQUIRE(set.size() == 0);
+  }
+
+  SECTION("wait_any gives up at the deadline") {
+    auto child = Popen::create({ "sleep", "100" }, PopenConfig{}).or_throw();
+    set.add(child);
+    auto start = WaitSet::Clock::now();
+    REQUIRE(set.wait_any(start + 50ms).or_throw() == 0);
+    REQUIRE(WaitSet::Clock::now() - start >= 50ms);
+    REQUIRE(set.finished().empty());
+    REQUIRE(set.size() == 1);
+    REQUIRE(child.pid().has_value());
+    child.kill_tree();
+    set.remove(child);
+    REQUIRE(set.size() == 0);
+  }
+
+  SECTION("wait_all reaps every child") {
+    std::vector<Popen> children;
+    children.reserve(20);
+    for (int i = 0; i < 20; i++) {
+      children.push_back(Popen::create({ "sh", "-c", "exit " + std::to_string(i) }, PopenConfig{}).or_throw());
+    }
+    for (auto& child : children) set.add(child);
+
+    REQUIRE(set.wait_all().or_throw() == 20);
+    REQUIRE(set.finished().size() == 20);
+    REQUIRE(set.size() == 0);
+    for (int i = 0; i < 20; i++) {
+      auto& child = children[static_cast<size_t>(i)];
+      REQUIRE(child.exit_status()->toString() == "subprocess::ExitStatus::Exited(" + std::to_string(i) + ")");
+    }
+    // and the set is empty now
+    REQUIRE(set.wait_any().or_throw() == 0);
+  }
+
+  SECTION("a child that has already finished is reported at once") {
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    child.wait().or_throw();
+    set.add(child);
+    REQUIRE(set.wait_any(WaitSet::Clock::now()).or_throw() == 1);
+    REQUIRE(set.finished().front() == &child);
+  }
+
+  SECTION("a child reaped by another thread is still reported") {
+    auto child = Popen::create({ "sleep", "0.05" }, PopenConfig{}).or_throw();
+    set.add(child);
+    std::thread waiter([&] { child.wait(); });
+    REQUIRE(set.wait_any().or_throw() == 1);
+    waiter.join();
+    REQUIRE(child.exit_status()->toString() == "subprocess::ExitStatus::Exited(0)");
+  }
+
+  SECTION("a child cannot be added twice") {
+    auto child = Popen::create({ "true" }, PopenConfig{}).or_throw();
+    set.add(child);
+    auto err = set.add(child);
+    REQUIRE(err.has_value());
+    REQUIRE(err->kind == PopenError::LogicError);
+  }
+}